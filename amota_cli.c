@@ -64,6 +64,7 @@
 
 #include "console_task.h"
 #include "ble.h"
+#include "ble_buf.h"
 #include "amota_cli.h"
 
 static portBASE_TYPE amota_command(char *pcWriteBuffer, size_t xWriteBufferLen,
@@ -74,43 +75,112 @@ CLI_Command_Definition_t amota_command_definition = {
     (const char *const) "amota:\tAMOTA Framework.\r\n",
     amota_command, -1};
 
-static portBASE_TYPE amota_command(char *pcWriteBuffer, size_t xWriteBufferLen,
+static portBASE_TYPE amota_start(cli_writer_t *writer,
                                  const char *pcCommandString)
 {
-    const char *pcParameterString;
-    portBASE_TYPE xParameterStringLength;
+    AppAdvStart(APP_MODE_AUTO_INIT);
 
-    pcWriteBuffer[0] = 0x0;
+    return pdFALSE;
+}
+
+static portBASE_TYPE amota_stop(cli_writer_t *writer,
+                                const char *pcCommandString)
+{
+    AppAdvStop();
 
-    pcParameterString =
-        FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameterStringLength);
-    if (pcParameterString == NULL)
+    return pdFALSE;
+}
+
+static portBASE_TYPE amota_connected(cli_writer_t *writer,
+                                     const char *pcCommandString)
+{
+    dmConnId_t connId = AppConnIsOpen();
+
+    if (connId == DM_CONN_ID_NONE)
     {
-        return pdFALSE;
+        cli_writer_puts(writer, "AMOTA: not connected");
+    }
+    else
+    {
+        cli_writer_puts(writer, "AMOTA: connected");
     }
 
-    if (strncmp(pcParameterString, "start", xParameterStringLength) == 0)
+    return pdFALSE;
+}
+
+static portBASE_TYPE amota_buffers_recommend(cli_writer_t *writer)
+{
+    wsfBufPoolDesc_t pools[BLE_BUF_POOLS];
+    uint32_t total = 0;
+    uint8_t count = ble_buf_recommend(pools);
+
+    if (count == 0)
     {
-        AppAdvStart(APP_MODE_AUTO_INIT);
+        cli_writer_error(writer, "nothing recorded, build with "
+                                 "BLE_BUF_RECORD=1\r\n");
+        return pdFALSE;
     }
-    else if (strncmp(pcParameterString, "stop", xParameterStringLength) == 0)
+
+    cli_writer_printf(writer, "#define WSF_BUF_POOLS %d\r\n", count);
+    cli_writer_puts(writer, "static wsfBufPoolDesc_t "
+                            "g_psPoolDescriptors[WSF_BUF_POOLS] =\r\n{\r\n");
+    for (uint8_t i = 0; i < count; i++)
     {
-        AppAdvStop();
+        cli_writer_printf(writer, "    { %3d, %2d }%s\r\n", pools[i].len,
+                          pools[i].num, (i + 1 < count) ? "," : "");
+        total += pools[i].len * pools[i].num + 16;
     }
-    else if (strncmp(pcParameterString, "connected", xParameterStringLength) == 0)
+    cli_writer_printf(writer, "};\r\n%d bytes\r\n", total);
+
+    return pdFALSE;
+}
+
+static portBASE_TYPE amota_buffers(cli_writer_t *writer,
+                                   const char *pcCommandString)
+{
+    ble_buf_pool_stats_t pools[BLE_BUF_POOLS];
+    uint8_t count;
+
+    // "recommend" is the only keyword of the table entry
+    if (cli_table_keyword() != CLI_TABLE_NO_KEYWORD)
     {
-        dmConnId_t connId = AppConnIsOpen();
-
-        if (connId == DM_CONN_ID_NONE)
-        {
-            strcat(pcWriteBuffer, "AMOTA: not connected");
-        }
-        else
-        {
-            strcat(pcWriteBuffer, "AMOTA: connected");
-        }
+        return amota_buffers_recommend(writer);
     }
 
+    count = ble_buf_stats(pools);
+    cli_writer_puts(writer, "size  num  used  high  allocs  failures\r\n");
+    for (uint8_t i = 0; i < count; i++)
+    {
+        cli_writer_printf(writer, "%4d  %3d  %4d  %4d  %6d  %8d\r\n",
+                          pools[i].size, pools[i].count, pools[i].in_use,
+                          pools[i].high_water, pools[i].allocs,
+                          pools[i].failures);
+    }
+    cli_writer_printf(writer, "largest request %d bytes\r\n",
+                      ble_buf_max_request());
 
     return pdFALSE;
 }
+
+// Sorted by name
+static const cli_subcommand_t amota_subcommands[] = {
+    {"buffers", "[recommend]",
+     "Show the use of the WSF buffer pools, or the pool table recommended\r\n"
+     "for the workload recorded with BLE_BUF_RECORD.\r\n",
+     0, 1, amota_buffers, "recommend"},
+    {"connected", NULL, "Show whether an AMOTA client is connected.\r\n", 0,
+     0, amota_connected},
+    {"start", NULL, "Start advertising the AMOTA service.\r\n", 0, 0,
+     amota_start},
+    {"stop", NULL, "Stop advertising.\r\n", 0, 0, amota_stop},
+};
+
+const cli_table_t amota_command_table =
+    CLI_TABLE("amota", amota_subcommands);
+
+static portBASE_TYPE amota_command(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString)
+{
+    return cli_table_dispatch(&amota_command_table, pcWriteBuffer,
+                              xWriteBufferLen, pcCommandString);
+}
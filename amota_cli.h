@@ -35,6 +35,9 @@
 #include <FreeRTOS.h>
 #include <FreeRTOS_CLI.h>
 
+#include "cli_table.h"
+
 extern CLI_Command_Definition_t amota_command_definition;
+extern const cli_table_t amota_command_table;
 
 #endif /* _AMOTA_CLI_H_ */
@@ -57,6 +57,8 @@
 #include "am_util.h"
 #include "am_bootloader.h"
 
+#include "lorawan_config.h"
+
 //*****************************************************************************
 //
 // Location of the new image storage in internal flash.
@@ -74,7 +76,11 @@
 // Make sure the size is flash page multiple
 // (Default value is determined based on rest of flash from the start)
 //
-#define AMOTA_INT_FLASH_OTA_MAX_SIZE        (AM_HAL_FLASH_LARGEST_VALID_ADDR - AMOTA_INT_FLASH_OTA_ADDRESS + 1)
+// The top of the flash is reserved for the LoRaWAN persistent storage
+// starting at LORAWAN_FLASH_RESERVED_ADDRESS in lorawan_config.h.
+//
+#define AMOTA_INT_FLASH_RESERVED_SIZE       (AM_HAL_FLASH_LARGEST_VALID_ADDR + 1 - LORAWAN_FLASH_RESERVED_ADDRESS)
+#define AMOTA_INT_FLASH_OTA_MAX_SIZE        (AM_HAL_FLASH_LARGEST_VALID_ADDR - AMOTA_INT_FLASH_OTA_ADDRESS + 1 - AMOTA_INT_FLASH_RESERVED_SIZE)
 
 
 // OTA Descriptor address by reserving 256K bytes app image size
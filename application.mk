@@ -32,13 +32,15 @@ BSP_DIR := $(NM_SDK)/bsp/nm180100evb
 TARGET_VERSION := 0x00
 
 ifdef DEBUG
-    TARGET      := lorable-dev
-    TARGET_OTA  := lorable_ota-dev
-    TARGET_WIRE := lorable_wire-dev
+    TARGET       := lorable-dev
+    TARGET_OTA   := lorable_ota-dev
+    TARGET_WIRE  := lorable_wire-dev
+    TARGET_FUOTA := lorable_fuota-dev
 else
-    TARGET      := lorable
-    TARGET_OTA  := lorable_ota
-    TARGET_WIRE := lorable_wire
+    TARGET       := lorable
+    TARGET_OTA   := lorable_ota
+    TARGET_WIRE  := lorable_wire
+    TARGET_FUOTA := lorable_fuota
 endif
 
 #******************************************************************************
@@ -84,18 +86,69 @@ INCLUDES += -I./soft-se
 VPATH += $(NM_SDK)/platform/console
 VPATH += ./soft-se
 
-SRC += console_task.c
+# console.c replaces the SDK console_task.c, see console_uart.c
 SRC += gpio_service.c
 SRC += iom_service.c
 
 DEFINES += -DSOFT_SE
+
+# FUOTA sessions, see lorawan_fuota.c.  Fragments of up to 239 bytes (a
+# 242 byte payload less the fragment header) and as many as it takes to
+# fill the 0x9E000 bytes of AMOTA_INT_FLASH_OTA_MAX_SIZE.  The decoder is
+# built from source with these in every build, see makedefs/nm_loramac.mk.
+DEFINES += -DFRAG_MAX_SIZE=239
+DEFINES += -DFRAG_MAX_NB=2708
+
+# WSF buffer pool statistics, see ble_buf.c
+LFLAGS += -Wl,--wrap=WsfBufAlloc
+LFLAGS += -Wl,--wrap=WsfBufFree
+
+# wake the LoRaWAN task when a LoRaMac timer expires, see lorawan.c
+LFLAGS += -Wl,--wrap=TimerIrqHandler
+
+# wake the BLE task when a WSF handler becomes ready, see ble.c
+LFLAGS += -Wl,--wrap=WsfSetEvent
+LFLAGS += -Wl,--wrap=WsfTaskSetReady
+ifdef BLE_BUF_RECORD
+    DEFINES += -DBLE_BUF_RECORD=$(BLE_BUF_RECORD)
+endif
+
 SRC += aes.c
 SRC += cmac.c
 SRC += soft-se.c
 SRC += soft-se-hal.c
 
 SRC += ble.c
+SRC += ble_buf.c
 SRC += lorawan.c
+SRC += lorawan_join_scheduler.c
+SRC += lorawan_journal.c
+SRC += lorawan_coalesce.c
+SRC += lorawan_fragment.c
+SRC += lorawan_confirmed.c
+SRC += lorawan_mac_request.c
+SRC += lorawan_class_policy.c
+SRC += lorawan_fuota.c
+SRC += lorawan_airtime.c
+SRC += lorawan_budget.c
+SRC += lorawan_rx_calibration.c
+SRC += lorawan_downlink.c
+SRC += lorawan_drain.c
+SRC += lorawan_bench.c
+SRC += lorawan_buffer.c
+SRC += lorawan_frame.c
+SRC += lorawan_frame_uart.c
+SRC += console.c
+SRC += console_uart.c
+SRC += idle_stats.c
+SRC += lorawan_payload.c
+SRC += cli_batch.c
+SRC += cli_table.c
+SRC += cli_writer.c
+SRC += token_log.c
+SRC += token_log_cli.c
+SRC += lorawan_log.c
+SRC += lorawan_stats.c
 SRC += lorawan_cli.c
 SRC += application.c
 
@@ -39,7 +39,11 @@
 #include <am_mcu_apollo.h>
 #include <am_util.h>
 
+#include <FreeRTOS.h>
+#include <task.h>
+
 #include <wsf_types.h>
+#include <wsf_os.h>
 #include <wsf_trace.h>
 #include <wsf_buf.h>
 #include <wsf_timer.h>
@@ -69,26 +73,99 @@
 #include "app_ui.h"
 
 #include "ble.h"
+#include "ble_buf.h"
 #include "amota_cli.h"
+#include "lorawan_class_policy.h"
+#include "lorawan_config.h"
 #include "console_task.h"
 #include "task_message.h"
+#include "token_log.h"
 
 TaskHandle_t ble_task_handle;
 
+static ble_task_stats_t ble_task_counters;
+
+extern void __real_WsfSetEvent(wsfHandlerId_t handlerId, wsfEventMask_t event);
+extern void __real_WsfTaskSetReady(wsfHandlerId_t handlerId,
+                                   wsfTaskEvent_t event);
+
+// recording the buffer use for a new pool table needs room to spare
+#if BLE_BUF_RECORD
+#define WSF_BUF_SCALE               2
+#else
+#define WSF_BUF_SCALE               1
+#endif
+
 #define WSF_BUF_POOLS               4
 static uint32_t g_pui32BufMem[
         (WSF_BUF_POOLS*16
-         + 16*8 + 32*4 + 64*6 + 280*8) / sizeof(uint32_t)];
+         + (16*8 + 32*4 + 64*6 + 280*8) * WSF_BUF_SCALE) / sizeof(uint32_t)];
 
 static wsfBufPoolDesc_t g_psPoolDescriptors[WSF_BUF_POOLS] =
 {
-    {  16,  8 },
-    {  32,  4 },
-    {  64,  6 },
-    { 280,  8 }
+    {  16,  8 * WSF_BUF_SCALE },
+    {  32,  4 * WSF_BUF_SCALE },
+    {  64,  6 * WSF_BUF_SCALE },
+    { 280,  8 * WSF_BUF_SCALE }
 };
 
 
+// The WSF OS port in the Cordio library does not know about this task.
+// WsfSetEvent and WsfTaskSetReady, through which events, messages and
+// timers make a handler ready, are wrapped at link time (see
+// application.mk) to wake it up.
+static void ble_task_wake()
+{
+    BaseType_t woken = pdFALSE;
+
+    if (ble_task_handle == NULL) {
+        return;
+    }
+
+    if (__get_IPSR() != 0) {
+        vTaskNotifyGiveFromISR(ble_task_handle, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        xTaskNotifyGive(ble_task_handle);
+    }
+}
+
+void __wrap_WsfSetEvent(wsfHandlerId_t handlerId, wsfEventMask_t event)
+{
+    __real_WsfSetEvent(handlerId, event);
+    ble_task_wake();
+}
+
+void __wrap_WsfTaskSetReady(wsfHandlerId_t handlerId, wsfTaskEvent_t event)
+{
+    __real_WsfTaskSetReady(handlerId, event);
+    ble_task_wake();
+}
+
+// Block until the next WSF timer expires, at least one tick so that a
+// timer the port has yet to service does not turn this into a spin.
+static TickType_t ble_task_timeout()
+{
+    bool_t running;
+    wsfTimerTicks_t ticks;
+    TickType_t timeout;
+
+    ticks = WsfTimerNextExpiration(&running);
+    if (!running) {
+        return portMAX_DELAY;
+    }
+
+    timeout = pdMS_TO_TICKS(ticks * WSF_MS_PER_TICK);
+    return timeout ? timeout : 1;
+}
+
+void ble_task_stats(ble_task_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = ble_task_counters;
+    taskEXIT_CRITICAL();
+}
+
 void ble_cordio_init(void)
 {
     wsfHandlerId_t handlerId;
@@ -110,6 +187,7 @@ void ble_cordio_init(void)
         am_util_debug_printf("Memory pool is too small by %d\r\n",
                              wsfBufMemLen - sizeof(g_pui32BufMem));
     }
+    ble_buf_init(g_psPoolDescriptors, WSF_BUF_POOLS);
 
     //
     // Initialize the WSF security service.
@@ -164,12 +242,16 @@ void ble_cordio_init(void)
 
 void ble_task(void *pvParameters)
 {
-    FreeRTOS_CLIRegisterCommand(&amota_command_definition);
+    cli_table_register(&amota_command_definition, &amota_command_table);
 
     NVIC_SetPriority(BLE_IRQn, NVIC_configMAX_SYSCALL_INTERRUPT_PRIORITY);
 
+#if LORAWAN_TOKEN_LOG
+    TOKEN_LOG("ble: task started %d.%d", 2, 0);
+#else
     am_util_stdio_printf("\r\n\r\nBLE Task Started 2.0\r\n\r\n");
     nm_console_print_prompt();
+#endif
 
     HciDrvRadioBoot(1);
     ble_cordio_init();
@@ -177,10 +259,25 @@ void ble_task(void *pvParameters)
     AmotaStart();
     while (1) {
         wsfOsDispatcher();
+        ble_task_counters.dispatches++;
+        lorawan_class_policy_set_ble_active(AppConnIsOpen() != DM_CONN_ID_NONE);
+
+        if (wsfOsReadyToSleep()) {
+            if (ulTaskNotifyTake(pdTRUE, ble_task_timeout())) {
+                ble_task_counters.wakeups++;
+            } else {
+                ble_task_counters.timeouts++;
+            }
+        }
     }
 }
 
 void am_ble_isr(void)
 {
+    BaseType_t woken = pdFALSE;
+
     HciDrvIntService();
+
+    vTaskNotifyGiveFromISR(ble_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
 }
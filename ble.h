@@ -32,11 +32,20 @@
 #ifndef _BLE_H_
 #define _BLE_H_
 
+#include <stdint.h>
+
 #include <FreeRTOS.h>
 #include <queue.h>
 
+typedef struct {
+    uint32_t dispatches;
+    uint32_t wakeups;
+    uint32_t timeouts;
+} ble_task_stats_t;
+
 extern TaskHandle_t ble_task_handle;
 extern QueueHandle_t ble_task_queue;
 extern void ble_task(void *pvParameters);
+extern void ble_task_stats(ble_task_stats_t *stats);
 
 #endif /* _BLE_H_ */
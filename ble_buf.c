@@ -0,0 +1,270 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <wsf_types.h>
+#include <wsf_buf.h>
+#include <wsf_cs.h>
+
+#include "ble_buf.h"
+#include "lorawan_config.h"
+
+// WsfBufAlloc() and WsfBufFree() are wrapped at link time (application.mk)
+// to follow the use of the WSF buffer pools.  The pools are taken in the
+// same way as WSF does, the first one large enough with a free buffer, so
+// that the counts here mirror those of the stack.
+//
+// With BLE_BUF_RECORD the peak number of buffers outstanding at once is
+// also recorded for every range of request sizes, in steps of
+// BLE_BUF_STEP bytes.  That is enough to work out the smallest pool table
+// that would have served the recorded workload.
+#define BLE_BUF_STEP    8
+#define BLE_BUF_CLASSES 36
+
+typedef struct {
+    void *buffer;
+    uint8_t pool;
+    uint8_t size_class;
+} buf_entry_t;
+
+extern void *__real_WsfBufAlloc(uint16_t len);
+extern void __real_WsfBufFree(void *pBuf);
+
+static ble_buf_pool_stats_t buf_pools[BLE_BUF_POOLS];
+static uint8_t buf_pool_count;
+static buf_entry_t buf_entries[BLE_BUF_TRACK];
+static uint16_t buf_max_request;
+
+#if BLE_BUF_RECORD
+// buffers outstanding and their peak with a size class from a to b
+static uint8_t buf_range_use[BLE_BUF_CLASSES][BLE_BUF_CLASSES];
+static uint8_t buf_range_peak[BLE_BUF_CLASSES][BLE_BUF_CLASSES];
+
+static void buf_record(uint8_t size_class, bool alloc)
+{
+    for (uint32_t a = 0; a <= size_class; a++) {
+        for (uint32_t b = size_class; b < BLE_BUF_CLASSES; b++) {
+            if (!alloc) {
+                buf_range_use[a][b]--;
+            } else if (++buf_range_use[a][b] > buf_range_peak[a][b]) {
+                buf_range_peak[a][b] = buf_range_use[a][b];
+            }
+        }
+    }
+}
+#endif
+
+static uint8_t buf_size_class(uint16_t len)
+{
+    uint32_t size_class = (len + BLE_BUF_STEP - 1) / BLE_BUF_STEP;
+
+    if (size_class > 0) {
+        size_class--;
+    }
+    if (size_class >= BLE_BUF_CLASSES) {
+        size_class = BLE_BUF_CLASSES - 1;
+    }
+
+    return size_class;
+}
+
+void *__wrap_WsfBufAlloc(uint16_t len)
+{
+    void *buffer = __real_WsfBufAlloc(len);
+    uint32_t first = buf_pool_count;
+    uint32_t pool = buf_pool_count;
+    WSF_CS_INIT(cs);
+
+    WSF_CS_ENTER(cs);
+    for (uint32_t i = 0; i < buf_pool_count; i++) {
+        if (len > buf_pools[i].size) {
+            continue;
+        }
+        if (first == buf_pool_count) {
+            first = i;
+        }
+        if (buf_pools[i].in_use < buf_pools[i].count) {
+            pool = i;
+            break;
+        }
+    }
+
+    if (len > buf_max_request) {
+        buf_max_request = len;
+    }
+
+    if (buffer == NULL) {
+        if (first < buf_pool_count) {
+            buf_pools[first].failures++;
+        }
+    } else if (pool < buf_pool_count) {
+        buf_pools[pool].allocs++;
+        if (++buf_pools[pool].in_use > buf_pools[pool].high_water) {
+            buf_pools[pool].high_water = buf_pools[pool].in_use;
+        }
+
+        for (uint32_t i = 0; i < BLE_BUF_TRACK; i++) {
+            if (buf_entries[i].buffer == NULL) {
+                buf_entries[i].buffer = buffer;
+                buf_entries[i].pool = pool;
+                buf_entries[i].size_class = buf_size_class(len);
+#if BLE_BUF_RECORD
+                buf_record(buf_entries[i].size_class, true);
+#endif
+                break;
+            }
+        }
+    }
+    WSF_CS_EXIT(cs);
+
+    return buffer;
+}
+
+void __wrap_WsfBufFree(void *pBuf)
+{
+    WSF_CS_INIT(cs);
+
+    WSF_CS_ENTER(cs);
+    for (uint32_t i = 0; i < BLE_BUF_TRACK; i++) {
+        if (buf_entries[i].buffer == pBuf) {
+            buf_pools[buf_entries[i].pool].in_use--;
+#if BLE_BUF_RECORD
+            buf_record(buf_entries[i].size_class, false);
+#endif
+            buf_entries[i].buffer = NULL;
+            break;
+        }
+    }
+    WSF_CS_EXIT(cs);
+
+    __real_WsfBufFree(pBuf);
+}
+
+// Takes the pool table given to WsfBufInit()
+void ble_buf_init(const wsfBufPoolDesc_t *pools, uint8_t count)
+{
+    if (count > BLE_BUF_POOLS) {
+        count = BLE_BUF_POOLS;
+    }
+
+    memset(buf_pools, 0, sizeof(buf_pools));
+    for (uint32_t i = 0; i < count; i++) {
+        buf_pools[i].size = pools[i].len;
+        buf_pools[i].count = pools[i].num;
+    }
+    buf_pool_count = count;
+}
+
+uint8_t ble_buf_stats(ble_buf_pool_stats_t *pools)
+{
+    memcpy(pools, buf_pools, sizeof(buf_pools));
+
+    return buf_pool_count;
+}
+
+uint16_t ble_buf_max_request()
+{
+    return buf_max_request;
+}
+
+// Splits the size classes up to the largest one used into at most
+// BLE_BUF_POOLS ranges, each served by a pool of the largest size of the
+// range with as many buffers as were outstanding at once in it plus
+// BLE_BUF_HEADROOM, so that the pools take the least memory.  Returns the
+// number of pools, zero without a recording.
+uint8_t ble_buf_recommend(wsfBufPoolDesc_t *pools)
+{
+#if BLE_BUF_RECORD
+    uint32_t cost[BLE_BUF_POOLS + 1][BLE_BUF_CLASSES + 1];
+    uint8_t start[BLE_BUF_POOLS + 1][BLE_BUF_CLASSES + 1];
+    uint32_t last = 0;
+    uint32_t best = 1;
+    uint8_t n = 0;
+
+    for (uint32_t b = 0; b < BLE_BUF_CLASSES; b++) {
+        if (buf_range_peak[b][b] > 0) {
+            last = b + 1;
+        }
+    }
+    if (last == 0) {
+        return 0;
+    }
+
+    // cost[k][j]: least memory for classes below j with k pools
+    memset(cost, 0xFF, sizeof(cost));
+    cost[0][0] = 0;
+    for (uint32_t k = 1; k <= BLE_BUF_POOLS; k++) {
+        for (uint32_t j = 1; j <= last; j++) {
+            for (uint32_t a = 0; a < j; a++) {
+                uint32_t peak = buf_range_peak[a][j - 1];
+                uint32_t size = peak ? (peak + BLE_BUF_HEADROOM) * j *
+                                           BLE_BUF_STEP
+                                     : 0;
+
+                if ((cost[k - 1][a] != UINT32_MAX) &&
+                    (cost[k - 1][a] + size < cost[k][j])) {
+                    cost[k][j] = cost[k - 1][a] + size;
+                    start[k][j] = a;
+                }
+            }
+        }
+        if (cost[k][last] < cost[best][last]) {
+            best = k;
+        }
+    }
+
+    // walk back from the largest class, skipping unused ranges
+    for (uint32_t k = best, j = last; k > 0; j = start[k][j], k--) {
+        uint32_t peak = buf_range_peak[start[k][j]][j - 1];
+
+        if (peak > 0) {
+            pools[n].len = j * BLE_BUF_STEP;
+            pools[n].num = peak + BLE_BUF_HEADROOM;
+            n++;
+        }
+    }
+
+    // smallest pool first, as WsfBufInit() expects
+    for (uint8_t i = 0; i < n / 2; i++) {
+        wsfBufPoolDesc_t swap = pools[i];
+
+        pools[i] = pools[n - 1 - i];
+        pools[n - 1 - i] = swap;
+    }
+
+    return n;
+#else
+    return 0;
+#endif
+}
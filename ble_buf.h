@@ -0,0 +1,59 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _BLE_BUF_H_
+#define _BLE_BUF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wsf_types.h>
+#include <wsf_buf.h>
+
+// Most pools and most buffers outstanding at once that are tracked
+#define BLE_BUF_POOLS 4
+#define BLE_BUF_TRACK 64
+
+typedef struct {
+    uint16_t size;
+    uint8_t count;
+    uint8_t in_use;
+    uint8_t high_water;
+    uint32_t allocs;
+    uint32_t failures;
+} ble_buf_pool_stats_t;
+
+extern void ble_buf_init(const wsfBufPoolDesc_t *pools, uint8_t count);
+extern uint8_t ble_buf_stats(ble_buf_pool_stats_t *pools);
+extern uint16_t ble_buf_max_request();
+extern uint8_t ble_buf_recommend(wsfBufPoolDesc_t *pools);
+
+#endif /* _BLE_BUF_H_ */
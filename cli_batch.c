@@ -0,0 +1,231 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <FreeRTOS_CLI.h>
+#include <task.h>
+
+#include "cli_batch.h"
+#include "cli_table.h"
+#include "cli_writer.h"
+
+// Runs several console commands back to back, separated by ';' on the
+// command line or by new lines in a framed upload or a console block
+// between "batch begin" and "batch end".  The commands are
+// dispatched through their tables rather than FreeRTOS_CLIProcessCommand(),
+// which cannot be entered again from a command, so only commands that
+// registered a table with cli_table_register() can be batched.
+//
+// On the console each command takes one or more pages of the batch
+// output: its command line, its output and its status, followed by a
+// summary once all have run.
+
+// room kept in a page for the status line of the command
+#define BATCH_STATUS_RESERVE 32
+
+static portBASE_TYPE cli_batch_command(char *pcWriteBuffer,
+                                       size_t xWriteBufferLen,
+                                       const char *pcCommandString);
+
+CLI_Command_Definition_t cli_batch_command_definition = {
+    (const char *const) "batch",
+    (const char *const) "batch:\tRun commands separated by ';' in one go, or\r\n"
+                        "\tthe lines between \"batch begin\" and \"batch end\".\r\n",
+    cli_batch_command, -1};
+
+static const char *const status_names[] = {"ok", "error", "usage",
+                                           "unknown"};
+
+static uint32_t batch_index;
+static bool batch_continuing;
+static uint32_t batch_failed;
+static TickType_t batch_start;
+
+// Copies command line index of the batch, without the surrounding blanks,
+// returns false past the last one.  A line that does not fit in size comes
+// back empty, to be reported rather than run cut short.
+bool cli_batch_line(const char *commands, size_t length, uint32_t index,
+                    char *line, size_t size)
+{
+    const char *end = commands + length;
+    const char *p = commands;
+
+    while (p < end) {
+        const char *start = p;
+        const char *stop;
+
+        while ((p < end) && (*p != ';') && (*p != '\n')) {
+            p++;
+        }
+        stop = p++;
+
+        while ((start < stop) && ((*start == ' ') || (*start == '\r'))) {
+            start++;
+        }
+        while ((stop > start) && ((stop[-1] == ' ') || (stop[-1] == '\r'))) {
+            stop--;
+        }
+        if (start == stop) {
+            continue;
+        }
+
+        if (index-- == 0) {
+            if ((size_t)(stop - start) >= size) {
+                stop = start;
+            }
+            memcpy(line, start, stop - start);
+            line[stop - start] = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Runs a whole command into buffer, all of its pages, and returns its
+// status.  Output past the end of buffer is dropped and the command
+// aborted.
+uint8_t cli_batch_run(const char *line, char *buffer, size_t size,
+                      size_t *length)
+{
+    const cli_table_t *table = cli_table_lookup(line, strcspn(line, " "));
+    cli_writer_t writer;
+    portBASE_TYPE more;
+
+    *length = 0;
+    if (line[0] == 0) {
+        cli_writer_init(&writer, buffer, size);
+        cli_writer_error(&writer, "command line too long\r\n");
+        *length = writer.length;
+        return writer.status;
+    }
+
+    if (table == NULL) {
+        return CLI_STATUS_UNKNOWN;
+    }
+
+    do {
+        more = cli_table_dispatch(table, buffer + *length, size - *length,
+                                  line);
+        *length += strlen(buffer + *length);
+        if ((more != pdFALSE) && (size - *length < CLI_BATCH_PAGE_MIN)) {
+            cli_table_abort();
+            return cli_table_status() | CLI_BATCH_TRUNCATED;
+        }
+    } while (more != pdFALSE);
+
+    return cli_table_status();
+}
+
+static portBASE_TYPE cli_batch_command(char *pcWriteBuffer,
+                                       size_t xWriteBufferLen,
+                                       const char *pcCommandString)
+{
+    const char *commands;
+    portBASE_TYPE xParameterStringLength;
+    const cli_table_t *table;
+    char line[CLI_BATCH_LINE];
+    cli_writer_t writer;
+    portBASE_TYPE more;
+    uint8_t status;
+
+    cli_writer_init(&writer, pcWriteBuffer, xWriteBufferLen);
+
+    commands =
+        FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameterStringLength);
+    if (commands == NULL) {
+        cli_writer_usage(&writer, "batch <command>[; <command>...]\r\n");
+        return pdFALSE;
+    }
+
+    if (!batch_continuing && (batch_index == 0)) {
+        batch_start = xTaskGetTickCount();
+        batch_failed = 0;
+    }
+
+    if (!cli_batch_line(commands, strlen(commands), batch_index, line,
+                        sizeof(line))) {
+        cli_writer_printf(&writer, "batch: %d commands, %d failed, %d ms\r\n",
+                          batch_index, batch_failed,
+                          (xTaskGetTickCount() - batch_start) *
+                              portTICK_PERIOD_MS);
+        batch_index = 0;
+        return pdFALSE;
+    }
+
+    if (!batch_continuing) {
+        cli_writer_printf(&writer, "> %s\r\n", line);
+    }
+
+    // a page too small for a command page and its status stops the batch
+    if (writer.size - writer.length <
+        CLI_BATCH_PAGE_MIN + BATCH_STATUS_RESERVE) {
+        if (batch_continuing) {
+            cli_table_abort();
+        }
+        cli_writer_error(&writer, "batch output page too small\r\n");
+        batch_continuing = false;
+        batch_index = 0;
+        return pdFALSE;
+    }
+
+    table = cli_table_lookup(line, strcspn(line, " "));
+    if (line[0] == 0) {
+        cli_writer_error(&writer, "command line too long\r\n");
+        more = pdFALSE;
+        status = writer.status;
+    } else if (table == NULL) {
+        cli_writer_error(&writer, "not a batch command\r\n");
+        more = pdFALSE;
+        status = CLI_STATUS_UNKNOWN;
+    } else {
+        more = cli_table_dispatch(
+            table, writer.buffer + writer.length,
+            writer.size - writer.length - BATCH_STATUS_RESERVE, line);
+        writer.length += strlen(writer.buffer + writer.length);
+        status = cli_table_status();
+    }
+
+    batch_continuing = (more != pdFALSE);
+    if (!batch_continuing) {
+        cli_writer_printf(&writer, "= %d %s\r\n", status,
+                          status_names[status]);
+        batch_failed += (status != CLI_STATUS_OK);
+        batch_index++;
+    }
+
+    return pdTRUE;
+}
@@ -0,0 +1,323 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <FreeRTOS_CLI.h>
+#include <task.h>
+
+#include "cli_table.h"
+
+static portBASE_TYPE cli_table_help(cli_writer_t *writer,
+                                    const char *pcCommandString);
+
+static const cli_subcommand_t help_subcommand = {
+    "help", "[command]", NULL, 0, 1, cli_table_help};
+
+// The console runs one command at a time, a command returning pdTRUE is
+// called again with the same command string for its next page.
+static const cli_table_t *active_table;
+static const cli_subcommand_t *active_subcommand;
+static uint32_t active_cursor;
+static uint8_t active_status;
+static int8_t active_keyword;
+
+static const cli_table_t *registry[CLI_TABLE_REGISTRY];
+static uint32_t registry_count;
+
+// Subcommands match the whole first parameter, "s" no longer selects
+// whichever of send or stats happened to be compared first.
+static int cli_table_compare(const char *name, const char *token,
+                             size_t length)
+{
+    int result = strncmp(name, token, length);
+
+    if ((result == 0) && (name[length] != '\0')) {
+        result = 1;
+    }
+
+    return result;
+}
+
+static bool cli_table_number(const char *token, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if ((token[i] < '0') || (token[i] > '9')) {
+            return false;
+        }
+    }
+
+    return length > 0;
+}
+
+// Position of token in the '|' separated keywords, -1 if it is not one
+static int8_t cli_table_match(const char *keywords, const char *token,
+                              size_t length)
+{
+    const char *p = keywords;
+    int8_t index = 0;
+
+    while (*p) {
+        size_t n = strcspn(p, "|");
+
+        if ((n == 1) && (*p == '#')) {
+            if (cli_table_number(token, length)) {
+                return index;
+            }
+        } else if ((n == length) && (strncmp(p, token, n) == 0)) {
+            return index;
+        }
+
+        p += n;
+        if (*p == '|') {
+            p++;
+        }
+        index++;
+    }
+
+    return -1;
+}
+
+void cli_table_register(const CLI_Command_Definition_t *definition,
+                        const cli_table_t *table)
+{
+    FreeRTOS_CLIRegisterCommand(definition);
+
+    taskENTER_CRITICAL();
+    if (registry_count < CLI_TABLE_REGISTRY) {
+        registry[registry_count++] = table;
+    }
+    taskEXIT_CRITICAL();
+}
+
+const cli_table_t *cli_table_lookup(const char *command, size_t length)
+{
+    for (uint32_t i = 0; i < registry_count; i++) {
+        if (cli_table_compare(registry[i]->command, command, length) == 0) {
+            return registry[i];
+        }
+    }
+
+    return NULL;
+}
+
+const cli_subcommand_t *cli_table_find(const cli_table_t *table,
+                                       const char *name, size_t length)
+{
+    uint32_t low = 0;
+    uint32_t high = table->count;
+
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        int result =
+            cli_table_compare(table->subcommands[middle].name, name, length);
+
+        if (result == 0) {
+            return &table->subcommands[middle];
+        } else if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return NULL;
+}
+
+static bool cli_table_usage(cli_writer_t *writer,
+                            const cli_subcommand_t *subcommand)
+{
+    return cli_writer_printf(writer, "usage: %s %s%s%s\r\n",
+                             active_table->command, subcommand->name,
+                             subcommand->usage ? " " : "",
+                             subcommand->usage ? subcommand->usage : "");
+}
+
+// Pages through the list of subcommands, the cursor counts the lines
+// written so far.
+static portBASE_TYPE cli_table_list(cli_writer_t *writer)
+{
+    const cli_table_t *table = active_table;
+    uint32_t lines = table->count + 3;
+    uint32_t line = writer->cursor;
+    bool written = true;
+
+    while (written && (line < lines)) {
+        if (line == 0) {
+            written = cli_writer_printf(writer,
+                                        "usage: %s [command] [<args>]\r\n\r\n"
+                                        "Supported commands are:\r\n",
+                                        table->command);
+        } else if (line <= table->count) {
+            written = cli_writer_printf(writer, "  %s\r\n",
+                                        table->subcommands[line - 1].name);
+        } else if (line == table->count + 1) {
+            written = cli_writer_puts(writer, "\r\n");
+        } else {
+            written = cli_writer_printf(
+                writer, "See '%s help [command]' for the details of each "
+                        "command.\r\n",
+                table->command);
+        }
+        line += written;
+    }
+
+    writer->cursor = line;
+    return (line < lines) ? pdTRUE : pdFALSE;
+}
+
+static portBASE_TYPE cli_table_help(cli_writer_t *writer,
+                                    const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
+    const cli_subcommand_t *subcommand;
+
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
+    if (pcParameterString == NULL) {
+        return cli_table_list(writer);
+    }
+
+    subcommand = cli_table_find(active_table, pcParameterString,
+                                xParameterStringLength);
+    if (subcommand == NULL) {
+        cli_writer_error(writer, "unknown command\r\n");
+        return pdFALSE;
+    }
+
+    if (writer->cursor == 0) {
+        cli_table_usage(writer, subcommand);
+        writer->cursor = 1;
+    }
+    if (subcommand->help &&
+        !cli_writer_printf(writer, "%s%s", writer->length ? "\r\n" : "",
+                           subcommand->help)) {
+        return pdTRUE;
+    }
+
+    return pdFALSE;
+}
+
+portBASE_TYPE cli_table_dispatch(const cli_table_t *table,
+                                 char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
+    const cli_subcommand_t *subcommand = active_subcommand;
+    cli_writer_t writer;
+    portBASE_TYPE more;
+    int8_t argc;
+
+    cli_writer_init(&writer, pcWriteBuffer, xWriteBufferLen);
+
+    if (subcommand == NULL) {
+        active_status = CLI_STATUS_OK;
+        pcParameterString = FreeRTOS_CLIGetParameter(pcCommandString, 1,
+                                                     &xParameterStringLength);
+        if (pcParameterString == NULL) {
+            return pdFALSE;
+        }
+
+        if (cli_table_compare("help", pcParameterString,
+                              xParameterStringLength) == 0) {
+            subcommand = &help_subcommand;
+        } else {
+            subcommand = cli_table_find(table, pcParameterString,
+                                        xParameterStringLength);
+        }
+        if (subcommand == NULL) {
+            cli_writer_error(&writer, "unknown command, see '%s help'\r\n",
+                             table->command);
+            active_status = CLI_STATUS_UNKNOWN;
+            return pdFALSE;
+        }
+
+        active_table = table;
+        argc = FreeRTOS_CLIGetNumberOfParameters(pcCommandString) - 1;
+        if ((argc < subcommand->min_args) || (argc > subcommand->max_args)) {
+            cli_table_usage(&writer, subcommand);
+            active_status = CLI_STATUS_USAGE;
+            return pdFALSE;
+        }
+
+        active_keyword = CLI_TABLE_NO_KEYWORD;
+        if ((subcommand->keywords != NULL) && (argc > 0)) {
+            pcParameterString = FreeRTOS_CLIGetParameter(
+                pcCommandString, 2, &xParameterStringLength);
+            active_keyword = cli_table_match(subcommand->keywords,
+                                             pcParameterString,
+                                             xParameterStringLength);
+            if (active_keyword < 0) {
+                cli_writer_error(&writer,
+                                 "unknown argument, see '%s help %s'\r\n",
+                                 table->command, subcommand->name);
+                active_status = CLI_STATUS_ERROR;
+                return pdFALSE;
+            }
+        }
+        active_cursor = 0;
+    }
+
+    writer.cursor = active_cursor;
+    more = subcommand->handler(&writer, pcCommandString);
+    if (writer.status != CLI_STATUS_OK) {
+        active_status = writer.status;
+    }
+
+    active_subcommand = (more != pdFALSE) ? subcommand : NULL;
+    active_cursor = writer.cursor;
+
+    return more;
+}
+
+// Drops the pages a continued command has not written yet
+void cli_table_abort()
+{
+    active_subcommand = NULL;
+}
+
+uint8_t cli_table_status()
+{
+    return active_status;
+}
+
+// Position of the first argument in the keywords of the running
+// subcommand, CLI_TABLE_NO_KEYWORD without one
+int8_t cli_table_keyword()
+{
+    return active_keyword;
+}
@@ -0,0 +1,97 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _CLI_TABLE_H_
+#define _CLI_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+#include <FreeRTOS_CLI.h>
+
+#include "cli_writer.h"
+
+// Commands with a table that can be run from a batch
+#define CLI_TABLE_REGISTRY 4
+
+// Returns pdTRUE with writer->cursor set to resume from when the output
+// continues in another page.
+typedef portBASE_TYPE (*cli_table_handler_t)(cli_writer_t *writer,
+                                             const char *pcCommandString);
+
+// One subcommand.  usage lists the arguments after the subcommand name,
+// min_args and max_args bound their count and help is printed below the
+// usage line by "<command> help <subcommand>".  keywords, when given,
+// lists the values the first argument may take separated by '|', "#"
+// stands for a decimal number.  Any other value is an error, the handler
+// gets the position of the match from cli_table_keyword().
+typedef struct {
+    const char *name;
+    const char *usage;
+    const char *help;
+    uint8_t min_args;
+    uint8_t max_args;
+    cli_table_handler_t handler;
+    const char *keywords;
+} cli_subcommand_t;
+
+// cli_table_keyword() without a first argument
+#define CLI_TABLE_NO_KEYWORD -1
+
+// The subcommands must be sorted by name, they are looked up by bisection.
+typedef struct {
+    const char *command;
+    const cli_subcommand_t *subcommands;
+    uint32_t count;
+} cli_table_t;
+
+#define CLI_TABLE(command, subcommands)                                        \
+    {                                                                          \
+        command, subcommands, sizeof(subcommands) / sizeof(subcommands[0])     \
+    }
+
+extern void cli_table_register(const CLI_Command_Definition_t *definition,
+                               const cli_table_t *table);
+extern const cli_table_t *cli_table_lookup(const char *command,
+                                           size_t length);
+extern const cli_subcommand_t *cli_table_find(const cli_table_t *table,
+                                              const char *name,
+                                              size_t length);
+extern portBASE_TYPE cli_table_dispatch(const cli_table_t *table,
+                                        char *pcWriteBuffer,
+                                        size_t xWriteBufferLen,
+                                        const char *pcCommandString);
+extern void cli_table_abort();
+extern uint8_t cli_table_status();
+extern int8_t cli_table_keyword();
+
+#endif /* _CLI_TABLE_H_ */
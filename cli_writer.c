@@ -0,0 +1,151 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_util.h>
+
+#include "cli_writer.h"
+
+void cli_writer_init(cli_writer_t *writer, char *buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->cursor = 0;
+    writer->status = CLI_STATUS_OK;
+
+    buffer[0] = 0;
+}
+
+// A string that does not fit is dropped so that the caller can retry it in
+// the next page, unless the page is still empty.  Then it would never fit
+// and is truncated instead.
+static bool cli_writer_commit(cli_writer_t *writer, size_t length)
+{
+    size_t space = writer->size - writer->length;
+
+    if (length < space) {
+        writer->length += length;
+        return true;
+    }
+
+    if (writer->length > 0) {
+        writer->buffer[writer->length] = 0;
+        return false;
+    }
+
+    writer->length = space - 1;
+    writer->buffer[writer->length] = 0;
+    return true;
+}
+
+bool cli_writer_puts(cli_writer_t *writer, const char *string)
+{
+    size_t space = writer->size - writer->length;
+    size_t length = strlen(string);
+
+    memcpy(writer->buffer + writer->length, string,
+           length < space ? length + 1 : space - 1);
+    return cli_writer_commit(writer, length);
+}
+
+static bool cli_writer_format(cli_writer_t *writer, const char *prefix,
+                              const char *format, va_list args)
+{
+    char *p = writer->buffer + writer->length;
+    size_t space = writer->size - writer->length;
+    size_t prefix_length = strlen(prefix);
+    uint32_t length = space;
+
+    if (prefix_length + 1 < space) {
+        memcpy(p, prefix, prefix_length);
+        length = prefix_length + am_util_stdio_vsnprintf(p + prefix_length,
+                                                         space - prefix_length,
+                                                         format, args);
+    } else {
+        memcpy(p, prefix, space - 1);
+        p[space - 1] = 0;
+    }
+
+    // a string ending exactly at the buffer end counts as cut off, some
+    // vsnprintf implementations return the truncated length
+    if (length + 1 >= space) {
+        length = space;
+    }
+
+    return cli_writer_commit(writer, length);
+}
+
+bool cli_writer_printf(cli_writer_t *writer, const char *format, ...)
+{
+    va_list args;
+    bool written;
+
+    va_start(args, format);
+    written = cli_writer_format(writer, "", format, args);
+    va_end(args);
+
+    return written;
+}
+
+// The status is set even when the message has to wait for the next page
+bool cli_writer_error(cli_writer_t *writer, const char *format, ...)
+{
+    va_list args;
+    bool written;
+
+    writer->status = CLI_STATUS_ERROR;
+
+    va_start(args, format);
+    written = cli_writer_format(writer, "error: ", format, args);
+    va_end(args);
+
+    return written;
+}
+
+bool cli_writer_usage(cli_writer_t *writer, const char *format, ...)
+{
+    va_list args;
+    bool written;
+
+    writer->status = CLI_STATUS_USAGE;
+
+    va_start(args, format);
+    written = cli_writer_format(writer, "usage: ", format, args);
+    va_end(args);
+
+    return written;
+}
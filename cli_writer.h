@@ -0,0 +1,62 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _CLI_WRITER_H_
+#define _CLI_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Outcome of a command, set by cli_writer_error() and cli_writer_usage()
+#define CLI_STATUS_OK      0
+#define CLI_STATUS_ERROR   1
+#define CLI_STATUS_USAGE   2
+#define CLI_STATUS_UNKNOWN 3
+
+// Bounded console output.  Each call appends a whole string or nothing,
+// so a page never ends in half a line.  cursor is kept across the calls
+// of a command that returns pdTRUE to continue in the next page.
+typedef struct {
+    char *buffer;
+    size_t size;
+    size_t length;
+    uint32_t cursor;
+    uint8_t status;
+} cli_writer_t;
+
+extern void cli_writer_init(cli_writer_t *writer, char *buffer, size_t size);
+extern bool cli_writer_puts(cli_writer_t *writer, const char *string);
+extern bool cli_writer_printf(cli_writer_t *writer, const char *format, ...);
+extern bool cli_writer_error(cli_writer_t *writer, const char *format, ...);
+extern bool cli_writer_usage(cli_writer_t *writer, const char *format, ...);
+
+#endif /* _CLI_WRITER_H_ */
@@ -0,0 +1,285 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <FreeRTOS_CLI.h>
+#include <task.h>
+
+#include "ble.h"
+#include "cli_table.h"
+#include "cli_writer.h"
+#include "console_task.h"
+#include "console_uart.h"
+#include "idle_stats.h"
+#include "lorawan_config.h"
+#include "lorawan_log.h"
+
+// Console task on top of the interrupt driven UART in console_uart.c, in
+// place of the blocking one of the SDK.  It reads the receive ring byte
+// by byte so that a command taking over the console, such as the binary
+// frame mode, finds everything the host sent after the command line.
+#define CONSOLE_PROMPT "nm> "
+
+// "batch begin" opens a block of lines that are collected and run as one
+// batch on "batch end", see cli_batch.c
+#define CONSOLE_BATCH_PROMPT  "batch> "
+#define CONSOLE_BATCH_COMMAND "batch "
+#define CONSOLE_BATCH_BEGIN   "batch begin"
+#define CONSOLE_BATCH_END     "batch end"
+
+// after ESC, after ESC [
+#define ESCAPE_START    1
+#define ESCAPE_SEQUENCE 2
+
+TaskHandle_t nm_console_task_handle;
+
+static char console_line[LORAWAN_CONSOLE_LINE];
+static uint32_t console_length;
+
+// 0 while no block is open
+static char console_batch[LORAWAN_CONSOLE_BATCH];
+static uint32_t console_batch_length;
+
+static portBASE_TYPE console_command(char *pcWriteBuffer,
+                                     size_t xWriteBufferLen,
+                                     const char *pcCommandString);
+
+static CLI_Command_Definition_t console_command_definition = {
+    (const char *const) "console",
+    (const char *const) "console:\tConsole transport.\r\n",
+    console_command, -1};
+
+static portBASE_TYPE console_stats(cli_writer_t *writer,
+                                   const char *pcCommandString)
+{
+    console_uart_stats_t uart;
+    lorawan_log_stats_t log;
+
+    console_uart_stats(&uart);
+    lorawan_log_stats(&log);
+
+    cli_writer_printf(writer,
+                      "tx %d bytes, %d dropped, high water %d of %d\r\n",
+                      uart.tx_bytes, uart.tx_dropped, uart.tx_high_water,
+                      LORAWAN_CONSOLE_TX_RING);
+    cli_writer_printf(writer,
+                      "rx %d bytes, %d dropped, high water %d of %d\r\n",
+                      uart.rx_bytes, uart.rx_dropped, uart.rx_high_water,
+                      LORAWAN_CONSOLE_RX_RING);
+    cli_writer_printf(writer,
+                      "MAC callback logging %d calls, longest %d us, "
+                      "average %d us\r\n",
+                      log.calls, log.hold_max,
+                      log.calls ? log.hold_total / log.calls : 0);
+
+    return pdFALSE;
+}
+
+static portBASE_TYPE console_idle(cli_writer_t *writer,
+                                  const char *pcCommandString)
+{
+    idle_stats_t idle;
+    ble_task_stats_t ble;
+
+    // "reset" is the only keyword of the table entry
+    if (cli_table_keyword() != CLI_TABLE_NO_KEYWORD) {
+        idle_stats_reset();
+        return pdFALSE;
+    }
+
+    idle_stats(&idle);
+    ble_task_stats(&ble);
+
+    cli_writer_printf(writer, "%d ms, idle %d%%, estimated %d uA\r\n",
+                      idle.elapsed,
+                      idle.elapsed ? (uint32_t)(((uint64_t)idle.sleep_time +
+                                                 idle.deep_sleep_time) *
+                                                100 / idle.elapsed)
+                                   : 0,
+                      idle.average_current);
+    cli_writer_printf(writer, "deep sleep %d ms in %d, sleep %d ms in %d\r\n",
+                      idle.deep_sleep_time, idle.deep_sleeps, idle.sleep_time,
+                      idle.sleeps);
+    cli_writer_printf(writer,
+                      "BLE task %d dispatches, %d wakeups, %d timeouts\r\n",
+                      ble.dispatches, ble.wakeups, ble.timeouts);
+
+    return pdFALSE;
+}
+
+// Sorted by name
+static const cli_subcommand_t console_subcommands[] = {
+    {"idle", "[reset]",
+     "Show the time spent in sleep and deep sleep since boot or\r\n"
+     "the last reset, the estimated average current and how\r\n"
+     "often the BLE task woke up.\r\n",
+     0, 1, console_idle, "reset"},
+    {"stats", NULL,
+     "Show the bytes dropped by the UART rings and the time the MAC\r\n"
+     "callbacks spend logging.\r\n",
+     0, 0, console_stats},
+};
+
+static const cli_table_t console_command_table =
+    CLI_TABLE("console", console_subcommands);
+
+static portBASE_TYPE console_command(char *pcWriteBuffer,
+                                     size_t xWriteBufferLen,
+                                     const char *pcCommandString)
+{
+    return cli_table_dispatch(&console_command_table, pcWriteBuffer,
+                              xWriteBufferLen, pcCommandString);
+}
+
+void nm_console_print_prompt()
+{
+    const char *prompt =
+        console_batch_length ? CONSOLE_BATCH_PROMPT : CONSOLE_PROMPT;
+
+    console_uart_write(prompt, strlen(prompt), false);
+}
+
+static void console_run(const char *command)
+{
+    char *output = FreeRTOS_CLIGetOutputBuffer();
+    portBASE_TYPE more;
+
+    do {
+        output[0] = 0;
+        more = FreeRTOS_CLIProcessCommand(command, output,
+                                          configCOMMAND_INT_MAX_OUTPUT_SIZE);
+        console_uart_write(output, strlen(output), true);
+    } while (more != pdFALSE);
+}
+
+static void console_print(const char *string)
+{
+    console_uart_write(string, strlen(string), true);
+}
+
+// Collects the lines of a batch block, runs it as "batch" with one
+// command per line once it ends.  Returns false for lines outside of a
+// block.
+static bool console_batch_line()
+{
+    if (strcmp(console_line, CONSOLE_BATCH_BEGIN) == 0) {
+        strcpy(console_batch, CONSOLE_BATCH_COMMAND);
+        console_batch_length = strlen(CONSOLE_BATCH_COMMAND);
+        return true;
+    }
+
+    if (console_batch_length == 0) {
+        return false;
+    }
+
+    if (strcmp(console_line, CONSOLE_BATCH_END) == 0) {
+        if (console_batch_length == strlen(CONSOLE_BATCH_COMMAND)) {
+            console_print("error: empty batch\r\n");
+        } else {
+            console_batch[console_batch_length] = 0;
+            console_run(console_batch);
+        }
+        console_batch_length = 0;
+        return true;
+    }
+
+    if (console_batch_length + console_length + 1 >= sizeof(console_batch)) {
+        console_print("error: batch too long, discarded\r\n");
+        console_batch_length = 0;
+        return true;
+    }
+
+    memcpy(&console_batch[console_batch_length], console_line, console_length);
+    console_batch_length += console_length;
+    console_batch[console_batch_length++] = '\n';
+
+    return true;
+}
+
+static void console_execute()
+{
+    console_line[console_length] = 0;
+    if (!console_batch_line()) {
+        console_run(console_line);
+    }
+}
+
+void nm_console_task(void *pvParameters)
+{
+    uint32_t escape = 0;
+    uint8_t last = 0;
+    uint8_t c;
+
+    cli_table_register(&console_command_definition, &console_command_table);
+
+    console_uart_write("\r\n", 2, true);
+    nm_console_print_prompt();
+
+    while (1) {
+        if (console_uart_read(&c, 1, portMAX_DELAY) == 0) {
+            continue;
+        }
+
+        // cursor keys and the like are not supported, skip them
+        if (escape == ESCAPE_START) {
+            escape = (c == '[') ? ESCAPE_SEQUENCE : 0;
+        } else if (escape == ESCAPE_SEQUENCE) {
+            if ((c >= 0x40) && (c <= 0x7E)) {
+                escape = 0;
+            }
+        } else if (c == 0x1B) {
+            escape = ESCAPE_START;
+        } else if ((c == '\r') || (c == '\n')) {
+            if ((c == '\r') || (last != '\r')) {
+                console_uart_write("\r\n", 2, true);
+                if (console_length > 0) {
+                    console_execute();
+                    console_length = 0;
+                }
+                nm_console_print_prompt();
+            }
+        } else if ((c == '\b') || (c == 0x7F)) {
+            if (console_length > 0) {
+                console_length--;
+                console_uart_write("\b \b", 3, true);
+            }
+        } else if ((c >= ' ') && (console_length < sizeof(console_line) - 1)) {
+            console_line[console_length++] = c;
+            console_uart_write(&c, 1, true);
+        }
+
+        last = c;
+    }
+}
@@ -0,0 +1,269 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_bsp.h>
+#include <am_mcu_apollo.h>
+#include <am_util.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "console_uart.h"
+#include "lorawan_config.h"
+
+// Interrupt driven console UART.  Output is copied to the transmit ring
+// and the FIFO threshold interrupt feeds it to the UART, received bytes
+// go from the FIFO to the receive ring and wake the console task.
+//
+// Text printed with am_util_stdio_printf() never waits for the UART, a
+// string that does not fit the transmit ring is dropped whole and
+// counted.  The console task itself may wait for room so that command
+// output and frame replies are complete.
+#if ((LORAWAN_CONSOLE_TX_RING & (LORAWAN_CONSOLE_TX_RING - 1)) != 0) || \
+    ((LORAWAN_CONSOLE_RX_RING & (LORAWAN_CONSOLE_RX_RING - 1)) != 0)
+#error "console ring sizes must be powers of two"
+#endif
+
+#define TX_MASK (LORAWAN_CONSOLE_TX_RING - 1)
+#define RX_MASK (LORAWAN_CONSOLE_RX_RING - 1)
+
+#define UART_INTERRUPTS \
+    (AM_HAL_UART_INT_RX | AM_HAL_UART_INT_RX_TMOUT | AM_HAL_UART_INT_TX)
+
+static void *uart_handle;
+
+static uint8_t tx_ring[LORAWAN_CONSOLE_TX_RING];
+static volatile uint32_t tx_head;
+static volatile uint32_t tx_tail;
+
+static uint8_t rx_ring[LORAWAN_CONSOLE_RX_RING];
+static volatile uint32_t rx_head;
+static volatile uint32_t rx_tail;
+static TaskHandle_t rx_reader;
+
+static bool text_enabled = true;
+
+static console_uart_stats_t uart_stats;
+
+static const am_hal_uart_config_t uart_config = {
+    .ui32BaudRate = 115200,
+    .ui32DataBits = AM_HAL_UART_DATA_BITS_8,
+    .ui32Parity = AM_HAL_UART_PARITY_NONE,
+    .ui32StopBits = AM_HAL_UART_ONE_STOP_BIT,
+    .ui32FlowControl = AM_HAL_UART_FLOW_CTRL_NONE,
+    .ui32FifoLevels = AM_HAL_UART_TX_FIFO_1_2 | AM_HAL_UART_RX_FIFO_1_2,
+    .pui8TxBuffer = NULL,
+    .ui32TxBufferSize = 0,
+    .pui8RxBuffer = NULL,
+    .ui32RxBufferSize = 0,
+};
+
+// Moves what the FIFO takes from the transmit ring, from the interrupt or
+// with interrupts masked.
+static void uart_fill()
+{
+    UART0_Type *uart = UARTn(LORAWAN_CONSOLE_UART);
+    uint32_t tail = tx_tail;
+
+    while ((tail != tx_head) && !uart->FR_b.TXFF) {
+        uart->DR = tx_ring[tail++ & TX_MASK];
+    }
+    tx_tail = tail;
+}
+
+// Copies up to length bytes to the transmit ring, or nothing if all
+// is set and they do not fit.  am_util_stdio_printf() is also called from
+// interrupts, so the ring is guarded by masking interrupts the way the
+// ISR-safe API does, which works from tasks as well.
+static uint32_t uart_put(const uint8_t *data, uint32_t length, bool all)
+{
+    UBaseType_t mask;
+    uint32_t head;
+    uint32_t space;
+    uint32_t used;
+
+    mask = taskENTER_CRITICAL_FROM_ISR();
+    head = tx_head;
+    space = LORAWAN_CONSOLE_TX_RING - (head - tx_tail);
+    if (length > space) {
+        length = all ? 0 : space;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        tx_ring[(head + i) & TX_MASK] = data[i];
+    }
+    tx_head = head + length;
+
+    used = tx_head - tx_tail;
+    if (used > uart_stats.tx_high_water) {
+        uart_stats.tx_high_water = used;
+    }
+    uart_stats.tx_bytes += length;
+
+    // the threshold interrupt only fires once the FIFO drains past it
+    uart_fill();
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+
+    return length;
+}
+
+static void uart_dropped(uint32_t length)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    uart_stats.tx_dropped += length;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+static void uart_print(char *string)
+{
+    uint32_t length = strlen(string);
+
+    if (!text_enabled || (uart_put((const uint8_t *)string, length, true) <
+                          length)) {
+        uart_dropped(length);
+    }
+}
+
+#if LORAWAN_CONSOLE_UART == 0
+void am_uart_isr(void)
+#else
+void am_uart1_isr(void)
+#endif
+{
+    UART0_Type *uart = UARTn(LORAWAN_CONSOLE_UART);
+    BaseType_t woken = pdFALSE;
+    uint32_t status;
+    uint32_t head = rx_head;
+
+    am_hal_uart_interrupt_status_get(uart_handle, &status, true);
+    am_hal_uart_interrupt_clear(uart_handle, status);
+
+    while (!uart->FR_b.RXFE) {
+        uint8_t byte = uart->DR_b.DATA;
+
+        if (head - rx_tail < LORAWAN_CONSOLE_RX_RING) {
+            rx_ring[head++ & RX_MASK] = byte;
+            uart_stats.rx_bytes++;
+        } else {
+            uart_stats.rx_dropped++;
+        }
+    }
+    if (head - rx_tail > uart_stats.rx_high_water) {
+        uart_stats.rx_high_water = head - rx_tail;
+    }
+    if ((head != rx_head) && (rx_reader != NULL)) {
+        vTaskNotifyGiveFromISR(rx_reader, &woken);
+    }
+    rx_head = head;
+
+    uart_fill();
+
+    portYIELD_FROM_ISR(woken);
+}
+
+void console_uart_init()
+{
+    am_hal_uart_initialize(LORAWAN_CONSOLE_UART, &uart_handle);
+    am_hal_uart_power_control(uart_handle, AM_HAL_SYSCTRL_WAKE, false);
+    am_hal_uart_configure(uart_handle, &uart_config);
+
+    am_hal_gpio_pinconfig(AM_BSP_GPIO_COM_UART_TX, g_AM_BSP_GPIO_COM_UART_TX);
+    am_hal_gpio_pinconfig(AM_BSP_GPIO_COM_UART_RX, g_AM_BSP_GPIO_COM_UART_RX);
+
+    am_hal_uart_interrupt_clear(uart_handle, UART_INTERRUPTS);
+    am_hal_uart_interrupt_enable(uart_handle, UART_INTERRUPTS);
+    NVIC_SetPriority((IRQn_Type)(UART0_IRQn + LORAWAN_CONSOLE_UART),
+                     NVIC_configMAX_SYSCALL_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ((IRQn_Type)(UART0_IRQn + LORAWAN_CONSOLE_UART));
+
+    am_util_stdio_printf_init(uart_print);
+}
+
+// Writes all of data if wait is set, sleeping while the ring is full,
+// otherwise as much as fits.  Returns the bytes written.
+uint32_t console_uart_write(const void *data, uint32_t length, bool wait)
+{
+    const uint8_t *bytes = data;
+    uint32_t written = uart_put(bytes, length, false);
+
+    while (wait && (written < length)) {
+        vTaskDelay(1);
+        written += uart_put(&bytes[written], length - written, false);
+    }
+    if (written < length) {
+        uart_dropped(length - written);
+    }
+
+    return written;
+}
+
+// Reads what has been received, up to length bytes, waiting up to
+// timeout for the first one.  Only the console task reads.
+uint32_t console_uart_read(uint8_t *data, uint32_t length, TickType_t timeout)
+{
+    uint32_t tail = rx_tail;
+    uint32_t n = 0;
+
+    rx_reader = xTaskGetCurrentTaskHandle();
+    if (tail == rx_head) {
+        ulTaskNotifyTake(pdTRUE, timeout);
+    }
+
+    while ((n < length) && (tail != rx_head)) {
+        data[n++] = rx_ring[tail++ & RX_MASK];
+    }
+    rx_tail = tail;
+
+    return n;
+}
+
+// Drops the text printed by other tasks while the console is used for
+// binary frames.
+void console_uart_text(bool enable)
+{
+    text_enabled = enable;
+}
+
+// True while output is still queued, the UART stops in deep sleep
+bool console_uart_busy()
+{
+    return (tx_head != tx_tail) ||
+           UARTn(LORAWAN_CONSOLE_UART)->FR_b.BUSY;
+}
+
+void console_uart_stats(console_uart_stats_t *stats)
+{
+    memcpy(stats, &uart_stats, sizeof(console_uart_stats_t));
+}
@@ -0,0 +1,121 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_mcu_apollo.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "idle_stats.h"
+#include "lorawan_config.h"
+
+// Time spent in the sleep modes entered from the FreeRTOS idle task,
+// measured with the STIMER that also keeps the tick in deep sleep.
+#ifndef configSTIMER_CLOCK_HZ
+#define configSTIMER_CLOCK_HZ 32768
+#endif
+
+static TickType_t idle_start;
+static uint32_t idle_entry;
+static bool idle_deep;
+static uint64_t idle_sleep_counts;
+static uint64_t idle_deep_sleep_counts;
+static uint32_t idle_sleeps;
+static uint32_t idle_deep_sleeps;
+
+static uint32_t idle_ms(uint64_t counts)
+{
+    return (uint32_t)(counts * 1000 / configSTIMER_CLOCK_HZ);
+}
+
+void idle_stats_reset()
+{
+    taskENTER_CRITICAL();
+    idle_start = xTaskGetTickCount();
+    idle_sleep_counts = 0;
+    idle_deep_sleep_counts = 0;
+    idle_sleeps = 0;
+    idle_deep_sleeps = 0;
+    taskEXIT_CRITICAL();
+}
+
+// Both are called from the idle task with interrupts disabled
+void idle_stats_sleep(bool deep)
+{
+    idle_deep = deep;
+    idle_entry = am_hal_stimer_counter_get();
+}
+
+void idle_stats_wakeup()
+{
+    uint32_t counts = am_hal_stimer_counter_get() - idle_entry;
+
+    if (idle_deep) {
+        idle_deep_sleeps++;
+        idle_deep_sleep_counts += counts;
+    } else {
+        idle_sleeps++;
+        idle_sleep_counts += counts;
+    }
+}
+
+void idle_stats(idle_stats_t *stats)
+{
+    uint32_t active;
+    uint64_t charge;
+
+    memset(stats, 0, sizeof(*stats));
+
+    taskENTER_CRITICAL();
+    stats->elapsed = (xTaskGetTickCount() - idle_start) * portTICK_PERIOD_MS;
+    stats->sleep_time = idle_ms(idle_sleep_counts);
+    stats->deep_sleep_time = idle_ms(idle_deep_sleep_counts);
+    stats->sleeps = idle_sleeps;
+    stats->deep_sleeps = idle_deep_sleeps;
+    taskEXIT_CRITICAL();
+
+    if (stats->elapsed == 0) {
+        return;
+    }
+
+    active = stats->elapsed - stats->sleep_time - stats->deep_sleep_time;
+    if (active > stats->elapsed) {
+        active = 0;
+    }
+    charge = (uint64_t)active * IDLE_ACTIVE_CURRENT +
+             (uint64_t)stats->sleep_time * IDLE_SLEEP_CURRENT +
+             (uint64_t)stats->deep_sleep_time * LORAWAN_SLEEP_CURRENT;
+    stats->average_current = (uint32_t)(charge / stats->elapsed);
+}
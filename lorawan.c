@@ -39,6 +39,9 @@
 #include <am_mcu_apollo.h>
 #include <am_util.h>
 
+#include <FreeRTOS.h>
+#include <task.h>
+
 #include <LmHandler.h>
 #include <LmHandlerMsgDisplay.h>
 #include <LmhpClockSync.h>
@@ -46,10 +49,29 @@
 #include <LmhpRemoteMcastSetup.h>
 #include <board.h>
 
+#include "cli_batch.h"
+#include "cli_table.h"
 #include "lorawan.h"
+#include "lorawan_bench.h"
+#include "lorawan_budget.h"
+#include "lorawan_buffer.h"
+#include "lorawan_class_policy.h"
+#include "lorawan_coalesce.h"
 #include "lorawan_cli.h"
 #include "lorawan_config.h"
+#include "lorawan_confirmed.h"
+#include "lorawan_downlink.h"
+#include "lorawan_drain.h"
+#include "lorawan_fragment.h"
+#include "lorawan_fuota.h"
+#include "lorawan_join_scheduler.h"
+#include "lorawan_journal.h"
+#include "lorawan_log.h"
+#include "lorawan_mac_request.h"
+#include "lorawan_rx_calibration.h"
+#include "lorawan_stats.h"
 #include "task_message.h"
+#include "token_log_cli.h"
 
 #define LORAWAN_EVENT_JOIN  0x01
 
@@ -57,11 +79,14 @@ TaskHandle_t  lorawan_task_handle;
 QueueHandle_t lorawan_task_queue;
 
 static QueueHandle_t lorawan_transmit_queue;
+static uint32_t lorawan_transaction_id;
 
 uint8_t AppDataBuffer[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
 
 static volatile uint8_t IsMacProcessPending = 0;
+static TickType_t       lorawan_timeout;
 static volatile uint8_t IsTxFramePending    = 0;
+static bool             IsMacProcessing     = false;
 
 static LmHandlerCallbacks_t   LmHandlerCallbacks;
 static LmHandlerParams_t      LmHandlerParams;
@@ -106,11 +131,102 @@ void lorawan_join()
     task_message_t task_message;
     task_message.ui32Event = LORAWAN_EVENT_JOIN;
     xQueueSend(lorawan_task_queue, &task_message, portMAX_DELAY);
+    lorawan_wake();
+}
+
+// The task blocks between passes until it is woken here, by the MAC, its
+// timers, the radio interrupt or a new uplink, or until the earliest
+// deadline a module asked for with lorawan_wake_in().
+void lorawan_wake()
+{
+    if (lorawan_task_handle == NULL) {
+        return;
+    }
+
+    // without the woken flag the switch is left pending to the end of the
+    // tick or of the idle sleep, which also suits the simulator tick hook
+    if (__get_IPSR() != 0) {
+        vTaskNotifyGiveFromISR(lorawan_task_handle, NULL);
+    } else {
+        xTaskNotifyGive(lorawan_task_handle);
+    }
+}
+
+// Called by the modules from their process functions with the time in ms
+// until they have work again.
+void lorawan_wake_in(uint32_t delay)
+{
+    TickType_t ticks = pdMS_TO_TICKS(delay);
+
+    if (ticks < lorawan_timeout) {
+        lorawan_timeout = ticks;
+    }
+}
+
+// Checks that length bytes of payload fit the next uplink together with
+// the MAC commands queued in the MAC and in lorawan_mac_request.c, called
+// by the senders right before LmHandlerSend(), which would otherwise
+// send an empty frame in place of a payload that does not fit and
+// report success.  When only the commands are in the way they go out on
+// their own first and the payload is deferred to a later pass.
+uint8_t lorawan_payload_check(uint8_t length)
+{
+    LmHandlerAppData_t appData = {.Buffer = NULL, .BufferSize = 0, .Port = 0};
+    LoRaMacTxInfo_t txInfo;
+    uint32_t attached;
+
+    if (LoRaMacQueryTxPossible(length + lorawan_mac_request_length(),
+                               &txInfo) == LORAMAC_STATUS_OK) {
+        return LORAWAN_PAYLOAD_FITS;
+    }
+
+    if (length > txInfo.MaxPossibleApplicationDataSize) {
+        return LORAWAN_PAYLOAD_TOO_LONG;
+    }
+
+    attached = lorawan_mac_request_attach();
+    lorawan_mac_request_sent(
+        attached, LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG));
+
+    return LORAWAN_PAYLOAD_DEFERRED;
+}
+
+// The LoRaMac timers expire in the RTC interrupt of the board support,
+// wrapped at link time (see application.mk).
+extern void __real_TimerIrqHandler(void);
+
+void __wrap_TimerIrqHandler(void)
+{
+    __real_TimerIrqHandler();
+    lorawan_wake();
 }
 
-void lorawan_send(lorawan_transaction_t *transaction)
+uint32_t lorawan_send(lorawan_transaction_t *transaction)
 {
-    xQueueSend(lorawan_transmit_queue, transaction, portMAX_DELAY);
+    taskENTER_CRITICAL();
+    transaction->id = ++lorawan_transaction_id;
+    taskEXIT_CRITICAL();
+
+    transaction->timestamp = TimerGetCurrentTime();
+    if (transaction->message_type == LORAMAC_HANDLER_CONFIRMED_MSG) {
+        if (!lorawan_confirmed_submit(transaction)) {
+            lorawan_buffer_release(transaction->buffer);
+            return 0;
+        }
+    } else if (lorawan_journal_active()) {
+        lorawan_journal_append(transaction);
+        lorawan_buffer_release(transaction->buffer);
+    } else if (!lorawan_coalesce_submit(transaction) &&
+               (xQueueSend(lorawan_transmit_queue, transaction, 0) != pdPASS)) {
+        // the slot may hold a newer uplink with the same key by now
+        lorawan_transaction_t latest = *transaction;
+        lorawan_coalesce_resolve(&latest, true);
+        lorawan_journal_append(&latest);
+        lorawan_buffer_release(latest.buffer);
+    }
+
+    lorawan_wake();
+    return transaction->id;
 }
 
 static void lorawan_setup()
@@ -150,44 +266,79 @@ static void lorawan_setup()
     LmHandlerAppData.BufferSize = 0;
     LmHandlerAppData.Port       = 0;
 
+    lorawan_log_init();
     LmHandlerInit(&LmHandlerCallbacks, &LmHandlerParams);
-    LmHandlerSetSystemMaxRxError(20);
+    lorawan_rx_calibration_init();
     LmHandlerPackageRegister(PACKAGE_ID_COMPLIANCE, &LmhpComplianceParams);
+    lorawan_fuota_setup();
+
+    lorawan_join_scheduler_init();
+    lorawan_class_policy_init();
 }
 
 void lorawan_task(void *pvParameters)
 {
-    FreeRTOS_CLIRegisterCommand(&LoRaWANCommandDefinition);
+    lorawan_buffer_init();
+    cli_table_register(&LoRaWANCommandDefinition, &LoRaWANCommandTable);
+    FreeRTOS_CLIRegisterCommand(&cli_batch_command_definition);
+    cli_table_register(&token_log_command_definition,
+                       &token_log_command_table);
     lorawan_task_queue = xQueueCreate(10, sizeof(task_message_t));
     lorawan_transmit_queue = xQueueCreate(10, sizeof(lorawan_transaction_t));
+    lorawan_fragment_init();
+    lorawan_coalesce_init();
+    lorawan_confirmed_init();
+    lorawan_mac_request_init();
+    lorawan_budget_init();
+    lorawan_journal_init();
+    lorawan_downlink_init();
+    lorawan_drain_init();
+    lorawan_bench_init();
 
     lorawan_setup();
 
     while (1) {
+        lorawan_timeout = pdMS_TO_TICKS(LORAWAN_TASK_POLL);
         lorawan_handler();
+        lorawan_join_scheduler_process();
+        IsMacProcessing = true;
         LmHandlerProcess();
+        IsMacProcessing = false;
+        lorawan_journal_process();
+        lorawan_bench_process();
         UplinkProcess();
-
+        lorawan_drain_process(
+            (uxQueueMessagesWaiting(lorawan_transmit_queue) > 0) ||
+            lorawan_journal_active());
+        lorawan_fragment_process();
+        lorawan_downlink_process();
+        lorawan_rx_calibration_process();
+        lorawan_mac_request_process();
+        lorawan_class_policy_process();
+        lorawan_fuota_process();
+
+        // block outside of the critical section, a wake up given after the
+        // flag was read is kept in the notification count
         taskENTER_CRITICAL();
-        if (IsMacProcessPending) {
-            IsMacProcessPending = 0;
-        }
-        else
-        {
-        	taskYIELD();
-        }
+        bool pending = IsMacProcessPending;
+        IsMacProcessPending = 0;
         taskEXIT_CRITICAL();
+
+        if (!pending) {
+            ulTaskNotifyTake(pdTRUE, lorawan_timeout);
+        }
     }
 }
 
 static void OnMacProcessNotify(void)
 {
     IsMacProcessPending = 1;
+    lorawan_wake();
 }
 
 static void OnNvmDataChange(LmHandlerNvmContextStates_t state, uint16_t size)
 {
-    DisplayNvmDataChange(state, size);
+    lorawan_log_nvm(state, size);
 }
 
 static void OnNetworkParametersChange(CommissioningParams_t *params)
@@ -198,37 +349,71 @@ static void OnNetworkParametersChange(CommissioningParams_t *params)
 static void OnMacMcpsRequest(LoRaMacStatus_t status, McpsReq_t *mcpsReq,
                              TimerTime_t nextTxIn)
 {
-    DisplayMacMcpsRequestUpdate(status, mcpsReq, nextTxIn);
+    lorawan_log_mcps(status, mcpsReq, nextTxIn);
+    lorawan_stats_request(status, nextTxIn);
+    lorawan_budget_request(status, nextTxIn);
+
+    // LmHandler answers a downlink with FPending set with an empty frame
+    if (IsMacProcessing && (mcpsReq->Type == MCPS_UNCONFIRMED) &&
+        (mcpsReq->Req.Unconfirmed.fBufferSize == 0)) {
+        lorawan_drain_request(status, nextTxIn);
+    } else {
+        lorawan_drain_uplink(status, nextTxIn);
+    }
 }
 
 static void OnMacMlmeRequest(LoRaMacStatus_t status, MlmeReq_t *mlmeReq,
                              TimerTime_t nextTxIn)
 {
-    DisplayMacMlmeRequestUpdate(status, mlmeReq, nextTxIn);
+    lorawan_log_mlme(status, mlmeReq, nextTxIn);
+    lorawan_stats_request(status, nextTxIn);
+    lorawan_budget_request(status, nextTxIn);
+    if ((status == LORAMAC_STATUS_OK) && (mlmeReq->Type == MLME_JOIN)) {
+        lorawan_budget_consume(LORAWAN_JOIN_TIME_ON_AIR);
+    }
 }
 
 static void OnJoinRequest(LmHandlerJoinParams_t *params)
 {
-    DisplayJoinRequestUpdate(params);
+    lorawan_log_join(params);
     if (params->Status == LORAMAC_HANDLER_ERROR) {
-        LmHandlerJoin();
+        lorawan_join_scheduler_result(false);
     } else {
+        lorawan_join_scheduler_result(true);
+        lorawan_fuota_joined();
         LmHandlerRequestClass(LORAWAN_DEFAULT_CLASS);
     }
 }
 
 static void OnTxData(LmHandlerTxParams_t *params)
 {
-    DisplayTxUpdate(params);
+    lorawan_log_tx(params);
+    lorawan_stats_tx(params);
+    lorawan_budget_tx(params);
+    lorawan_rx_calibration_tx(params);
+    lorawan_confirmed_tx_done(params);
+    lorawan_fragment_tx_done(params);
+    lorawan_class_policy_tx_done();
+    lorawan_bench_tx_done(params);
 }
 
 static void OnRxData(LmHandlerAppData_t *appData, LmHandlerRxParams_t *params)
 {
-    DisplayRxUpdate(appData, params);
+    lorawan_log_rx(appData, params);
+    lorawan_stats_rx(params);
+    lorawan_rx_calibration_rx(params);
+    lorawan_class_policy_rx_done(params);
+    lorawan_drain_rx(params);
 
     switch (appData->Port) {
     case LORAWAN_APP_PORT:
         break;
+    case LORAWAN_DOWNLINK_PORT:
+        lorawan_downlink_rx(appData);
+        break;
+    case LORAWAN_FUOTA_FRAG_PORT:
+        lorawan_fuota_rx(appData);
+        break;
     default:
         break;
     }
@@ -236,10 +421,12 @@ static void OnRxData(LmHandlerAppData_t *appData, LmHandlerRxParams_t *params)
 
 static void OnClassChange(DeviceClass_t deviceClass)
 {
-    DisplayClassUpdate(deviceClass);
+    lorawan_log_class(deviceClass);
+    lorawan_class_policy_class_change(deviceClass);
 
-    LmHandlerAppData_t appData = {.Buffer = NULL, .BufferSize = 0, .Port = 0};
-    LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
+    // let the server know about the switch with the next uplink
+    lorawan_mac_request(LORAWAN_MAC_REQUEST_UPLINK,
+                        LORAWAN_CLASS_ANNOUNCE_DEADLINE);
 }
 
 static void OnBeaconStatusChange(LoRaMAcHandlerBeaconParams_t *params)
@@ -252,31 +439,82 @@ static void OnBeaconStatusChange(LoRaMAcHandlerBeaconParams_t *params)
         break;
     }
 
-    DisplayBeaconUpdate(params);
+    lorawan_log_beacon(params);
 }
 
 static void OnSysTimeUpdate(bool isSynchronized, int32_t timeCorrection)
 {
+    lorawan_class_policy_time_sync(isSynchronized);
+    lorawan_fuota_time_sync(isSynchronized);
+    lorawan_rx_calibration_time_sync(isSynchronized);
 }
 
 static void UplinkProcess(void)
 {
     lorawan_transaction_t transaction;
+    LmHandlerErrorStatus_t status;
+    uint32_t attached;
+    uint8_t fit;
+
+    // confirmed attempts take turns with the unconfirmed traffic
+    if (lorawan_confirmed_process(
+            uxQueueMessagesWaiting(lorawan_transmit_queue) > 0)) {
+        return;
+    }
+
     if (xQueuePeek(lorawan_transmit_queue, &transaction, 0) == pdPASS)
     {
+        lorawan_coalesce_resolve(&transaction, false);
         if (LmHandlerIsBusy() == true)
         {
             return;
         }
+        if (lorawan_budget_hold(transaction.length))
+        {
+            uint32_t wait = lorawan_time_until_tx(transaction.length);
+            if (wait != LORAWAN_BUDGET_NEVER)
+            {
+                lorawan_wake_in(wait);
+            }
+            return;
+        }
+        fit = lorawan_payload_check(transaction.length);
+        if (fit == LORAWAN_PAYLOAD_DEFERRED)
+        {
+            return;
+        }
 
         if (xQueueReceive(lorawan_transmit_queue, &transaction, 0) == pdPASS)
         {
+            lorawan_coalesce_resolve(&transaction, true);
+            lorawan_stats_dequeue(TimerGetElapsedTime(transaction.timestamp));
+            lorawan_bench_dequeue(
+                &transaction,
+                uxQueueMessagesWaiting(lorawan_transmit_queue) + 1);
+
+            // the datarate in use cannot carry the payload at all
+            if (fit == LORAWAN_PAYLOAD_TOO_LONG)
+            {
+                lorawan_stats_uplink_rejected();
+                lorawan_bench_sent(&transaction, LORAMAC_HANDLER_ERROR);
+                lorawan_buffer_release(transaction.buffer);
+                return;
+            }
+
             LmHandlerAppData.Port = transaction.port;
             LmHandlerAppData.BufferSize = transaction.length;
             LmHandlerAppData.Buffer = transaction.buffer;
 
-            LmHandlerSend(&LmHandlerAppData, transaction.message_type);
+            attached = lorawan_mac_request_attach();
+            status = LmHandlerSend(&LmHandlerAppData, transaction.message_type);
+            lorawan_mac_request_sent(attached, status);
+            lorawan_bench_sent(&transaction, status);
+
+            // the MAC has copied the payload into its frame
+            lorawan_buffer_release(transaction.buffer);
         }
+    } else {
+        lorawan_journal_send();
     }
 }
 
@@ -284,14 +522,12 @@ static void lorawan_handler()
 {
     task_message_t task_message;
 
-    // do not block on message receive as the LoRa MAC state machine decides
-    // when it is appropriate to sleep.  We also do not explicitly go to
-    // sleep directly and simply do a task yield.  This allows other timing
-    // critical radios such as BLE to run their state machines.
+    // do not block on message receive, the task blocks at the end of its
+    // pass until the MAC, a timer or a producer wakes it
     if (xQueueReceive(lorawan_task_queue, &task_message, 0) == pdPASS) {
         switch (task_message.ui32Event) {
         case LORAWAN_EVENT_JOIN:
-            LmHandlerJoin();
+            lorawan_join_scheduler_start();
             break;
         }
     }
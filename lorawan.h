@@ -32,22 +32,48 @@
 #ifndef _LORAWAN_H_
 #define _LORAWAN_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <FreeRTOS.h>
 #include <LmHandler.h>
 #include <queue.h>
 
-typedef struct {
-    LmHandlerMsgTypes_t  message_type;
-    uint32_t             length; 
-    uint8_t             *buffer;
-    uint8_t              port;
-} lorawan_transaction_t;
+// uplinks with this key are never coalesced
+#define LORAWAN_KEY_NONE 0
+
+// lorawan_payload_check() results
+#define LORAWAN_PAYLOAD_FITS     0
+#define LORAWAN_PAYLOAD_DEFERRED 1
+#define LORAWAN_PAYLOAD_TOO_LONG 2
+
+typedef struct lorawan_transaction_s lorawan_transaction_t;
+
+// called from the LoRaWAN task when a confirmed transaction completes
+typedef void (*lorawan_transaction_callback_t)(
+    const lorawan_transaction_t *transaction, bool acked);
+
+struct lorawan_transaction_s {
+    LmHandlerMsgTypes_t             message_type;
+    uint32_t                        length;
+    uint8_t                        *buffer;
+    uint8_t                         port;
+    uint8_t                         key;
+    TimerTime_t                     timestamp;
+    uint32_t                        id;
+    lorawan_transaction_callback_t  callback;
+    void                           *context;
+};
 
 extern TaskHandle_t lorawan_task_handle;
 extern QueueHandle_t lorawan_task_queue;
 
 extern void lorawan_task(void *pvParameters);
 extern void lorawan_join();
-extern void lorawan_send(lorawan_transaction_t *transaction);
+extern void lorawan_wake();
+extern void lorawan_wake_in(uint32_t delay);
+extern uint8_t lorawan_payload_check(uint8_t length);
+// returns the transaction id, 0 if it was not accepted
+extern uint32_t lorawan_send(lorawan_transaction_t *transaction);
 
 #endif /* _LORAWAN_H_ */
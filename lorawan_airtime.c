@@ -0,0 +1,118 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+#include "lorawan_airtime.h"
+#include "lorawan_config.h"
+
+#define LORA_PREAMBLE_LENGTH 8
+#define LORA_CODING_RATE     1
+
+typedef struct {
+    uint8_t  sf;
+    uint16_t bandwidth;
+} lora_datarate_t;
+
+static const lora_datarate_t datarates_us915[] = {
+    {10, 125}, {9, 125}, {8, 125}, {7, 125}, {8, 500}, {0, 0},
+    {0, 0},    {0, 0},   {12, 500}, {11, 500}, {10, 500}, {9, 500},
+    {8, 500},  {7, 500},
+};
+
+static const lora_datarate_t datarates_default[] = {
+    {12, 125}, {11, 125}, {10, 125}, {9, 125}, {8, 125}, {7, 125}, {7, 250},
+};
+
+static const lora_datarate_t *lorawan_datarate(int8_t datarate)
+{
+    const lora_datarate_t *table = datarates_default;
+    uint32_t count = sizeof(datarates_default) / sizeof(lora_datarate_t);
+
+    if (ACTIVE_REGION == LORAMAC_REGION_US915) {
+        table = datarates_us915;
+        count = sizeof(datarates_us915) / sizeof(lora_datarate_t);
+    }
+
+    if ((datarate < 0) || (datarate >= count) || (table[datarate].sf == 0)) {
+        return NULL;
+    }
+
+    return &table[datarate];
+}
+
+// LoRa symbol time in us, 0 for datarates that are not LoRa
+uint32_t lorawan_symbol_time(int8_t datarate)
+{
+    const lora_datarate_t *dr = lorawan_datarate(datarate);
+
+    if (dr == NULL) {
+        return 0;
+    }
+
+    return ((uint32_t)1000 << dr->sf) / dr->bandwidth;
+}
+
+// LoRa time on air in ms of an uplink carrying length bytes of application
+// payload, as given in the SX126x datasheet (explicit header, CRC on).
+uint32_t lorawan_time_on_air(int8_t datarate, uint8_t length)
+{
+    const lora_datarate_t *dr = lorawan_datarate(datarate);
+    uint32_t symbol_time;
+    uint32_t low_dr_optimize;
+    int32_t numerator;
+    uint32_t payload_symbols;
+    uint32_t sf;
+
+    if (dr == NULL) {
+        return 0;
+    }
+
+    sf = dr->sf;
+    symbol_time = ((uint32_t)1000 << sf) / dr->bandwidth;
+    low_dr_optimize = (symbol_time > 16000) ? 1 : 0;
+
+    numerator = 8 * (length + LORAWAN_FRAME_OVERHEAD) - 4 * sf + 28 + 16;
+    payload_symbols = 8;
+    if (numerator > 0) {
+        uint32_t denominator = 4 * (sf - 2 * low_dr_optimize);
+        payload_symbols += ((numerator + denominator - 1) / denominator) *
+                           (LORA_CODING_RATE + 4);
+    }
+
+    // symbol time is in us, preamble adds 4.25 symbols
+    return (symbol_time * (LORA_PREAMBLE_LENGTH * 4 + 17 + payload_symbols * 4) /
+                4 + 999) / 1000;
+}
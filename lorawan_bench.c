@@ -0,0 +1,299 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_util.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+
+#include "lorawan.h"
+#include "lorawan_bench.h"
+#include "lorawan_config.h"
+
+// Uplink load generator.  Bursts of uplinks are handed to lorawan_send()
+// every interval and each one is timestamped when it is queued, taken off
+// the transmit queue, returned from LmHandlerSend() and confirmed by the
+// MAC.  The transaction context points at the record of the uplink so
+// that bench traffic is told apart from the rest without a lookup.
+//
+// A bench ends once every uplink is confirmed or rejected, or
+// LORAWAN_BENCH_TIMEOUT ms after the last one was queued, e.g. when
+// uplinks went to the journal instead of the queue.
+
+#define STAGE_QUEUED   0
+#define STAGE_DEQUEUED 1
+#define STAGE_SENT     2
+#define STAGE_DONE     3
+#define STAGES         4
+
+typedef struct {
+    TimerTime_t time[STAGES];
+    uint8_t stage;
+} bench_record_t;
+
+static lorawan_bench_config_t bench_config;
+static bench_record_t bench_records[LORAWAN_BENCH_RECORDS];
+static uint8_t bench_payload[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+static uint32_t bench_scratch[LORAWAN_BENCH_RECORDS];
+
+static bool bench_active;
+static TimerTime_t bench_next;
+static TimerTime_t bench_last_queued;
+static bench_record_t *bench_transmitting;
+static lorawan_bench_result_t bench_result;
+
+static bench_record_t *bench_record(const lorawan_transaction_t *transaction)
+{
+    bench_record_t *record = transaction->context;
+
+    if ((record < &bench_records[0]) ||
+        (record >= &bench_records[bench_result.submitted])) {
+        return NULL;
+    }
+
+    return record;
+}
+
+static void bench_submit()
+{
+    bench_record_t *record = &bench_records[bench_result.submitted];
+    lorawan_transaction_t transaction;
+
+    transaction.message_type = LORAMAC_HANDLER_UNCONFIRMED_MSG;
+    transaction.length = bench_config.size;
+    transaction.buffer = bench_payload;
+    transaction.port = LORAWAN_BENCH_PORT;
+    transaction.key = LORAWAN_KEY_NONE;
+    transaction.callback = NULL;
+    transaction.context = record;
+
+    record->stage = STAGE_QUEUED;
+    bench_result.submitted++;
+    lorawan_send(&transaction);
+    record->time[STAGE_QUEUED] = transaction.timestamp;
+    bench_last_queued = transaction.timestamp;
+}
+
+static void bench_finish()
+{
+    lorawan_bench_result_t result;
+
+    bench_active = false;
+    bench_result.active = false;
+    bench_transmitting = NULL;
+
+    lorawan_bench_result(&result);
+    am_util_stdio_printf("\r\nbench done, %d/%d uplinks in %d ms\r\n",
+                         result.done, result.submitted, result.elapsed);
+}
+
+void lorawan_bench_init()
+{
+    bench_active = false;
+    bench_transmitting = NULL;
+    memset(&bench_result, 0, sizeof(bench_result));
+
+    for (uint32_t i = 0; i < sizeof(bench_payload); i++) {
+        bench_payload[i] = i;
+    }
+}
+
+bool lorawan_bench_start(const lorawan_bench_config_t *config)
+{
+    if (bench_active || (config->count == 0) ||
+        (config->count > LORAWAN_BENCH_RECORDS) ||
+        (config->size > LORAWAN_APP_DATA_BUFFER_MAX_SIZE)) {
+        return false;
+    }
+
+    bench_config = *config;
+    if (bench_config.burst == 0) {
+        bench_config.burst = 1;
+    }
+
+    memset(&bench_result, 0, sizeof(bench_result));
+    bench_result.active = true;
+    bench_transmitting = NULL;
+    bench_next = TimerGetCurrentTime();
+    bench_active = true;
+
+    return true;
+}
+
+void lorawan_bench_stop()
+{
+    if (bench_active) {
+        bench_finish();
+    }
+}
+
+void lorawan_bench_process()
+{
+    uint32_t resolved;
+
+    if (!bench_active) {
+        return;
+    }
+
+    while ((bench_result.submitted < bench_config.count) &&
+           ((int32_t)(TimerGetCurrentTime() - bench_next) >= 0)) {
+        for (uint32_t i = 0; (i < bench_config.burst) &&
+                             (bench_result.submitted < bench_config.count);
+             i++) {
+            bench_submit();
+        }
+        bench_next += bench_config.interval;
+    }
+    if (bench_result.submitted < bench_config.count) {
+        lorawan_wake_in(bench_next - TimerGetCurrentTime());
+    }
+
+    resolved = bench_result.done + bench_result.rejected;
+    if ((resolved == bench_config.count) ||
+        ((bench_result.submitted == bench_config.count) &&
+         (TimerGetElapsedTime(bench_last_queued) > LORAWAN_BENCH_TIMEOUT))) {
+        bench_finish();
+    }
+}
+
+// occupancy counts the uplink just taken off the queue
+void lorawan_bench_dequeue(const lorawan_transaction_t *transaction,
+                           uint32_t occupancy)
+{
+    bench_record_t *record = bench_record(transaction);
+
+    if (!bench_active || (record == NULL)) {
+        return;
+    }
+
+    record->time[STAGE_DEQUEUED] = TimerGetCurrentTime();
+    record->stage = STAGE_DEQUEUED;
+    bench_result.dequeued++;
+    bench_result.occupancy_total += occupancy;
+    if (occupancy > bench_result.occupancy_max) {
+        bench_result.occupancy_max = occupancy;
+    }
+}
+
+void lorawan_bench_sent(const lorawan_transaction_t *transaction,
+                        LmHandlerErrorStatus_t status)
+{
+    bench_record_t *record = bench_record(transaction);
+
+    bench_transmitting = NULL;
+    if (!bench_active || (record == NULL)) {
+        return;
+    }
+
+    // a rejected uplink stays at the sent stage for good
+    record->time[STAGE_SENT] = TimerGetCurrentTime();
+    record->stage = STAGE_SENT;
+    if (status == LORAMAC_HANDLER_SUCCESS) {
+        bench_result.sent++;
+        bench_transmitting = record;
+    } else {
+        bench_result.rejected++;
+    }
+}
+
+void lorawan_bench_tx_done(LmHandlerTxParams_t *params)
+{
+    bench_record_t *record = bench_transmitting;
+
+    if ((params->IsMcpsConfirm == 0) || (record == NULL)) {
+        return;
+    }
+
+    bench_transmitting = NULL;
+    record->time[STAGE_DONE] = TimerGetCurrentTime();
+    record->stage = STAGE_DONE;
+    bench_result.done++;
+    bench_result.bytes += bench_config.size;
+}
+
+// Nearest rank percentiles of the time between two stages over the
+// uplinks that reached the later one
+static void bench_latency(lorawan_bench_latency_t *latency, uint8_t from,
+                          uint8_t to)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < bench_result.submitted; i++) {
+        const bench_record_t *record = &bench_records[i];
+        uint32_t value;
+        uint32_t j;
+
+        if (record->stage < to) {
+            continue;
+        }
+
+        value = record->time[to] - record->time[from];
+        for (j = count; (j > 0) && (bench_scratch[j - 1] > value); j--) {
+            bench_scratch[j] = bench_scratch[j - 1];
+        }
+        bench_scratch[j] = value;
+        count++;
+    }
+
+    memset(latency, 0, sizeof(*latency));
+    if (count == 0) {
+        return;
+    }
+
+    latency->p50 = bench_scratch[(50 * count + 99) / 100 - 1];
+    latency->p90 = bench_scratch[(90 * count + 99) / 100 - 1];
+    latency->p99 = bench_scratch[(99 * count + 99) / 100 - 1];
+    latency->max = bench_scratch[count - 1];
+}
+
+void lorawan_bench_result(lorawan_bench_result_t *result)
+{
+    TimerTime_t last = bench_records[0].time[STAGE_QUEUED];
+
+    bench_latency(&bench_result.queue, STAGE_QUEUED, STAGE_DEQUEUED);
+    bench_latency(&bench_result.send, STAGE_DEQUEUED, STAGE_SENT);
+    bench_latency(&bench_result.tx, STAGE_SENT, STAGE_DONE);
+    bench_latency(&bench_result.total, STAGE_QUEUED, STAGE_DONE);
+
+    for (uint32_t i = 0; i < bench_result.submitted; i++) {
+        if ((bench_records[i].stage == STAGE_DONE) &&
+            ((int32_t)(bench_records[i].time[STAGE_DONE] - last) > 0)) {
+            last = bench_records[i].time[STAGE_DONE];
+        }
+    }
+    bench_result.elapsed = last - bench_records[0].time[STAGE_QUEUED];
+
+    *result = bench_result;
+}
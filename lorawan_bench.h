@@ -0,0 +1,84 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_BENCH_H_
+#define _LORAWAN_BENCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+#include "lorawan.h"
+
+typedef struct {
+    uint32_t count;
+    uint32_t size;
+    uint32_t interval;
+    uint32_t burst;
+} lorawan_bench_config_t;
+
+typedef struct {
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t max;
+} lorawan_bench_latency_t;
+
+typedef struct {
+    bool active;
+    uint32_t submitted;
+    uint32_t dequeued;
+    uint32_t sent;
+    uint32_t rejected;
+    uint32_t done;
+    uint32_t bytes;
+    uint32_t elapsed;
+    uint32_t occupancy_max;
+    uint32_t occupancy_total;
+    lorawan_bench_latency_t queue;
+    lorawan_bench_latency_t send;
+    lorawan_bench_latency_t tx;
+    lorawan_bench_latency_t total;
+} lorawan_bench_result_t;
+
+extern void lorawan_bench_init();
+extern bool lorawan_bench_start(const lorawan_bench_config_t *config);
+extern void lorawan_bench_stop();
+extern void lorawan_bench_process();
+extern void lorawan_bench_dequeue(const lorawan_transaction_t *transaction,
+                                  uint32_t occupancy);
+extern void lorawan_bench_sent(const lorawan_transaction_t *transaction,
+                               LmHandlerErrorStatus_t status);
+extern void lorawan_bench_tx_done(LmHandlerTxParams_t *params);
+extern void lorawan_bench_result(lorawan_bench_result_t *result);
+
+#endif /* _LORAWAN_BENCH_H_ */
@@ -0,0 +1,210 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+
+#include "lorawan_airtime.h"
+#include "lorawan_budget.h"
+#include "lorawan_config.h"
+
+// Airtime token buckets.  A bucket refills at rate/scale ms of airtime per
+// ms of wall time up to its capacity and each frame takes its time on air.
+// Levels are kept multiplied by the scale so the refill stays exact.
+//
+// The regulatory bucket follows the band time credits of the MAC, the
+// duty cycle over a one hour observation window.  The fleet bucket is our
+// own share of the network airtime.
+typedef struct {
+    uint32_t rate;
+    uint32_t scale;
+    uint64_t level;
+    uint64_t capacity;
+    bool     enabled;
+} budget_bucket_t;
+
+#define REGULATORY_WINDOW 3600000
+
+static budget_bucket_t regulatory;
+static budget_bucket_t fleet;
+static TimerTime_t budget_updated;
+static TimerTime_t mac_blocked_until;
+
+static void bucket_init(budget_bucket_t *b, uint32_t rate, uint32_t scale,
+                        uint32_t capacity, bool enabled)
+{
+    b->rate = rate;
+    b->scale = scale;
+    b->capacity = (uint64_t)capacity * scale;
+    b->level = b->capacity;
+    b->enabled = enabled;
+}
+
+static void bucket_refill(budget_bucket_t *b, uint32_t elapsed)
+{
+    b->level += (uint64_t)elapsed * b->rate;
+    if (b->level > b->capacity) {
+        b->level = b->capacity;
+    }
+}
+
+static void bucket_take(budget_bucket_t *b, uint32_t airtime)
+{
+    uint64_t cost = (uint64_t)airtime * b->scale;
+
+    b->level = (cost < b->level) ? (b->level - cost) : 0;
+}
+
+static uint32_t bucket_wait(const budget_bucket_t *b, uint32_t airtime)
+{
+    uint64_t cost = (uint64_t)airtime * b->scale;
+
+    if (!b->enabled || (cost <= b->level)) {
+        return 0;
+    }
+    if ((cost > b->capacity) || (b->rate == 0)) {
+        return LORAWAN_BUDGET_NEVER;
+    }
+
+    return (cost - b->level + b->rate - 1) / b->rate;
+}
+
+// must be called in a critical section
+static void budget_update()
+{
+    TimerTime_t now = TimerGetCurrentTime();
+    uint32_t elapsed = now - budget_updated;
+
+    budget_updated = now;
+    bucket_refill(&regulatory, elapsed);
+    bucket_refill(&fleet, elapsed);
+}
+
+void lorawan_budget_init()
+{
+    bucket_init(&regulatory, LORAWAN_BUDGET_REGULATORY_DUTY, 1000,
+                REGULATORY_WINDOW / 1000 * LORAWAN_BUDGET_REGULATORY_DUTY,
+                LORAWAN_DUTYCYCLE_ON);
+    bucket_init(&fleet, LORAWAN_BUDGET_FLEET_AIRTIME, LORAWAN_BUDGET_FLEET_PERIOD,
+                LORAWAN_BUDGET_FLEET_BURST, LORAWAN_BUDGET_FLEET_AIRTIME > 0);
+
+    budget_updated = TimerGetCurrentTime();
+    mac_blocked_until = budget_updated;
+}
+
+void lorawan_budget_consume(uint32_t airtime)
+{
+    taskENTER_CRITICAL();
+    budget_update();
+    bucket_take(&regulatory, airtime);
+    bucket_take(&fleet, airtime);
+    taskEXIT_CRITICAL();
+}
+
+void lorawan_budget_tx(LmHandlerTxParams_t *params)
+{
+    if (params->IsMcpsConfirm == 0) {
+        return;
+    }
+
+    lorawan_budget_consume(
+        lorawan_time_on_air(params->Datarate, params->AppData.BufferSize));
+}
+
+void lorawan_budget_request(LoRaMacStatus_t status, TimerTime_t nextTxIn)
+{
+    if (status == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED) {
+        taskENTER_CRITICAL();
+        mac_blocked_until = TimerGetCurrentTime() + nextTxIn;
+        taskEXIT_CRITICAL();
+    }
+}
+
+uint32_t lorawan_time_until_tx_datarate(uint8_t length, int8_t datarate)
+{
+    uint32_t airtime = lorawan_time_on_air(datarate, length);
+    uint32_t wait, w;
+
+    taskENTER_CRITICAL();
+    budget_update();
+
+    wait = bucket_wait(&regulatory, airtime);
+    w = bucket_wait(&fleet, airtime);
+    if (w > wait) {
+        wait = w;
+    }
+
+    w = mac_blocked_until - budget_updated;
+    if (((int32_t)w > 0) && (w > wait)) {
+        wait = w;
+    }
+    taskEXIT_CRITICAL();
+
+    return wait;
+}
+
+uint32_t lorawan_time_until_tx(uint8_t length)
+{
+    return lorawan_time_until_tx_datarate(length, LmHandlerGetCurrentDatarate());
+}
+
+// Senders in the LoRaWAN task hold a frame back while it does not fit
+// the budget.  Frames that never fit are let through, the MAC rejects
+// them if they violate the regulatory limits.
+bool lorawan_budget_hold(uint8_t length)
+{
+    uint32_t wait = lorawan_time_until_tx(length);
+
+    return (wait != 0) && (wait != LORAWAN_BUDGET_NEVER);
+}
+
+void lorawan_budget_status(lorawan_budget_status_t *status)
+{
+    uint32_t wait;
+
+    taskENTER_CRITICAL();
+    budget_update();
+    status->regulatory_level = regulatory.level / regulatory.scale;
+    status->regulatory_capacity =
+        regulatory.enabled ? regulatory.capacity / regulatory.scale : 0;
+    status->fleet_level = fleet.level / fleet.scale;
+    status->fleet_capacity = fleet.enabled ? fleet.capacity / fleet.scale : 0;
+    wait = mac_blocked_until - budget_updated;
+    status->mac_wait = ((int32_t)wait > 0) ? wait : 0;
+    taskEXIT_CRITICAL();
+}
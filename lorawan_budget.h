@@ -0,0 +1,61 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_BUDGET_H_
+#define _LORAWAN_BUDGET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+// returned by lorawan_time_until_tx when the frame never fits the budget
+#define LORAWAN_BUDGET_NEVER 0xFFFFFFFF
+
+typedef struct {
+    uint32_t regulatory_level;
+    uint32_t regulatory_capacity;
+    uint32_t fleet_level;
+    uint32_t fleet_capacity;
+    uint32_t mac_wait;
+} lorawan_budget_status_t;
+
+extern void     lorawan_budget_init();
+extern void     lorawan_budget_consume(uint32_t airtime);
+extern void     lorawan_budget_tx(LmHandlerTxParams_t *params);
+extern void     lorawan_budget_request(LoRaMacStatus_t status, TimerTime_t nextTxIn);
+extern bool     lorawan_budget_hold(uint8_t length);
+extern void     lorawan_budget_status(lorawan_budget_status_t *status);
+
+extern uint32_t lorawan_time_until_tx(uint8_t length);
+extern uint32_t lorawan_time_until_tx_datarate(uint8_t length, int8_t datarate);
+
+#endif /* _LORAWAN_BUDGET_H_ */
@@ -0,0 +1,100 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "lorawan_buffer.h"
+#include "lorawan_config.h"
+
+// Payload buffers for uplinks whose producer cannot keep the payload until
+// it has been sent, such as the console.  A buffer taken here is handed to
+// lorawan_send() with the transaction, which gives it back once the
+// payload has been copied out: when the MAC takes it, when it goes to the
+// journal, when a newer uplink with the same key replaces it, when the
+// confirmed transaction completes or when it is not accepted at all.
+// Buffers that do not come from here are left alone by the release.
+#define BUFFER_NONE 0xFF
+
+static uint8_t buffer_pool[LORAWAN_UPLINK_BUFFERS]
+                          [LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+static uint8_t buffer_next[LORAWAN_UPLINK_BUFFERS];
+static uint8_t buffer_free;
+static uint32_t buffer_available;
+
+void lorawan_buffer_init()
+{
+    for (int i = 0; i < LORAWAN_UPLINK_BUFFERS; i++) {
+        buffer_next[i] = (i + 1 < LORAWAN_UPLINK_BUFFERS) ? i + 1 : BUFFER_NONE;
+    }
+    buffer_free = 0;
+    buffer_available = LORAWAN_UPLINK_BUFFERS;
+}
+
+uint8_t *lorawan_buffer_alloc()
+{
+    uint8_t *buffer = NULL;
+
+    taskENTER_CRITICAL();
+    if (buffer_free != BUFFER_NONE) {
+        buffer = buffer_pool[buffer_free];
+        buffer_free = buffer_next[buffer_free];
+        buffer_available--;
+    }
+    taskEXIT_CRITICAL();
+
+    return buffer;
+}
+
+void lorawan_buffer_release(const uint8_t *buffer)
+{
+    uintptr_t offset = (uintptr_t)buffer - (uintptr_t)buffer_pool;
+    uint8_t index = offset / LORAWAN_APP_DATA_BUFFER_MAX_SIZE;
+
+    if ((offset >= sizeof(buffer_pool)) ||
+        (offset % LORAWAN_APP_DATA_BUFFER_MAX_SIZE != 0)) {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    buffer_next[index] = buffer_free;
+    buffer_free = index;
+    buffer_available++;
+    taskEXIT_CRITICAL();
+}
+
+uint32_t lorawan_buffer_available()
+{
+    return buffer_available;
+}
@@ -0,0 +1,261 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+
+#include "lorawan_class_policy.h"
+#include "lorawan_config.h"
+
+#define POLICY_EVALUATION_PERIOD 1000
+#define SECONDS_PER_DAY          86400
+#define SECONDS_PER_HOUR         3600
+
+static lorawan_power_source_t power_source = LORAWAN_DEFAULT_POWER_SOURCE;
+static volatile bool          ble_active;
+static bool                   time_synchronized;
+
+static bool        hint_active;
+static TimerTime_t hint_start;
+static uint32_t    hint_window;
+
+static TimerTime_t   last_evaluation;
+static DeviceClass_t policy_requested;
+static TimerTime_t   last_uplink;
+static DeviceClass_t class_current;
+static TimerTime_t   class_since;
+
+static lorawan_class_stats_t class_stats;
+static uint32_t              class_uplinks[3];
+
+static bool policy_time_allowed()
+{
+    SysTime_t time;
+    uint32_t hour;
+
+    // without a network time reference the schedule cannot be applied
+    if (!time_synchronized) {
+        return true;
+    }
+
+    time = SysTimeGet();
+    hour = (time.Seconds % SECONDS_PER_DAY) / SECONDS_PER_HOUR;
+
+    if (LORAWAN_CLASS_C_START_HOUR <= LORAWAN_CLASS_C_END_HOUR) {
+        return (hour >= LORAWAN_CLASS_C_START_HOUR) &&
+               (hour < LORAWAN_CLASS_C_END_HOUR);
+    }
+
+    return (hour >= LORAWAN_CLASS_C_START_HOUR) ||
+           (hour < LORAWAN_CLASS_C_END_HOUR);
+}
+
+static DeviceClass_t policy_desired_class()
+{
+    // keep the LoRa radio out of continuous receive while a BLE central is
+    // connected so that AMOTA transfers and flash writes are not competing
+    // with RX2 servicing
+    if (LORAWAN_CLASS_C_BLE_EXCLUSIVE && ble_active) {
+        return CLASS_A;
+    }
+
+    if (hint_active) {
+        if (TimerGetElapsedTime(hint_start) < hint_window) {
+            return CLASS_C;
+        }
+        hint_active = false;
+    }
+
+    if ((power_source == LORAWAN_POWER_MAINS) && policy_time_allowed()) {
+        return CLASS_C;
+    }
+
+    return CLASS_A;
+}
+
+// called from the LoRaWAN task on class changes and from the CLI task for
+// the statistics, the caller holds a critical section
+static void policy_update_residency()
+{
+    TimerTime_t now = TimerGetCurrentTime();
+
+    class_stats.residency[class_current] += now - class_since;
+    class_since = now;
+}
+
+void lorawan_class_policy_init()
+{
+    memset(&class_stats, 0, sizeof(class_stats));
+    memset(class_uplinks, 0, sizeof(class_uplinks));
+
+    class_current = CLASS_A;
+    policy_requested = LORAWAN_DEFAULT_CLASS;
+    class_since = TimerGetCurrentTime();
+    last_evaluation = class_since;
+    last_uplink = class_since;
+}
+
+void lorawan_class_policy_process()
+{
+    DeviceClass_t desired;
+
+    if (TimerGetElapsedTime(last_evaluation) < POLICY_EVALUATION_PERIOD) {
+        return;
+    }
+    last_evaluation = TimerGetCurrentTime();
+
+    if (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET) {
+        return;
+    }
+
+    // class C entered without a request from the policy belongs to a
+    // multicast session, which switches back to class A when it ends
+    if ((class_current == CLASS_C) && (policy_requested != CLASS_C)) {
+        return;
+    }
+
+    desired = policy_desired_class();
+    if (desired == LmHandlerGetCurrentClass()) {
+        return;
+    }
+
+    if (LmHandlerIsBusy() == true) {
+        return;
+    }
+
+    if (LmHandlerRequestClass(desired) == LORAMAC_HANDLER_SUCCESS) {
+        policy_requested = desired;
+    }
+}
+
+void lorawan_class_policy_class_change(DeviceClass_t deviceClass)
+{
+    taskENTER_CRITICAL();
+    policy_update_residency();
+    class_current = deviceClass;
+    class_stats.switches++;
+    taskEXIT_CRITICAL();
+}
+
+void lorawan_class_policy_tx_done()
+{
+    last_uplink = TimerGetCurrentTime();
+    class_uplinks[class_current]++;
+}
+
+void lorawan_class_policy_rx_done(LmHandlerRxParams_t *params)
+{
+    if (params->IsMcpsIndication == 0) {
+        return;
+    }
+
+    class_stats.downlinks[class_current]++;
+
+    // a class A downlink has waited on the server since at least the
+    // previous uplink, which bounds its latency from below
+    if (class_current == CLASS_A) {
+        class_stats.class_a_latency_total += TimerGetElapsedTime(last_uplink);
+    }
+}
+
+void lorawan_class_policy_time_sync(bool isSynchronized)
+{
+    time_synchronized = isSynchronized;
+}
+
+void lorawan_class_policy_set_power_source(lorawan_power_source_t source)
+{
+    power_source = source;
+}
+
+void lorawan_class_policy_hint_downlink(uint32_t window)
+{
+    hint_start = TimerGetCurrentTime();
+    hint_window = window;
+    hint_active = true;
+}
+
+void lorawan_class_policy_set_ble_active(bool active)
+{
+    ble_active = active;
+}
+
+lorawan_power_source_t lorawan_class_policy_power_source()
+{
+    return power_source;
+}
+
+void lorawan_class_policy_stats(lorawan_class_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    policy_update_residency();
+    memcpy(stats, &class_stats, sizeof(class_stats));
+    taskEXIT_CRITICAL();
+}
+
+uint32_t lorawan_class_policy_average_current(DeviceClass_t deviceClass)
+{
+    uint32_t residency;
+    uint32_t uplinks;
+    uint64_t receive_time;
+
+    taskENTER_CRITICAL();
+    policy_update_residency();
+    residency = class_stats.residency[deviceClass];
+    uplinks = class_uplinks[deviceClass];
+    taskEXIT_CRITICAL();
+
+    if (residency == 0) {
+        return 0;
+    }
+
+    // class C keeps the receiver on outside of transmissions, class A only
+    // opens RX1 and RX2 after each uplink
+    if (deviceClass == CLASS_C) {
+        receive_time = residency;
+    } else {
+        receive_time = (uint64_t)uplinks * 2 *
+                       LORAWAN_RX_WINDOW_TIME;
+        if (receive_time > residency) {
+            receive_time = residency;
+        }
+    }
+
+    return LORAWAN_SLEEP_CURRENT +
+           (uint32_t)(receive_time * LORAWAN_RADIO_RX_CURRENT / residency);
+}
@@ -0,0 +1,67 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_CLASS_POLICY_H_
+#define _LORAWAN_CLASS_POLICY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+typedef enum {
+    LORAWAN_POWER_BATTERY,
+    LORAWAN_POWER_MAINS,
+} lorawan_power_source_t;
+
+typedef struct {
+    uint32_t residency[3];
+    uint32_t downlinks[3];
+    uint32_t class_a_latency_total;
+    uint32_t switches;
+} lorawan_class_stats_t;
+
+extern void lorawan_class_policy_init();
+extern void lorawan_class_policy_process();
+extern void lorawan_class_policy_class_change(DeviceClass_t deviceClass);
+extern void lorawan_class_policy_tx_done();
+extern void lorawan_class_policy_rx_done(LmHandlerRxParams_t *params);
+extern void lorawan_class_policy_time_sync(bool isSynchronized);
+
+extern void lorawan_class_policy_set_power_source(lorawan_power_source_t source);
+extern void lorawan_class_policy_hint_downlink(uint32_t window);
+extern void lorawan_class_policy_set_ble_active(bool active);
+
+extern lorawan_power_source_t lorawan_class_policy_power_source();
+extern void lorawan_class_policy_stats(lorawan_class_stats_t *stats);
+extern uint32_t lorawan_class_policy_average_current(DeviceClass_t deviceClass);
+
+#endif /* _LORAWAN_CLASS_POLICY_H_ */
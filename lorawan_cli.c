@@ -50,9 +50,24 @@
 #include <board.h>
 #include <timer.h>
 
+#include "cli_table.h"
 #include "lorawan.h"
+#include "lorawan_bench.h"
+#include "lorawan_budget.h"
+#include "lorawan_buffer.h"
+#include "lorawan_class_policy.h"
 #include "lorawan_cli.h"
 #include "lorawan_config.h"
+#include "lorawan_confirmed.h"
+#include "lorawan_downlink.h"
+#include "lorawan_drain.h"
+#include "lorawan_fragment.h"
+#include "lorawan_frame.h"
+#include "lorawan_journal.h"
+#include "lorawan_mac_request.h"
+#include "lorawan_payload.h"
+#include "lorawan_rx_calibration.h"
+#include "lorawan_stats.h"
 #include "console_task.h"
 #include "task_message.h"
 
@@ -66,162 +81,781 @@ CLI_Command_Definition_t LoRaWANCommandDefinition = {
 
 static uint8_t upload_buffer[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
 
-static void ConvertHexString(const char *in, size_t inlen, uint8_t *out,
-                          size_t *outlen)
-{
-    size_t n = 0;
-    char cNum[3];
-    *outlen = 0;
-    while (n < inlen) {
-        switch (in[n]) {
-        case '\\':
-            n++;
-            switch (in[n]) {
-            case 'x':
-                n++;
-                memset(cNum, 0, 3);
-                memcpy(cNum, &in[n], 2);
-                n++;
-                out[*outlen] = strtol(cNum, NULL, 16);
-                break;
-            }
-            break;
-        default:
-            out[*outlen] = in[n];
-            break;
-        }
-        *outlen = *outlen + 1;
-        n++;
+static lorawan_payload_t staged_payload = {
+    .buffer = upload_buffer, .size = sizeof(upload_buffer)};
+
+static uint8_t blob_buffer[LORAWAN_BLOB_TEST_MAX];
+static volatile bool blob_busy;
+
+static bool prvLoRaWANBenchLatency(cli_writer_t *writer, const char *name,
+                                   const lorawan_bench_latency_t *latency)
+{
+    return cli_writer_printf(writer,
+                             "%s ms p50 %d, p90 %d, p99 %d, max %d\r\n", name,
+                             latency->p50, latency->p90, latency->p99,
+                             latency->max);
+}
+
+// Lines of the bench view
+#define BENCH_LINES 7
+
+// positions in the keywords of the table entries
+#define BENCH_STOP 0
+
+static bool prvLoRaWANBenchLine(cli_writer_t *writer, uint32_t line,
+                                const lorawan_bench_result_t *r)
+{
+    switch (line) {
+    case 0:
+        return cli_writer_printf(
+            writer,
+            "bench %s, %d queued, %d dequeued, %d sent, %d rejected, "
+            "%d done\r\n",
+            r->active ? "running" : "idle", r->submitted, r->dequeued, r->sent,
+            r->rejected, r->done);
+    case 1:
+        return cli_writer_printf(
+            writer, "%d bytes in %d ms, %d uplinks/h, %d bytes/h\r\n",
+            r->bytes, r->elapsed,
+            r->elapsed ? (uint32_t)((uint64_t)r->done * 3600000 / r->elapsed)
+                       : 0,
+            r->elapsed ? (uint32_t)((uint64_t)r->bytes * 3600000 / r->elapsed)
+                       : 0);
+    case 2:
+        return cli_writer_printf(
+            writer, "queue occupancy %d.%02d mean, %d max\r\n",
+            r->dequeued ? r->occupancy_total / r->dequeued : 0,
+            r->dequeued ? r->occupancy_total * 100 / r->dequeued % 100 : 0,
+            r->occupancy_max);
+    case 3:
+        return prvLoRaWANBenchLatency(writer, "queued to dequeued", &r->queue);
+    case 4:
+        return prvLoRaWANBenchLatency(writer, "dequeued to sent", &r->send);
+    case 5:
+        return prvLoRaWANBenchLatency(writer, "sent to tx done", &r->tx);
+    default:
+        return prvLoRaWANBenchLatency(writer, "queued to tx done", &r->total);
     }
 }
 
-void prvLoRaWANHelpSubCommand(char *pcWriteBuffer, size_t xWriteBufferLen,
-                                  const char *pcCommandString)
+portBASE_TYPE prvLoRaWANBenchSubCommand(cli_writer_t *writer,
+                                        const char *pcCommandString)
 {
     const char *pcParameterString;
     portBASE_TYPE xParameterStringLength;
+    lorawan_bench_config_t config;
+    lorawan_bench_result_t result;
+    uint32_t line = writer->cursor;
 
     pcParameterString =
         FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
 
     if (pcParameterString == NULL) {
-        strcat(pcWriteBuffer, "usage: lorawan [command] [<args>]\r\n");
-        strcat(pcWriteBuffer, "\r\n");
-        strcat(pcWriteBuffer, "Supported commands are:\r\n");
-        strcat(pcWriteBuffer, "  join\r\n");
-        strcat(pcWriteBuffer, "  reset\r\n");
-        strcat(pcWriteBuffer, "  send\r\n");
-        strcat(pcWriteBuffer, "\r\n");
-        strcat(
-            pcWriteBuffer,
-            "See 'lorawan help [command] for the details of each command.\r\n");
-    } else if (strncmp(pcParameterString, "join", 4) == 0) {
-        strcat(pcWriteBuffer, "usage: lorawan join\r\n");
-        strcat(pcWriteBuffer, "Join a LoRaWAN network.\r\n");
-    } else if (strncmp(pcParameterString, "reset", 5) == 0) {
-        strcat(pcWriteBuffer, "usage: lorawan reset\r\n");
-        strcat(pcWriteBuffer, "Stop and reset the LoRaMac stack.\r\n");
-    } else if (strncmp(pcParameterString, "send", 3) == 0) {
-        strcat(pcWriteBuffer, "usage: lorawan send <port> <ack> [msg]\r\n");
-        strcat(pcWriteBuffer, "\r\n");
-        strcat(pcWriteBuffer, "Where:\r\n");
-        strcat(pcWriteBuffer, "  port  is the uplink port number\r\n");
-        strcat(pcWriteBuffer,
-               "  ack   request message confirmation from the server\r\n");
-        strcat(pcWriteBuffer, "  msg   payload content\r\n");
-    }
-}
-
-void prvLoRaWANSendSubCommand(char *pcWriteBuffer, size_t xWriteBufferLen,
-                                  const char *pcCommandString)
+        lorawan_bench_result(&result);
+        while ((line < BENCH_LINES) &&
+               prvLoRaWANBenchLine(writer, line, &result)) {
+            line++;
+        }
+        writer->cursor = line;
+        return (line < BENCH_LINES) ? pdTRUE : pdFALSE;
+    } else if (cli_table_keyword() == BENCH_STOP) {
+        lorawan_bench_stop();
+        return pdFALSE;
+    }
+
+    if (FreeRTOS_CLIGetNumberOfParameters(pcCommandString) < 4) {
+        cli_writer_error(writer, "missing size or interval\r\n");
+        return pdFALSE;
+    }
+
+    config.count = atoi(pcParameterString);
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 3, &xParameterStringLength);
+    config.size = atoi(pcParameterString);
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 4, &xParameterStringLength);
+    config.interval = atoi(pcParameterString);
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 5, &xParameterStringLength);
+    config.burst = pcParameterString ? atoi(pcParameterString) : 1;
+
+    if (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET) {
+        cli_writer_error(writer, "not joined\r\n");
+    } else if (!lorawan_bench_start(&config)) {
+        cli_writer_error(writer,
+                         "bench running or more than %d uplinks "
+                         "of up to %d bytes\r\n",
+                         LORAWAN_BENCH_RECORDS,
+                         LORAWAN_APP_DATA_BUFFER_MAX_SIZE);
+    }
+
+    return pdFALSE;
+}
+
+static void prvLoRaWANBlobDone(const lorawan_blob_t *blob, bool success)
+{
+    am_util_stdio_printf("\r\nblob of %d bytes on port %d %s\r\n",
+                         blob->length, blob->port,
+                         success ? "sent" : "aborted");
+    blob_busy = false;
+}
+
+portBASE_TYPE prvLoRaWANBlobSubCommand(cli_writer_t *writer,
+                                       const char *pcCommandString)
 {
     const char *pcParameterString;
     portBASE_TYPE xParameterStringLength;
+    lorawan_blob_t blob;
 
-    LmHandlerMsgTypes_t ack = LORAMAC_HANDLER_UNCONFIRMED_MSG;
-    uint8_t port = LORAWAN_APP_PORT;
-    uint8_t argc = FreeRTOS_CLIGetNumberOfParameters(pcCommandString);
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
+    blob.port = atoi(pcParameterString);
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 3, &xParameterStringLength);
+    blob.length = atoi(pcParameterString);
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 4, &xParameterStringLength);
+    blob.redundancy = pcParameterString ? atoi(pcParameterString)
+                                        : LORAWAN_FRAG_DEFAULT_REDUNDANCY;
+    blob.buffer = blob_buffer;
+    blob.callback = prvLoRaWANBlobDone;
+    blob.context = NULL;
+
+    if ((blob.length == 0) || (blob.length > LORAWAN_BLOB_TEST_MAX)) {
+        cli_writer_error(writer, "length must be 1 to %d bytes\r\n",
+                         LORAWAN_BLOB_TEST_MAX);
+        return pdFALSE;
+    }
+
+    if (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET) {
+        cli_writer_error(writer, "not joined\r\n");
+        return pdFALSE;
+    }
+
+    // the test pattern lives in one buffer, so one blob at a time
+    if (blob_busy) {
+        cli_writer_error(writer, "blob in progress\r\n");
+        return pdFALSE;
+    }
+
+    for (uint32_t i = 0; i < blob.length; i++) {
+        blob_buffer[i] = i & 0xFF;
+    }
+
+    blob_busy = true;
+    if (!lorawan_send_blob(&blob)) {
+        blob_busy = false;
+        cli_writer_error(writer, "blob queue full\r\n");
+    }
+
+    return pdFALSE;
+}
+
+portBASE_TYPE prvLoRaWANBudgetSubCommand(cli_writer_t *writer,
+                                         const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
+    lorawan_budget_status_t status;
+    uint32_t length = 0;
+    uint32_t wait;
 
     pcParameterString =
         FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
-    if (xParameterStringLength > LORAWAN_APP_DATA_BUFFER_MAX_SIZE)
-    {
-        xParameterStringLength = LORAWAN_APP_DATA_BUFFER_MAX_SIZE;
+    if (pcParameterString != NULL) {
+        length = atoi(pcParameterString);
+    }
+    if (length > LORAWAN_APP_DATA_BUFFER_MAX_SIZE) {
+        cli_writer_error(writer, "length exceeds the payload buffer\r\n");
+        return pdFALSE;
     }
 
-    switch (argc) {
-    case 2:
-        memcpy(upload_buffer, pcParameterString, xParameterStringLength);
-        break;
-    case 3: {
-        pcParameterString = FreeRTOS_CLIGetParameter(pcCommandString, 2,
+    lorawan_budget_status(&status);
+    wait = lorawan_time_until_tx(length);
+
+    cli_writer_printf(writer,
+                      "regulatory %d/%d ms, fleet %d/%d ms, mac wait %d ms\r\n",
+                      status.regulatory_level, status.regulatory_capacity,
+                      status.fleet_level, status.fleet_capacity,
+                      status.mac_wait);
+    if (wait == LORAWAN_BUDGET_NEVER) {
+        cli_writer_printf(writer, "%d bytes exceed the budget\r\n", length);
+    } else {
+        cli_writer_printf(writer, "%d bytes in %d ms\r\n", length, wait);
+    }
+
+    return pdFALSE;
+}
+
+#define CLASS_MAINS   0
+#define CLASS_BATTERY 1
+#define CLASS_HINT    2
+
+portBASE_TYPE prvLoRaWANClassSubCommand(cli_writer_t *writer,
+                                        const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
+    lorawan_class_stats_t stats;
+
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
+
+    if (pcParameterString == NULL) {
+        lorawan_class_policy_stats(&stats);
+
+        cli_writer_printf(
+            writer, "class %c, power %s, %d switches\r\n",
+            "ABC"[LmHandlerGetCurrentClass()],
+            lorawan_class_policy_power_source() == LORAWAN_POWER_MAINS
+                ? "mains"
+                : "battery",
+            stats.switches);
+        cli_writer_printf(
+            writer, "class A: %d s, %d downlinks, >= %d ms mean wait, %d uA*\r\n",
+            stats.residency[CLASS_A] / 1000, stats.downlinks[CLASS_A],
+            stats.downlinks[CLASS_A]
+                ? stats.class_a_latency_total / stats.downlinks[CLASS_A]
+                : 0,
+            lorawan_class_policy_average_current(CLASS_A));
+        cli_writer_printf(writer, "class C: %d s, %d downlinks, %d uA*\r\n",
+                          stats.residency[CLASS_C] / 1000,
+                          stats.downlinks[CLASS_C],
+                          lorawan_class_policy_average_current(CLASS_C));
+        cli_writer_puts(writer, "* model estimate from the residency and the "
+                                "configured radio currents, not measured\r\n");
+    } else if (cli_table_keyword() == CLASS_MAINS) {
+        lorawan_class_policy_set_power_source(LORAWAN_POWER_MAINS);
+    } else if (cli_table_keyword() == CLASS_BATTERY) {
+        lorawan_class_policy_set_power_source(LORAWAN_POWER_BATTERY);
+    } else if (cli_table_keyword() == CLASS_HINT) {
+        pcParameterString = FreeRTOS_CLIGetParameter(pcCommandString, 3,
                                                      &xParameterStringLength);
         if (pcParameterString == NULL) {
-            strcat(pcWriteBuffer, "error: missing port number\r\n");
-            return;
-        } else {
-            port = atoi(pcParameterString);
+            cli_writer_error(writer, "missing hint duration\r\n");
+            return pdFALSE;
         }
+        lorawan_class_policy_hint_downlink(atoi(pcParameterString) * 1000);
+    }
 
-        pcParameterString = FreeRTOS_CLIGetParameter(pcCommandString, 3,
-                                                     &xParameterStringLength);
-        memcpy(upload_buffer, pcParameterString, xParameterStringLength);
+    return pdFALSE;
+}
+
+static bool prvLoRaWANStatsHistogram(cli_writer_t *writer, const char *name,
+                                     const uint32_t *histogram, size_t count)
+{
+    char buffer[128];
+    cli_writer_t line;
+
+    // built apart so that the histogram moves to the next page as a whole
+    cli_writer_init(&line, buffer, sizeof(buffer));
+    cli_writer_printf(&line, "%s:", name);
+    for (size_t i = 0; i < count; i++) {
+        cli_writer_printf(&line, " %d", histogram[i]);
     }
-        break;
-    case 4: {
-    pcParameterString = FreeRTOS_CLIGetParameter(pcCommandString, 2,
-                                                     &xParameterStringLength);
-        if (pcParameterString == NULL) {
-            strcat(pcWriteBuffer,
-                   "error: missing acknowledgement parameter\r\n");
-            return;
-        } else {
-            ack = atoi(pcParameterString) > 0 ? LORAMAC_HANDLER_CONFIRMED_MSG
-                                              : LORAMAC_HANDLER_UNCONFIRMED_MSG;
+    cli_writer_puts(&line, "\r\n");
+
+    return cli_writer_puts(writer, buffer);
+}
+
+// Lines of the statistics view, followed by one line per confirmed port
+#define STATS_LINES 12
+
+#define STATS_RAW   0
+#define STATS_RESET 1
+
+static bool prvLoRaWANStatsLine(cli_writer_t *writer, uint32_t line)
+{
+    lorawan_stats_t *s = &lorawan_stats;
+    lorawan_mac_request_stats_t r;
+    lorawan_rx_calibration_t rx;
+    const lorawan_confirmed_stats_t *c;
+    uint32_t saved;
+    uint32_t count;
+
+    switch (line) {
+    case 0:
+        return cli_writer_printf(
+            writer, "uplinks %d (%d failed), airtime %d ms (last %d ms)\r\n",
+            s->uplinks, s->uplink_failures, s->airtime_total, s->airtime_last);
+    case 1:
+        return cli_writer_printf(writer,
+                                 "confirmed %d, acked %d, retries %d\r\n",
+                                 s->confirmed, s->confirmed_acked,
+                                 s->confirmed_retries);
+    case 2:
+        return cli_writer_printf(writer, "duty cycle waits %d, %d ms\r\n",
+                                 s->dutycycle_waits, s->dutycycle_wait_total);
+    case 3:
+        lorawan_mac_request_stats(&r);
+        return cli_writer_printf(
+            writer, "mac requests %d, %d piggybacked, %d empty frames\r\n",
+            r.requested, r.piggybacked, r.standalone);
+    case 4:
+        return cli_writer_printf(
+            writer, "queue residency %d ms mean, %d ms max, %d coalesced\r\n",
+            s->queue_dequeued ? s->queue_residency_total / s->queue_dequeued
+                              : 0,
+            s->queue_residency_max, s->queue_coalesced);
+    case 5:
+        return prvLoRaWANStatsHistogram(writer, "datarate", s->datarate,
+                                        LORAWAN_STATS_DATARATES);
+    case 6:
+        return cli_writer_printf(writer, "downlinks %d\r\n", s->downlinks);
+    case 7:
+        lorawan_rx_calibration_status(&rx);
+        return cli_writer_printf(
+            writer,
+            "rx error %d ms (target %d), drift %d ppm, %d syncs, "
+            "%d misses, %d backoffs\r\n",
+            rx.rx_error, rx.target, rx.drift_ppm, rx.syncs, rx.misses,
+            rx.backoffs);
+    case 8:
+        saved = lorawan_rx_calibration_saving(LmHandlerGetCurrentDatarate());
+        return cli_writer_printf(writer,
+                                 "rx windows %d.%03d ms shorter per uplink\r\n",
+                                 saved / 1000, saved % 1000);
+    case 9:
+        return prvLoRaWANStatsHistogram(writer, "rssi -130:10", s->rssi,
+                                        LORAWAN_STATS_HISTOGRAM);
+    case 10:
+        return prvLoRaWANStatsHistogram(writer, "snr -20:4", s->snr,
+                                        LORAWAN_STATS_HISTOGRAM);
+    case 11:
+        return cli_writer_printf(
+            writer,
+            "confirmed outstanding %d, ack rate %d%%, budget %d attempts\r\n",
+            lorawan_confirmed_outstanding(), lorawan_confirmed_ack_rate(),
+            lorawan_confirmed_budget());
+    }
+
+    c = lorawan_confirmed_stats(&count);
+    line -= STATS_LINES;
+    if (line >= count) {
+        return true;
+    }
+
+    return cli_writer_printf(writer,
+                             "port %d: %d acked, %d lost (%d%%), %d attempts, "
+                             "latency %d ms mean, %d ms max\r\n",
+                             c[line].port, c[line].acked, c[line].lost,
+                             c[line].lost * 100 / c[line].messages,
+                             c[line].attempts,
+                             c[line].acked
+                                 ? c[line].latency_total / c[line].acked
+                                 : 0,
+                             c[line].latency_max);
+}
+
+// The raw block is written 16 bytes at a time, the cursor is one past the
+// offset reached once the header is out
+static portBASE_TYPE prvLoRaWANStatsRaw(cli_writer_t *writer)
+{
+    const uint8_t *raw = (const uint8_t *)&lorawan_stats;
+    char buffer[2 * 16 + 3];
+    uint32_t offset;
+
+    // version and size followed by the little-endian statistics block
+    if (writer->cursor == 0) {
+        if (!cli_writer_printf(writer, "%02X%02X", LORAWAN_STATS_VERSION,
+                               sizeof(lorawan_stats_t))) {
+            return pdTRUE;
         }
+        writer->cursor = 1;
     }
-        break;
+
+    for (offset = writer->cursor - 1; offset < sizeof(lorawan_stats_t);
+         offset += 16) {
+        char *p = buffer;
+
+        for (uint32_t i = offset;
+             (i < offset + 16) && (i < sizeof(lorawan_stats_t)); i++) {
+            *p++ = "0123456789ABCDEF"[raw[i] >> 4];
+            *p++ = "0123456789ABCDEF"[raw[i] & 0x0F];
+        }
+        strcpy(p, (offset + 16 >= sizeof(lorawan_stats_t)) ? "\r\n" : "");
+
+        if (!cli_writer_puts(writer, buffer)) {
+            writer->cursor = offset + 1;
+            return pdTRUE;
+        }
     }
 
-    size_t length;
-    ConvertHexString(pcParameterString, xParameterStringLength, upload_buffer,
-                  &length);
+    return pdFALSE;
+}
 
-    lorawan_transaction_t transaction;
-    transaction.message_type = ack;
-    transaction.length = length;
-    transaction.buffer = upload_buffer;
-    transaction.port = port;
+portBASE_TYPE prvLoRaWANStatsSubCommand(cli_writer_t *writer,
+                                        const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
+    uint32_t line = writer->cursor;
+    uint32_t count;
 
-    lorawan_send(&transaction);
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
+
+    if (pcParameterString == NULL) {
+        lorawan_confirmed_stats(&count);
+        while ((line < STATS_LINES + count) &&
+               prvLoRaWANStatsLine(writer, line)) {
+            line++;
+        }
+        writer->cursor = line;
+        return (line < STATS_LINES + count) ? pdTRUE : pdFALSE;
+    } else if (cli_table_keyword() == STATS_RAW) {
+        return prvLoRaWANStatsRaw(writer);
+    } else if (cli_table_keyword() == STATS_RESET) {
+        lorawan_stats_reset();
+        lorawan_confirmed_stats_reset();
+    }
+
+    return pdFALSE;
 }
 
-portBASE_TYPE prvLoRaWANCommand(char *pcWriteBuffer, size_t xWriteBufferLen,
-                                    const char *pcCommandString)
+portBASE_TYPE prvLoRaWANDownlinkSubCommand(cli_writer_t *writer,
+                                           const char *pcCommandString)
+{
+    lorawan_downlink_status_t status;
+    const uint8_t *data;
+    uint32_t length;
+    uint8_t session;
+
+    lorawan_downlink_status(&status);
+
+    if (status.active) {
+        cli_writer_printf(writer,
+                          "session %d, %d bytes, %d/%d chunks, "
+                          "%d status requests\r\n",
+                          status.session, status.length, status.received,
+                          status.chunks, status.requests);
+    } else {
+        cli_writer_puts(writer, "no session in progress\r\n");
+    }
+
+    if (lorawan_downlink_blob(&data, &length, &session)) {
+        cli_writer_printf(writer, "committed session %d, %d bytes:", session,
+                          length);
+        for (uint32_t i = 0; (i < 16) && (i < length); i++) {
+            cli_writer_printf(writer, " %02x", data[i]);
+        }
+        cli_writer_puts(writer, (length > 16) ? " ...\r\n" : "\r\n");
+    }
+
+    return pdFALSE;
+}
+
+#define DRAIN_ON 0
+
+portBASE_TYPE prvLoRaWANDrainSubCommand(cli_writer_t *writer,
+                                        const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
+    lorawan_drain_stats_t stats;
+
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
+
+    if (pcParameterString == NULL) {
+        lorawan_drain_stats(&stats);
+
+        cli_writer_printf(writer,
+                          "drain %s, %d frame pending, %d immediate, "
+                          "%d retried, %d piggybacked\r\n",
+                          lorawan_drain_enabled() ? "on" : "off",
+                          stats.frame_pending, stats.immediate, stats.retried,
+                          stats.piggybacked);
+        cli_writer_printf(writer,
+                          "%d bursts, %d downlinks, %d ms mean burst\r\n",
+                          stats.bursts, stats.burst_downlinks,
+                          stats.bursts ? stats.burst_time / stats.bursts : 0);
+        cli_writer_printf(writer, "last burst %d downlinks in %d ms\r\n",
+                          stats.last_downlinks, stats.last_time);
+    } else {
+        lorawan_drain_enable(cli_table_keyword() == DRAIN_ON);
+    }
+
+    return pdFALSE;
+}
+
+portBASE_TYPE prvLoRaWANFrameSubCommand(cli_writer_t *writer,
+                                        const char *pcCommandString)
+{
+    lorawan_frame_stats_t stats;
+
+    if (lorawan_frame_active()) {
+        cli_writer_error(writer, "already in frame mode\r\n");
+        return pdFALSE;
+    }
+
+    lorawan_frame_run();
+
+    lorawan_frame_stats(&stats);
+    cli_writer_printf(writer, "%d frames, %d bytes, %d errors, %d uplinks\r\n",
+                      stats.frames, stats.bytes, stats.errors, stats.uplinks);
+
+    return pdFALSE;
+}
+
+portBASE_TYPE prvLoRaWANJournalSubCommand(cli_writer_t *writer,
+                                          const char *pcCommandString)
+{
+    lorawan_journal_status_t status;
+    lorawan_journal_stats_t stats;
+
+    lorawan_journal_status(&status);
+    lorawan_journal_stats(&stats);
+
+    cli_writer_printf(writer,
+                      "write %d:%d, read %d:%d, %d bytes staged, %s\r\n",
+                      status.write_page, status.write_offset, status.read_page,
+                      status.read_offset, status.staged,
+                      status.backlog ? "draining" : "idle");
+    cli_writer_printf(writer,
+                      "%d appended, %d sent, %d dropped, %d pages lost, "
+                      "%d corrupt\r\n",
+                      stats.appended, stats.sent, stats.dropped,
+                      stats.pages_lost, stats.corrupt);
+
+    return pdFALSE;
+}
+
+static void prvLoRaWANSendComplete(const lorawan_transaction_t *transaction,
+                                   bool acked)
+{
+    am_util_stdio_printf("\r\nuplink %d on port %d %s after %d ms\r\n",
+                         transaction->id, transaction->port,
+                         acked ? "acked" : "lost",
+                         TimerGetElapsedTime(transaction->timestamp));
+}
+
+#define REQUEST_LINK_CHECK 0
+
+portBASE_TYPE prvLoRaWANRequestSubCommand(cli_writer_t *writer,
+                                          const char *pcCommandString)
 {
     const char *pcParameterString;
     portBASE_TYPE xParameterStringLength;
+    uint32_t request;
+    uint32_t deadline = LORAWAN_MAC_REQUEST_DEADLINE;
+
+    request = (cli_table_keyword() == REQUEST_LINK_CHECK)
+                  ? LORAWAN_MAC_REQUEST_LINK_CHECK
+                  : LORAWAN_MAC_REQUEST_DEVICE_TIME;
+
+    pcParameterString =
+        FreeRTOS_CLIGetParameter(pcCommandString, 3, &xParameterStringLength);
+    if (pcParameterString != NULL) {
+        deadline = atoi(pcParameterString) * 1000;
+    }
+
+    lorawan_mac_request(request, deadline);
+
+    return pdFALSE;
+}
 
-    pcWriteBuffer[0] = 0x0;
+portBASE_TYPE prvLoRaWANChunkSubCommand(cli_writer_t *writer,
+                                        const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
 
     pcParameterString =
-        FreeRTOS_CLIGetParameter(pcCommandString, 1, &xParameterStringLength);
+        FreeRTOS_CLIGetParameter(pcCommandString, 2, &xParameterStringLength);
     if (pcParameterString == NULL) {
+        cli_writer_error(writer, "missing payload chunk\r\n");
+        return pdFALSE;
+    }
+
+    if (!lorawan_payload_decode(&staged_payload, pcParameterString,
+                                xParameterStringLength)) {
+        lorawan_payload_init(&staged_payload, upload_buffer,
+                             sizeof(upload_buffer));
+        cli_writer_error(writer, "invalid payload, chunks dropped\r\n");
+        return pdFALSE;
+    }
+
+    cli_writer_printf(writer, "%d bytes staged\r\n", staged_payload.length);
+
+    return pdFALSE;
+}
+
+portBASE_TYPE prvLoRaWANSendSubCommand(cli_writer_t *writer,
+                                       const char *pcCommandString)
+{
+    const char *pcParameterString;
+    portBASE_TYPE xParameterStringLength;
+
+    LmHandlerMsgTypes_t ack = LORAMAC_HANDLER_UNCONFIRMED_MSG;
+    uint8_t port = LORAWAN_APP_PORT;
+    uint8_t argc = FreeRTOS_CLIGetNumberOfParameters(pcCommandString);
+    uint8_t *buffer;
+    uint32_t length;
+    bool valid;
+
+    // send <msg> | send <port> <ack> [msg]
+    if (argc >= 3) {
+        pcParameterString = FreeRTOS_CLIGetParameter(pcCommandString, 2,
+                                                     &xParameterStringLength);
+        port = atoi(pcParameterString);
+        pcParameterString = FreeRTOS_CLIGetParameter(pcCommandString, 3,
+                                                     &xParameterStringLength);
+        ack = atoi(pcParameterString) > 0 ? LORAMAC_HANDLER_CONFIRMED_MSG
+                                          : LORAMAC_HANDLER_UNCONFIRMED_MSG;
+    }
+
+    pcParameterString = NULL;
+    if ((argc == 2) || (argc >= 4)) {
+        pcParameterString = FreeRTOS_CLIGetParameter(
+            pcCommandString, (argc == 2) ? 2 : 4, &xParameterStringLength);
+    }
+
+    if (pcParameterString != NULL) {
+        lorawan_payload_init(&staged_payload, upload_buffer,
+                             sizeof(upload_buffer));
+        lorawan_payload_decode(&staged_payload, pcParameterString,
+                               xParameterStringLength);
+    } else if ((argc < 3) || (staged_payload.length == 0)) {
+        cli_writer_error(writer, "missing payload\r\n");
+        return pdFALSE;
+    }
+
+    valid = lorawan_payload_finish(&staged_payload);
+    length = staged_payload.length;
+    lorawan_payload_init(&staged_payload, upload_buffer,
+                         sizeof(upload_buffer));
+    if (!valid) {
+        cli_writer_error(writer, "invalid payload\r\n");
         return pdFALSE;
     }
 
-    if (strncmp(pcParameterString, "help", xParameterStringLength) == 0) {
-        prvLoRaWANHelpSubCommand(pcWriteBuffer, xWriteBufferLen,
-                                     pcCommandString);
-    } else if (strncmp(pcParameterString, "join", xParameterStringLength) ==
-               0) {
-        lorawan_join();
-    } else if (strncmp(pcParameterString, "reset", xParameterStringLength) == 0) {
-        LoRaMacStop();
-    } else if (strncmp(pcParameterString, "send", xParameterStringLength) ==
-               0) {
-        prvLoRaWANSendSubCommand(pcWriteBuffer, xWriteBufferLen,
-                                     pcCommandString);
+    // the staging buffer is reused by the next send or chunk, the uplink
+    // keeps its own copy until it leaves the stack
+    buffer = lorawan_buffer_alloc();
+    if (buffer == NULL) {
+        cli_writer_error(writer, "no uplink buffer free\r\n");
+        return pdFALSE;
     }
+    memcpy(buffer, upload_buffer, length);
+
+    lorawan_transaction_t transaction;
+    transaction.message_type = ack;
+    transaction.length = length;
+    transaction.buffer = buffer;
+    transaction.port = port;
+    transaction.key = LORAWAN_KEY_NONE;
+    transaction.callback = prvLoRaWANSendComplete;
+    transaction.context = NULL;
+
+    uint32_t id = lorawan_send(&transaction);
+    if (id == 0) {
+        cli_writer_error(writer, "confirmed queue full\r\n");
+    } else if (ack == LORAMAC_HANDLER_CONFIRMED_MSG) {
+        cli_writer_printf(writer, "uplink %d queued\r\n", id);
+    }
+
+    return pdFALSE;
+}
+
+portBASE_TYPE prvLoRaWANJoinSubCommand(cli_writer_t *writer,
+                                       const char *pcCommandString)
+{
+    lorawan_join();
+
+    return pdFALSE;
+}
+
+portBASE_TYPE prvLoRaWANResetSubCommand(cli_writer_t *writer,
+                                        const char *pcCommandString)
+{
+    LoRaMacStop();
+
     return pdFALSE;
 }
+
+// Sorted by name
+static const cli_subcommand_t LoRaWANSubCommands[] = {
+    {"bench", "[<count> <size> <interval> [burst]|stop]",
+     "Queue <count> uplinks of <size> bytes on the bench port,\r\n"
+     "[burst] of them every <interval> ms.  Without arguments,\r\n"
+     "show the throughput, the transmit queue occupancy and the\r\n"
+     "latency percentiles from queueing to the MAC confirm.\r\n",
+     0, 4, prvLoRaWANBenchSubCommand, "stop|#"},
+    {"blob", "<port> <length> [redundancy]",
+     "Send <length> bytes of test pattern on <port> as coded\r\n"
+     "fragments with [redundancy] percent extra fragments.\r\n",
+     2, 3, prvLoRaWANBlobSubCommand},
+    {"budget", "[length]",
+     "Show the regulatory and fleet airtime budgets and the\r\n"
+     "time until an uplink of [length] bytes may be sent.\r\n",
+     0, 1, prvLoRaWANBudgetSubCommand},
+    {"chunk", "<msg>",
+     "Append to the payload sent by the next 'lorawan send'\r\n"
+     "without a message.  Escapes and base64 quanta may span\r\n"
+     "chunks.\r\n",
+     1, 1, prvLoRaWANChunkSubCommand},
+    {"class", "[mains|battery|hint <seconds>]",
+     "Without arguments, show the class policy state,\r\n"
+     "residency, downlinks and the average current estimated\r\n"
+     "from a model, not measured.\r\n"
+     "  mains    allow class C on mains power\r\n"
+     "  battery  stay in class A\r\n"
+     "  hint     expect downlinks for <seconds>\r\n",
+     0, 2, prvLoRaWANClassSubCommand, "mains|battery|hint"},
+    {"downlink", NULL,
+     "Show the multi-frame downlink in progress and the first\r\n"
+     "bytes of the last payload committed to flash.\r\n",
+     0, 0, prvLoRaWANDownlinkSubCommand},
+    {"drain", "[on|off]",
+     "Without arguments, show how downlink bursts signalled\r\n"
+     "with FPending were delivered.\r\n"
+     "  on   retry empty uplinks the MAC rejects\r\n"
+     "  off  wait for the next application uplink\r\n",
+     0, 1, prvLoRaWANDrainSubCommand, "on|off"},
+    {"frame", NULL,
+     "Switch the console to COBS framed binary messages for\r\n"
+     "send, stats and config until the host sends exit.\r\n"
+     "See tools/lorawan_frame.py.\r\n",
+     0, 0, prvLoRaWANFrameSubCommand},
+    {"join", NULL, "Join a LoRaWAN network.\r\n", 0, 0,
+     prvLoRaWANJoinSubCommand},
+    {"journal", NULL,
+     "Show the store-and-forward journal of uplinks kept in\r\n"
+     "flash while the device is not joined or the queue is full.\r\n",
+     0, 0, prvLoRaWANJournalSubCommand},
+    {"request", "<linkcheck|time> [seconds]",
+     "Queue a MAC request on the next uplink.  An empty\r\n"
+     "frame is sent if no uplink goes out within [seconds].\r\n"
+     "  linkcheck  link margin and gateway count\r\n"
+     "  time       network time\r\n",
+     1, 2, prvLoRaWANRequestSubCommand, "linkcheck|time"},
+    {"reset", NULL, "Stop and reset the LoRaMac stack.\r\n", 0, 0,
+     prvLoRaWANResetSubCommand},
+    {"send", "<port> <ack> [msg]",
+     "Where:\r\n"
+     "  port  is the uplink port number\r\n"
+     "  ack   request message confirmation from the server\r\n"
+     "  msg   payload content, text with \\xNN escapes,\r\n"
+     "        hex:<hex> or b64:<base64>, the chunks\r\n"
+     "        staged with 'lorawan chunk' if omitted\r\n"
+     "'lorawan send <msg>' sends on the default port.\r\n",
+     1, 3, prvLoRaWANSendSubCommand},
+    {"stats", "[raw|reset]",
+     "Show airtime, datarate, retry and link quality statistics,\r\n"
+     "the receive window calibration and the ack latency and\r\n"
+     "loss of confirmed uplinks per port.\r\n"
+     "  raw    dump the statistics block in hex\r\n"
+     "  reset  clear the statistics\r\n",
+     0, 1, prvLoRaWANStatsSubCommand, "raw|reset"},
+};
+
+const cli_table_t LoRaWANCommandTable =
+    CLI_TABLE("lorawan", LoRaWANSubCommands);
+
+portBASE_TYPE prvLoRaWANCommand(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                    const char *pcCommandString)
+{
+    return cli_table_dispatch(&LoRaWANCommandTable, pcWriteBuffer,
+                              xWriteBufferLen, pcCommandString);
+}
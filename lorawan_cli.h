@@ -35,6 +35,9 @@
 #include <FreeRTOS.h>
 #include <FreeRTOS_CLI.h>
 
+#include "cli_table.h"
+
 extern CLI_Command_Definition_t LoRaWANCommandDefinition;
+extern const cli_table_t LoRaWANCommandTable;
 
 #endif /* _LORAWAN_CLI_H_ */
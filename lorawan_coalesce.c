@@ -0,0 +1,118 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "lorawan.h"
+#include "lorawan_buffer.h"
+#include "lorawan_coalesce.h"
+#include "lorawan_config.h"
+#include "lorawan_stats.h"
+
+// The transmit queue only holds a placeholder for a keyed uplink, the
+// latest transaction with that key lives in its slot here.  A newer
+// uplink with the same key overwrites the slot and so keeps the position
+// of the queued one.  The placeholder is resolved to the slot contents
+// when it reaches the head of the queue.
+
+typedef struct {
+    bool                  queued;
+    lorawan_transaction_t transaction;
+} coalesce_slot_t;
+
+static coalesce_slot_t coalesce_slots[LORAWAN_COALESCE_KEYS];
+
+static bool coalesce_keyed(const lorawan_transaction_t *transaction)
+{
+    return (transaction->message_type == LORAMAC_HANDLER_UNCONFIRMED_MSG) &&
+           (transaction->key != LORAWAN_KEY_NONE) &&
+           (transaction->key <= LORAWAN_COALESCE_KEYS);
+}
+
+void lorawan_coalesce_init()
+{
+    memset(coalesce_slots, 0, sizeof(coalesce_slots));
+}
+
+// Returns true when the transaction replaced a queued one.  Otherwise the
+// caller queues the transaction as the placeholder of its key, or takes
+// the slot back with lorawan_coalesce_resolve() if that fails.
+bool lorawan_coalesce_submit(const lorawan_transaction_t *transaction)
+{
+    coalesce_slot_t *slot;
+    const uint8_t *previous;
+    bool replaced;
+
+    if (!coalesce_keyed(transaction)) {
+        return false;
+    }
+
+    slot = &coalesce_slots[transaction->key - 1];
+
+    taskENTER_CRITICAL();
+    replaced = slot->queued;
+    previous = slot->transaction.buffer;
+    slot->queued = true;
+    memcpy(&slot->transaction, transaction, sizeof(lorawan_transaction_t));
+    taskEXIT_CRITICAL();
+
+    if (replaced) {
+        lorawan_stats_coalesced();
+        if (previous != transaction->buffer) {
+            lorawan_buffer_release(previous);
+        }
+    }
+
+    return replaced;
+}
+
+void lorawan_coalesce_resolve(lorawan_transaction_t *transaction, bool take)
+{
+    coalesce_slot_t *slot;
+
+    if (!coalesce_keyed(transaction)) {
+        return;
+    }
+
+    slot = &coalesce_slots[transaction->key - 1];
+
+    taskENTER_CRITICAL();
+    memcpy(transaction, &slot->transaction, sizeof(lorawan_transaction_t));
+    if (take) {
+        slot->queued = false;
+    }
+    taskEXIT_CRITICAL();
+}
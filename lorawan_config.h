@@ -18,4 +18,164 @@
 #define APP_TX_DUTYCYCLE                    5000
 #define APP_TX_DUTYCYCLE_RND                1000
 
+// The LoRaWAN task blocks between passes until the MAC, its timers, the
+// radio or a new uplink wakes it, or a module deadline is due, and at
+// most for this time in ms to look at the deadlines it is not told about.
+#define LORAWAN_TASK_POLL                   1000
+
+#define LORAWAN_JOIN_BACKOFF_MIN            8000
+#define LORAWAN_JOIN_BACKOFF_MAX            3600000
+#define LORAWAN_JOIN_TIME_ON_AIR            371
+#define LORAWAN_JOIN_SUBBAND_ATTEMPTS       2
+#define LORAWAN_JOIN_DEFAULT_SUBBAND        1
+
+// Confirmed uplinks: messages outstanding at once, ports with statistics,
+// delivery target in percent used to size the retry budget, attempts
+// limit and base back-off between attempts in ms.  Submitting waits at
+// most the submit timeout in ms for room in the queue, an attempt whose
+// confirm has not come by the margin in ms after its RX2 window failed.
+#define LORAWAN_CONFIRMED_WINDOW            4
+#define LORAWAN_CONFIRMED_PORTS             8
+#define LORAWAN_CONFIRMED_TARGET            99
+#define LORAWAN_CONFIRMED_MAX_ATTEMPTS      8
+#define LORAWAN_CONFIRMED_RETRY_DELAY       3000
+#define LORAWAN_CONFIRMED_SUBMIT_TIMEOUT    100
+#define LORAWAN_CONFIRMED_CONFIRM_MARGIN    1000
+
+// Unconfirmed uplinks tagged with a key from 1 to LORAWAN_COALESCE_KEYS
+// replace the queued uplink with the same key instead of being appended.
+#define LORAWAN_COALESCE_KEYS               8
+
+// Console UART module and its ring sizes in bytes (powers of two).  Text
+// printed while the transmit ring is full is dropped and counted instead
+// of blocking the printing task.
+#define LORAWAN_CONSOLE_UART                0
+#define LORAWAN_CONSOLE_TX_RING             2048
+#define LORAWAN_CONSOLE_RX_RING             512
+#define LORAWAN_CONSOLE_LINE                256
+
+// Lines collected by the console between "batch begin" and "batch end",
+// in bytes including the separators.
+#define LORAWAN_CONSOLE_BATCH               1024
+
+// Payload buffers for uplinks from the console and the binary framing,
+// see lorawan_buffer.c.  Each is held until its uplink leaves the stack,
+// sends fail once all are taken.
+#define LORAWAN_UPLINK_BUFFERS              24
+
+// Binary console framing.  A batch frame replies with the output of all
+// its commands, up to LORAWAN_FRAME_BATCH_REPLY bytes.
+#define LORAWAN_FRAME_BATCH_REPLY           512
+
+// Tokenized logging.  The LoRaWAN callbacks and the BLE task write a
+// format ID and the raw arguments to a ring of LORAWAN_TOKEN_LOG_WORDS
+// words (a power of two) instead of printing, "log dump" reads it out and
+// tools/token_log.py rebuilds the text from the ELF.  0 prints with the
+// LoRaMac-node Display functions.
+#define LORAWAN_TOKEN_LOG                   1
+#define LORAWAN_TOKEN_LOG_WORDS             512
+
+// Uplink benchmark ("lorawan bench"): port, most uplinks per run and the
+// time in ms after the last one was queued until the run is given up.
+#define LORAWAN_BENCH_PORT                  220
+#define LORAWAN_BENCH_RECORDS               64
+#define LORAWAN_BENCH_TIMEOUT               600000
+
+// MAC requests wait for an application uplink to piggyback on, deadlines
+// in ms after which an empty frame is sent instead.
+#define LORAWAN_MAC_REQUEST_DEADLINE        60000
+#define LORAWAN_MAC_REQUEST_RETRY           1000
+#define LORAWAN_CLASS_ANNOUNCE_DEADLINE     30000
+
+// Airtime budget.  The regulatory duty cycle in permille applies when
+// LORAWAN_DUTYCYCLE_ON is set, the fleet policy allows the given airtime
+// in ms per period with bursts of up to LORAWAN_BUDGET_FLEET_BURST ms.
+#define LORAWAN_BUDGET_REGULATORY_DUTY      10
+#define LORAWAN_BUDGET_FLEET_AIRTIME        30000
+#define LORAWAN_BUDGET_FLEET_PERIOD         86400000
+#define LORAWAN_BUDGET_FLEET_BURST          10000
+
+#define LORAWAN_FRAG_MAX_NB                 1024
+#define LORAWAN_FRAG_DEFAULT_REDUNDANCY     20
+#define LORAWAN_BLOB_TEST_MAX               2048
+
+#define LORAWAN_DEFAULT_POWER_SOURCE        LORAWAN_POWER_BATTERY
+#define LORAWAN_CLASS_C_START_HOUR          0
+#define LORAWAN_CLASS_C_END_HOUR            24
+#define LORAWAN_CLASS_C_BLE_EXCLUSIVE       1
+
+// WSF buffer pools.  "make BLE_BUF_RECORD=1" builds with the pools of ble.c
+// doubled and records the buffers in use by request size, "amota buffers
+// recommend" then prints the pool table that serves the recorded workload
+// in the least memory with BLE_BUF_HEADROOM spare buffers per pool.
+#ifndef BLE_BUF_RECORD
+#define BLE_BUF_RECORD                      0
+#endif
+#define BLE_BUF_HEADROOM                    1
+
+// Current estimates in uA and receive window length in ms used to report
+// the average current of each device class.
+#define LORAWAN_SLEEP_CURRENT               3
+#define LORAWAN_RADIO_RX_CURRENT            4600
+#define LORAWAN_RX_WINDOW_TIME              50
+
+// Current estimates in uA of the MCU running at 48 MHz and in normal sleep
+// used with LORAWAN_SLEEP_CURRENT for deep sleep by "console idle".
+#define IDLE_ACTIVE_CURRENT                 300
+#define IDLE_SLEEP_CURRENT                  100
+
+// Receive window calibration.  The max RX error in ms is kept between the
+// limits below and derived from the clock drift over the longest receive
+// delay (join accept RX2).  DeviceTime is requested every sync interval
+// until the drift is known and every resync interval after that; misses
+// in a row double the error, received downlinks bring it back down.
+#define LORAWAN_RX_ERROR_MAX                20
+#define LORAWAN_RX_ERROR_MIN                4
+#define LORAWAN_RX_ERROR_HORIZON            6000
+#define LORAWAN_RX_MIN_SYMBOLS              6
+#define LORAWAN_RX_CAL_SYNC_INTERVAL        3600000
+#define LORAWAN_RX_CAL_RESYNC_INTERVAL      86400000
+#define LORAWAN_RX_CAL_REQUEST_DEADLINE     600000
+#define LORAWAN_RX_CAL_MISSES               2
+#define LORAWAN_RX_CAL_RECOVERY             8
+
+// Frame pending draining.  Empty uplinks the MAC rejects after a downlink
+// with FPending set are retried once the duty cycle allows, or after the
+// retry time in ms if the MAC gives none.
+#define LORAWAN_DRAIN_ENABLE                1
+#define LORAWAN_DRAIN_RETRY                 1000
+
+#define LORAWAN_FUOTA_REBOOT_DELAY          10000
+
+// Persistent storage pages at the top of the internal flash.  These and
+// the areas below down to LORAWAN_FLASH_RESERVED_ADDRESS are excluded from
+// the OTA storage area in amota_profile_config.h.
+#define LORAWAN_NVM_FLASH_ADDRESS           0x000FE000
+#define LORAWAN_JOIN_NVM_ADDRESS            LORAWAN_NVM_FLASH_ADDRESS
+
+// Store-and-forward journal for uplinks that cannot be queued, flash pages
+// right below the persistent storage, RAM staging in bytes (a power of two)
+// and consumed records skipped per task iteration.
+#define LORAWAN_JOURNAL_PAGES               4
+#define LORAWAN_JOURNAL_FLASH_ADDRESS \
+    (LORAWAN_NVM_FLASH_ADDRESS - LORAWAN_JOURNAL_PAGES * AM_HAL_FLASH_PAGE_SIZE)
+#define LORAWAN_JOURNAL_STAGING             1024
+#define LORAWAN_JOURNAL_SCAN_LIMIT          32
+
+// Downlink sessions reassemble multi-frame payloads received on their own
+// port into two flash slots below the journal, a new payload replaces the
+// committed one only once complete and verified.  Missing chunks are
+// requested after a quiet time in ms, at most LORAWAN_DOWNLINK_REQUESTS
+// times in a row.
+#define LORAWAN_DOWNLINK_PORT               199
+#define LORAWAN_DOWNLINK_SLOT_PAGES         2
+#define LORAWAN_DOWNLINK_FLASH_ADDRESS \
+    (LORAWAN_JOURNAL_FLASH_ADDRESS - \
+     2 * LORAWAN_DOWNLINK_SLOT_PAGES * AM_HAL_FLASH_PAGE_SIZE)
+#define LORAWAN_DOWNLINK_QUIET              10000
+#define LORAWAN_DOWNLINK_REQUESTS           8
+
+// lowest address of the flash used by the LoRaWAN modules
+#define LORAWAN_FLASH_RESERVED_ADDRESS      LORAWAN_DOWNLINK_FLASH_ADDRESS
+
 #endif
@@ -0,0 +1,342 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+#include <utilities.h>
+
+#include "lorawan.h"
+#include "lorawan_airtime.h"
+#include "lorawan_budget.h"
+#include "lorawan_buffer.h"
+#include "lorawan_config.h"
+#include "lorawan_confirmed.h"
+#include "lorawan_mac_request.h"
+#include "lorawan_stats.h"
+
+// Confirmed uplinks are sent one attempt at a time.  Between attempts the
+// MAC is free for unconfirmed traffic, and the number of attempts given to
+// each message follows the measured ack rate so that the probability of
+// delivering it stays at LORAWAN_CONFIRMED_TARGET percent.
+//
+// The ack rate is an exponential moving average in 1/256 units.
+#define ACK_RATE_SCALE   256
+#define ACK_RATE_SHIFT   3
+#define ACK_RATE_INITIAL 192
+
+typedef struct {
+    lorawan_transaction_t transaction;
+    bool                  used;
+    uint8_t               attempts;
+    uint8_t               budget;
+    TimerTime_t           due;
+} confirmed_entry_t;
+
+static QueueHandle_t lorawan_confirmed_queue;
+
+static confirmed_entry_t confirmed_window[LORAWAN_CONFIRMED_WINDOW];
+static confirmed_entry_t *confirmed_in_flight;
+static TimerTime_t confirmed_in_flight_deadline;
+static bool confirmed_yield;
+static uint32_t confirmed_ack_rate;
+
+static lorawan_confirmed_stats_t confirmed_stats[LORAWAN_CONFIRMED_PORTS];
+
+static lorawan_confirmed_stats_t *confirmed_port_stats(uint8_t port)
+{
+    for (int i = 0; i < LORAWAN_CONFIRMED_PORTS; i++) {
+        if (confirmed_stats[i].messages == 0) {
+            confirmed_stats[i].port = port;
+        }
+        if (confirmed_stats[i].port == port) {
+            return &confirmed_stats[i];
+        }
+    }
+
+    return NULL;
+}
+
+// smallest number of attempts for which all of them failing is less likely
+// than the delivery target allows
+static uint8_t confirmed_attempt_budget()
+{
+    uint32_t miss = ACK_RATE_SCALE - confirmed_ack_rate;
+    uint32_t fail = 65536;
+    uint32_t limit = 65536 * (100 - LORAWAN_CONFIRMED_TARGET) / 100;
+    uint8_t budget = 0;
+
+    do {
+        fail = fail * miss / ACK_RATE_SCALE;
+        budget++;
+    } while ((fail > limit) && (budget < LORAWAN_CONFIRMED_MAX_ATTEMPTS));
+
+    return budget;
+}
+
+static void confirmed_complete(confirmed_entry_t *entry, bool acked)
+{
+    lorawan_confirmed_stats_t *stats = confirmed_port_stats(entry->transaction.port);
+    uint32_t latency = TimerGetElapsedTime(entry->transaction.timestamp);
+
+    if (stats != NULL) {
+        stats->messages++;
+        stats->attempts += entry->attempts;
+        if (acked) {
+            stats->acked++;
+            stats->latency_total += latency;
+            if (latency > stats->latency_max) {
+                stats->latency_max = latency;
+            }
+        } else {
+            stats->lost++;
+        }
+    }
+
+    entry->used = false;
+    if (entry->transaction.callback != NULL) {
+        entry->transaction.callback(&entry->transaction, acked);
+    }
+    lorawan_buffer_release(entry->transaction.buffer);
+}
+
+static void confirmed_attempt_done(confirmed_entry_t *entry, bool acked)
+{
+    if (acked) {
+        confirmed_complete(entry, true);
+    } else if (entry->attempts >= entry->budget) {
+        confirmed_complete(entry, false);
+    } else {
+        // randomized back-off, doubled on every failed attempt
+        uint32_t delay = LORAWAN_CONFIRMED_RETRY_DELAY << (entry->attempts - 1);
+
+        entry->due = TimerGetCurrentTime() + delay / 2 + randr(0, delay / 2);
+    }
+}
+
+// The MCPS confirm is due once the RX2 window of the attempt has closed.
+// It never comes if the MAC is stopped meanwhile, e.g. by lorawan reset.
+static TimerTime_t confirmed_deadline(uint32_t length)
+{
+    MibRequestConfirm_t mibReq;
+    uint32_t rx2_delay = 2000;
+
+    mibReq.Type = MIB_RECEIVE_DELAY_2;
+    if (LoRaMacMibGetRequestConfirm(&mibReq) == LORAMAC_STATUS_OK) {
+        rx2_delay = mibReq.Param.ReceiveDelay2;
+    }
+
+    return TimerGetCurrentTime() +
+           lorawan_time_on_air(LmHandlerGetCurrentDatarate(), length) +
+           rx2_delay + LORAWAN_RX_WINDOW_TIME + LORAWAN_CONFIRMED_CONFIRM_MARGIN;
+}
+
+void lorawan_confirmed_init()
+{
+    lorawan_confirmed_queue = xQueueCreate(10, sizeof(lorawan_transaction_t));
+
+    memset(confirmed_window, 0, sizeof(confirmed_window));
+    confirmed_in_flight = NULL;
+    confirmed_yield = false;
+    confirmed_ack_rate = ACK_RATE_INITIAL;
+    lorawan_confirmed_stats_reset();
+}
+
+bool lorawan_confirmed_submit(lorawan_transaction_t *transaction)
+{
+    return xQueueSend(lorawan_confirmed_queue, transaction,
+                      pdMS_TO_TICKS(LORAWAN_CONFIRMED_SUBMIT_TIMEOUT)) ==
+           pdPASS;
+}
+
+bool lorawan_confirmed_process(bool unconfirmed_pending)
+{
+    confirmed_entry_t *next = NULL;
+    uint32_t attached;
+    LmHandlerErrorStatus_t status;
+    uint8_t fit;
+
+    // admit new messages while the outstanding window has room
+    for (int i = 0; i < LORAWAN_CONFIRMED_WINDOW; i++) {
+        confirmed_entry_t *entry = &confirmed_window[i];
+
+        if (!entry->used &&
+            (xQueueReceive(lorawan_confirmed_queue, &entry->transaction, 0) ==
+             pdPASS)) {
+            entry->used = true;
+            entry->attempts = 0;
+            entry->budget = confirmed_attempt_budget();
+            entry->due = TimerGetCurrentTime();
+        }
+    }
+
+    // the MAC is still busy while it retransmits, only an idle MAC past
+    // the deadline has lost the confirm
+    if ((confirmed_in_flight != NULL) && (LmHandlerIsBusy() == false) &&
+        ((int32_t)(TimerGetCurrentTime() - confirmed_in_flight_deadline) >
+         0)) {
+        confirmed_entry_t *entry = confirmed_in_flight;
+
+        confirmed_in_flight = NULL;
+        confirmed_attempt_done(entry, false);
+    }
+
+    if (confirmed_in_flight != NULL) {
+        lorawan_wake_in(confirmed_in_flight_deadline - TimerGetCurrentTime());
+    }
+
+    if ((confirmed_in_flight != NULL) || (LmHandlerIsBusy() == true) ||
+        (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET)) {
+        return false;
+    }
+
+    // alternate with unconfirmed traffic after each confirmed attempt
+    if (confirmed_yield && unconfirmed_pending) {
+        confirmed_yield = false;
+        return false;
+    }
+
+    for (int i = 0; i < LORAWAN_CONFIRMED_WINDOW; i++) {
+        confirmed_entry_t *entry = &confirmed_window[i];
+
+        if (!entry->used) {
+            continue;
+        }
+        if ((int32_t)(TimerGetCurrentTime() - entry->due) < 0) {
+            lorawan_wake_in(entry->due - TimerGetCurrentTime());
+            continue;
+        }
+        if ((next == NULL) || ((int32_t)(entry->due - next->due) < 0)) {
+            next = entry;
+        }
+    }
+
+    if ((next == NULL) || lorawan_budget_hold(next->transaction.length)) {
+        return false;
+    }
+
+    LmHandlerAppData_t appData = {.Buffer = next->transaction.buffer,
+                                  .BufferSize = next->transaction.length,
+                                  .Port = next->transaction.port};
+
+    fit = lorawan_payload_check(next->transaction.length);
+    if (fit == LORAWAN_PAYLOAD_DEFERRED) {
+        return false;
+    }
+
+    if (next->attempts > 0) {
+        lorawan_stats_confirmed_retry();
+    }
+    next->attempts++;
+    confirmed_yield = true;
+
+    // the datarate in use cannot carry it, counts as an attempt
+    if (fit == LORAWAN_PAYLOAD_TOO_LONG) {
+        confirmed_attempt_done(next, false);
+        return false;
+    }
+
+    attached = lorawan_mac_request_attach();
+    status = LmHandlerSend(&appData, LORAMAC_HANDLER_CONFIRMED_MSG);
+    lorawan_mac_request_sent(attached, status);
+    if (status != LORAMAC_HANDLER_SUCCESS) {
+        // rejected by the MAC, e.g. duty cycle, counts as an attempt
+        confirmed_attempt_done(next, false);
+        return false;
+    }
+
+    confirmed_in_flight = next;
+    confirmed_in_flight_deadline = confirmed_deadline(next->transaction.length);
+    return true;
+}
+
+void lorawan_confirmed_tx_done(LmHandlerTxParams_t *params)
+{
+    confirmed_entry_t *entry = confirmed_in_flight;
+    bool acked;
+
+    if ((params->IsMcpsConfirm == 0) ||
+        (params->MsgType != LORAMAC_HANDLER_CONFIRMED_MSG) || (entry == NULL)) {
+        return;
+    }
+    confirmed_in_flight = NULL;
+
+    acked = params->AckReceived != 0;
+    confirmed_ack_rate -= confirmed_ack_rate >> ACK_RATE_SHIFT;
+    confirmed_ack_rate += (acked ? ACK_RATE_SCALE : 0) >> ACK_RATE_SHIFT;
+
+    confirmed_attempt_done(entry, acked);
+}
+
+uint32_t lorawan_confirmed_outstanding()
+{
+    uint32_t count = uxQueueMessagesWaiting(lorawan_confirmed_queue);
+
+    for (int i = 0; i < LORAWAN_CONFIRMED_WINDOW; i++) {
+        if (confirmed_window[i].used) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+uint32_t lorawan_confirmed_budget()
+{
+    return confirmed_attempt_budget();
+}
+
+uint32_t lorawan_confirmed_ack_rate()
+{
+    return confirmed_ack_rate * 100 / ACK_RATE_SCALE;
+}
+
+const lorawan_confirmed_stats_t *lorawan_confirmed_stats(uint32_t *count)
+{
+    *count = 0;
+    while ((*count < LORAWAN_CONFIRMED_PORTS) &&
+           (confirmed_stats[*count].messages > 0)) {
+        (*count)++;
+    }
+
+    return confirmed_stats;
+}
+
+void lorawan_confirmed_stats_reset()
+{
+    memset(confirmed_stats, 0, sizeof(confirmed_stats));
+}
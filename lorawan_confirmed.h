@@ -0,0 +1,63 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_CONFIRMED_H_
+#define _LORAWAN_CONFIRMED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+#include "lorawan.h"
+
+typedef struct {
+    uint8_t  port;
+    uint32_t messages;
+    uint32_t acked;
+    uint32_t lost;
+    uint32_t attempts;
+    uint32_t latency_total;
+    uint32_t latency_max;
+} lorawan_confirmed_stats_t;
+
+extern void     lorawan_confirmed_init();
+extern bool     lorawan_confirmed_submit(lorawan_transaction_t *transaction);
+extern bool     lorawan_confirmed_process(bool unconfirmed_pending);
+extern void     lorawan_confirmed_tx_done(LmHandlerTxParams_t *params);
+
+extern uint32_t lorawan_confirmed_outstanding();
+extern uint32_t lorawan_confirmed_budget();
+extern uint32_t lorawan_confirmed_ack_rate();
+extern const lorawan_confirmed_stats_t *lorawan_confirmed_stats(uint32_t *count);
+extern void     lorawan_confirmed_stats_reset();
+
+#endif /* _LORAWAN_CONFIRMED_H_ */
@@ -0,0 +1,477 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_bootloader.h>
+#include <am_mcu_apollo.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+
+#include "lorawan.h"
+#include "lorawan_class_policy.h"
+#include "lorawan_config.h"
+#include "lorawan_downlink.h"
+
+// Downlink sessions on LORAWAN_DOWNLINK_PORT.  Frames from the network:
+//
+//   0x01 start   session, length (4), chunk size (2), CRC32 (4)
+//   0x02 chunk   session, index (2), data
+//   0x03 query   session
+//
+// and from the device:
+//
+//   0x81 status  session, received (2), first missing (2), missing mask (4)
+//   0x82 result  session, 0 CRC mismatch, 1 committed, 2 rejected
+//
+// Multi-byte fields are little-endian.  Chunks are programmed into the
+// slot as they arrive and a bitmap in the slot header records which have
+// been received, so an interrupted session resumes after a reboot.  The
+// two slots alternate and the state word of a slot is only programmed to
+// committed once the CRC of the whole payload matches.
+#define DOWNLINK_START  0x01
+#define DOWNLINK_CHUNK  0x02
+#define DOWNLINK_QUERY  0x03
+#define DOWNLINK_STATUS 0x81
+#define DOWNLINK_RESULT 0x82
+
+#define DOWNLINK_RESULT_CRC_MISMATCH 0
+#define DOWNLINK_RESULT_COMMITTED    1
+#define DOWNLINK_RESULT_REJECTED     2
+
+#define SESSION_MAGIC       0x444C5353
+#define SESSION_IN_PROGRESS 0xFFFFFFFF
+#define SESSION_COMMITTED   0x434D4954
+#define SESSION_FAILED      0x00000000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t length;
+    uint32_t crc;
+    uint16_t chunk_size;
+    uint8_t  session;
+    uint8_t  reserved;
+    uint32_t state;
+} session_header_t;
+
+#define SESSION_BITMAP_OFFSET 32
+#define SESSION_DATA_OFFSET   256
+#define SESSION_MAX_CHUNKS    ((SESSION_DATA_OFFSET - SESSION_BITMAP_OFFSET) * 8)
+#define SESSION_SLOT_SIZE \
+    (LORAWAN_DOWNLINK_SLOT_PAGES * AM_HAL_FLASH_PAGE_SIZE)
+#define SESSION_CAPACITY      (SESSION_SLOT_SIZE - SESSION_DATA_OFFSET)
+#define SESSION_CHUNK_MAX     (LORAWAN_APP_DATA_BUFFER_MAX_SIZE - 4)
+
+static int32_t     active_slot = -1;
+static int32_t     committed_slot = -1;
+static uint32_t    session_chunks;
+static uint32_t    session_received;
+static uint32_t    session_requests;
+static TimerTime_t session_activity;
+static bool        status_due;
+static bool        result_due;
+
+static uint8_t  status_frame[10];
+static uint8_t  result_frame[3];
+static uint32_t chunk_words[(SESSION_CHUNK_MAX + 3) / 4];
+
+static uint32_t slot_address(int32_t slot)
+{
+    return LORAWAN_DOWNLINK_FLASH_ADDRESS + slot * SESSION_SLOT_SIZE;
+}
+
+static const session_header_t *slot_header(int32_t slot)
+{
+    return (const session_header_t *)slot_address(slot);
+}
+
+static const uint32_t *slot_bitmap(int32_t slot)
+{
+    return (const uint32_t *)(slot_address(slot) + SESSION_BITMAP_OFFSET);
+}
+
+static uint32_t get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_u16(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static bool chunk_received(uint32_t index)
+{
+    return (slot_bitmap(active_slot)[index >> 5] & (1u << (index & 0x1F))) == 0;
+}
+
+static void slot_program(uint32_t address, uint32_t *words, uint32_t count)
+{
+    am_hal_flash_program_main(AM_HAL_FLASH_PROGRAM_KEY, words,
+                              (uint32_t *)address, count);
+}
+
+static void slot_set_state(int32_t slot, uint32_t state)
+{
+    slot_program(slot_address(slot) + offsetof(session_header_t, state),
+                 &state, 1);
+}
+
+static void session_result(uint8_t session, uint8_t result)
+{
+    result_frame[0] = DOWNLINK_RESULT;
+    result_frame[1] = session;
+    result_frame[2] = result;
+    result_due = true;
+}
+
+static void session_start(const uint8_t *p, uint32_t size)
+{
+    session_header_t header;
+    const session_header_t *h;
+    uint32_t address;
+    int32_t slot;
+
+    if (size < 12) {
+        return;
+    }
+
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = SESSION_MAGIC;
+    header.session = p[1];
+    header.length = get_u32(&p[2]);
+    header.chunk_size = get_u16(&p[6]);
+    header.crc = get_u32(&p[8]);
+
+    // the network repeats the start until it sees a status
+    if (active_slot >= 0) {
+        h = slot_header(active_slot);
+        if ((h->session == header.session) && (h->length == header.length) &&
+            (h->chunk_size == header.chunk_size) && (h->crc == header.crc)) {
+            status_due = true;
+            return;
+        }
+    }
+
+    if ((header.chunk_size < 4) || (header.chunk_size > SESSION_CHUNK_MAX) ||
+        (header.chunk_size & 0x03) || (header.length == 0) ||
+        (header.length > SESSION_CAPACITY) ||
+        ((header.length + header.chunk_size - 1) / header.chunk_size >
+         SESSION_MAX_CHUNKS)) {
+        session_result(header.session, DOWNLINK_RESULT_REJECTED);
+        return;
+    }
+
+    // the committed payload stays intact until the new one is complete
+    slot = (committed_slot == 0) ? 1 : 0;
+    header.sequence = 0;
+    if (committed_slot >= 0) {
+        header.sequence = slot_header(committed_slot)->sequence + 1;
+    }
+
+    for (uint32_t page = 0; page < LORAWAN_DOWNLINK_SLOT_PAGES; page++) {
+        address = slot_address(slot) + page * AM_HAL_FLASH_PAGE_SIZE;
+        am_hal_flash_page_erase(AM_HAL_FLASH_PROGRAM_KEY,
+                                AM_HAL_FLASH_ADDR2INST(address),
+                                AM_HAL_FLASH_ADDR2PAGE(address));
+    }
+    slot_program(slot_address(slot), (uint32_t *)&header,
+                 sizeof(header) / sizeof(uint32_t));
+
+    active_slot = slot;
+    session_chunks =
+        (header.length + header.chunk_size - 1) / header.chunk_size;
+    session_received = 0;
+    session_requests = 0;
+    session_activity = TimerGetCurrentTime();
+    status_due = false;
+
+    lorawan_class_policy_hint_downlink(LORAWAN_DOWNLINK_QUIET);
+}
+
+static void session_complete()
+{
+    const session_header_t *h = slot_header(active_slot);
+    const uint8_t *data =
+        (const uint8_t *)(slot_address(active_slot) + SESSION_DATA_OFFSET);
+
+    if (am_bootloader_fast_crc32(data, h->length) == h->crc) {
+        slot_set_state(active_slot, SESSION_COMMITTED);
+        committed_slot = active_slot;
+        session_result(h->session, DOWNLINK_RESULT_COMMITTED);
+    } else {
+        slot_set_state(active_slot, SESSION_FAILED);
+        session_result(h->session, DOWNLINK_RESULT_CRC_MISMATCH);
+    }
+
+    active_slot = -1;
+    status_due = false;
+}
+
+static void session_chunk(const uint8_t *p, uint32_t size)
+{
+    const session_header_t *h;
+    uint32_t index;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t bit;
+
+    if ((active_slot < 0) || (size < 5)) {
+        return;
+    }
+
+    h = slot_header(active_slot);
+    index = get_u16(&p[2]);
+    if ((p[1] != h->session) || (index >= session_chunks)) {
+        return;
+    }
+
+    offset = index * h->chunk_size;
+    length = h->length - offset;
+    if (length > h->chunk_size) {
+        length = h->chunk_size;
+    }
+    if (size - 4 != length) {
+        return;
+    }
+
+    session_activity = TimerGetCurrentTime();
+    session_requests = 0;
+    if (chunk_received(index)) {
+        return;
+    }
+
+    // the chunk goes from the receive buffer straight to flash
+    memset(chunk_words, 0xFF, sizeof(chunk_words));
+    memcpy(chunk_words, &p[4], length);
+    slot_program(slot_address(active_slot) + SESSION_DATA_OFFSET + offset,
+                 chunk_words, (length + 3) / 4);
+
+    bit = ~(1u << (index & 0x1F));
+    slot_program(slot_address(active_slot) + SESSION_BITMAP_OFFSET +
+                     (index >> 5) * sizeof(uint32_t),
+                 &bit, 1);
+
+    if (++session_received == session_chunks) {
+        session_complete();
+    }
+}
+
+static void session_query(const uint8_t *p, uint32_t size)
+{
+    if (size < 2) {
+        return;
+    }
+
+    if ((active_slot >= 0) && (slot_header(active_slot)->session == p[1])) {
+        status_due = true;
+    } else if ((committed_slot >= 0) &&
+               (slot_header(committed_slot)->session == p[1])) {
+        session_result(p[1], DOWNLINK_RESULT_COMMITTED);
+    }
+}
+
+void lorawan_downlink_init()
+{
+    const session_header_t *h;
+    uint32_t sequence[2];
+    int32_t progress = -1;
+
+    // the state is rebuilt from the slots alone
+    active_slot = -1;
+    committed_slot = -1;
+    status_due = false;
+    result_due = false;
+
+    for (int32_t slot = 0; slot < 2; slot++) {
+        h = slot_header(slot);
+        sequence[slot] = h->sequence;
+        if (h->magic != SESSION_MAGIC) {
+            continue;
+        }
+        if (h->state == SESSION_COMMITTED) {
+            if ((committed_slot < 0) ||
+                ((int32_t)(h->sequence - sequence[committed_slot]) > 0)) {
+                committed_slot = slot;
+            }
+        } else if (h->state == SESSION_IN_PROGRESS) {
+            progress = slot;
+        }
+    }
+
+    // a session is only resumed if it is newer than the committed payload
+    if ((progress >= 0) &&
+        ((committed_slot < 0) ||
+         ((int32_t)(sequence[progress] - sequence[committed_slot]) > 0))) {
+        h = slot_header(progress);
+        active_slot = progress;
+        session_chunks = (h->length + h->chunk_size - 1) / h->chunk_size;
+        session_received = 0;
+        for (uint32_t i = 0; i < session_chunks; i++) {
+            session_received += chunk_received(i) ? 1 : 0;
+        }
+        session_requests = 0;
+        session_activity = TimerGetCurrentTime();
+    }
+}
+
+void lorawan_downlink_rx(LmHandlerAppData_t *appData)
+{
+    if (appData->BufferSize < 1) {
+        return;
+    }
+
+    switch (appData->Buffer[0]) {
+    case DOWNLINK_START:
+        session_start(appData->Buffer, appData->BufferSize);
+        break;
+    case DOWNLINK_CHUNK:
+        session_chunk(appData->Buffer, appData->BufferSize);
+        break;
+    case DOWNLINK_QUERY:
+        session_query(appData->Buffer, appData->BufferSize);
+        break;
+    default:
+        break;
+    }
+}
+
+static void downlink_send(uint8_t *frame, uint32_t length)
+{
+    lorawan_transaction_t transaction;
+
+    transaction.message_type = LORAMAC_HANDLER_UNCONFIRMED_MSG;
+    transaction.length = length;
+    transaction.buffer = frame;
+    transaction.port = LORAWAN_DOWNLINK_PORT;
+    transaction.key = LORAWAN_KEY_NONE;
+    transaction.callback = NULL;
+    transaction.context = NULL;
+
+    lorawan_send(&transaction);
+}
+
+// Reports the missing chunks once the network has been quiet for
+// LORAWAN_DOWNLINK_QUIET, the report goes out with the next uplink and
+// opens the receive windows for the retransmissions.
+void lorawan_downlink_process()
+{
+    uint32_t first;
+    uint32_t missing = 0;
+
+    if (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET) {
+        return;
+    }
+
+    if (result_due) {
+        result_due = false;
+        downlink_send(result_frame, sizeof(result_frame));
+        return;
+    }
+
+    if ((active_slot < 0) ||
+        (!status_due &&
+         ((TimerGetElapsedTime(session_activity) < LORAWAN_DOWNLINK_QUIET) ||
+          (session_requests >= LORAWAN_DOWNLINK_REQUESTS)))) {
+        return;
+    }
+
+    for (first = 0; first < session_chunks; first++) {
+        if (!chunk_received(first)) {
+            break;
+        }
+    }
+    for (uint32_t i = 0; (i < 32) && (first + i < session_chunks); i++) {
+        if (!chunk_received(first + i)) {
+            missing |= 1u << i;
+        }
+    }
+
+    status_frame[0] = DOWNLINK_STATUS;
+    status_frame[1] = slot_header(active_slot)->session;
+    put_u16(&status_frame[2], session_received);
+    put_u16(&status_frame[4], first);
+    put_u16(&status_frame[6], missing);
+    put_u16(&status_frame[8], missing >> 16);
+    downlink_send(status_frame, sizeof(status_frame));
+
+    status_due = false;
+    session_requests++;
+    session_activity = TimerGetCurrentTime();
+}
+
+bool lorawan_downlink_blob(const uint8_t **data, uint32_t *length,
+                           uint8_t *session)
+{
+    const session_header_t *h;
+
+    if (committed_slot < 0) {
+        return false;
+    }
+
+    h = slot_header(committed_slot);
+    *data = (const uint8_t *)(slot_address(committed_slot) +
+                              SESSION_DATA_OFFSET);
+    *length = h->length;
+    *session = h->session;
+
+    return true;
+}
+
+void lorawan_downlink_status(lorawan_downlink_status_t *status)
+{
+    memset(status, 0, sizeof(lorawan_downlink_status_t));
+
+    if (active_slot >= 0) {
+        status->active = true;
+        status->session = slot_header(active_slot)->session;
+        status->length = slot_header(active_slot)->length;
+        status->chunks = session_chunks;
+        status->received = session_received;
+        status->requests = session_requests;
+    }
+    if (committed_slot >= 0) {
+        status->committed = true;
+        status->committed_session = slot_header(committed_slot)->session;
+        status->committed_length = slot_header(committed_slot)->length;
+    }
+}
@@ -0,0 +1,190 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+
+#include "lorawan.h"
+#include "lorawan_budget.h"
+#include "lorawan_config.h"
+#include "lorawan_drain.h"
+
+// In class A, LmHandler answers a downlink with FPending set with an empty
+// uplink straight from the MCPS indication.  When the MAC rejects that
+// frame, e.g. because of the duty cycle, the network keeps the rest of its
+// queue until the next application uplink.  The empty frame is owed until
+// any uplink is accepted and is retried here as soon as the duty cycle
+// and the airtime budget allow.
+//
+// A burst runs from the first downlink with FPending set to the first
+// downlink without it, its length and duration are kept to compare the
+// delivery time with draining on and off.
+
+static bool        drain_enabled = LORAWAN_DRAIN_ENABLE;
+static bool        drain_pending;
+static bool        drain_sending;
+static TimerTime_t drain_due;
+
+static bool        rx_seen;
+static bool        request_seen;
+static bool        burst_active;
+static uint32_t    burst_downlinks;
+static TimerTime_t burst_start;
+static TimerTime_t burst_last;
+
+static lorawan_drain_stats_t drain_stats;
+
+void lorawan_drain_init()
+{
+    drain_pending = false;
+    burst_active = false;
+    memset(&drain_stats, 0, sizeof(drain_stats));
+}
+
+void lorawan_drain_enable(bool enable)
+{
+    drain_enabled = enable;
+    if (!enable) {
+        drain_pending = false;
+    }
+}
+
+bool lorawan_drain_enabled()
+{
+    return drain_enabled;
+}
+
+void lorawan_drain_rx(LmHandlerRxParams_t *params)
+{
+    if ((params->IsMcpsIndication == 0) ||
+        (params->Status != LORAMAC_EVENT_INFO_STATUS_OK)) {
+        return;
+    }
+
+    rx_seen = true;
+    burst_last = TimerGetCurrentTime();
+    if (burst_active) {
+        burst_downlinks++;
+    }
+}
+
+// Called for the empty uplink LmHandler sends after a downlink with
+// FPending set.
+void lorawan_drain_request(LoRaMacStatus_t status, TimerTime_t nextTxIn)
+{
+    request_seen = true;
+    drain_stats.frame_pending++;
+
+    if (!burst_active) {
+        burst_active = true;
+        burst_downlinks = 1;
+        burst_start = burst_last;
+    }
+
+    if (status == LORAMAC_STATUS_OK) {
+        drain_stats.immediate++;
+        drain_pending = false;
+        return;
+    }
+
+    if (drain_enabled) {
+        drain_pending = true;
+        drain_due = TimerGetCurrentTime() +
+                    ((nextTxIn > 0) ? nextTxIn : LORAWAN_DRAIN_RETRY);
+    }
+}
+
+// Called for every other uplink request, any accepted uplink opens the
+// receive windows for the next downlink.
+void lorawan_drain_uplink(LoRaMacStatus_t status, TimerTime_t nextTxIn)
+{
+    if (!drain_pending) {
+        return;
+    }
+
+    if (status == LORAMAC_STATUS_OK) {
+        drain_pending = false;
+        if (drain_sending) {
+            drain_stats.retried++;
+        } else {
+            drain_stats.piggybacked++;
+        }
+    } else if (nextTxIn > 0) {
+        drain_due = TimerGetCurrentTime() + nextTxIn;
+    }
+}
+
+void lorawan_drain_process(bool traffic)
+{
+    LmHandlerAppData_t appData = {.Buffer = NULL, .BufferSize = 0, .Port = 0};
+
+    // a downlink that did not ask for another one ends the burst
+    if (rx_seen && !request_seen && burst_active) {
+        burst_active = false;
+        drain_stats.bursts++;
+        drain_stats.last_downlinks = burst_downlinks;
+        drain_stats.last_time = burst_last - burst_start;
+        drain_stats.burst_downlinks += drain_stats.last_downlinks;
+        drain_stats.burst_time += drain_stats.last_time;
+    }
+    rx_seen = false;
+    request_seen = false;
+
+    // queued application data goes first and opens the windows as well
+    if (!drain_pending || traffic) {
+        return;
+    }
+
+    if ((int32_t)(TimerGetCurrentTime() - drain_due) < 0) {
+        lorawan_wake_in(drain_due - TimerGetCurrentTime());
+        return;
+    }
+
+    if ((LmHandlerIsBusy() == true) ||
+        (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET) ||
+        lorawan_budget_hold(0)) {
+        return;
+    }
+
+    drain_due = TimerGetCurrentTime() + LORAWAN_DRAIN_RETRY;
+    drain_sending = true;
+    LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
+    drain_sending = false;
+}
+
+void lorawan_drain_stats(lorawan_drain_stats_t *stats)
+{
+    memcpy(stats, &drain_stats, sizeof(lorawan_drain_stats_t));
+}
@@ -0,0 +1,61 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_DRAIN_H_
+#define _LORAWAN_DRAIN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+typedef struct {
+    uint32_t frame_pending;
+    uint32_t immediate;
+    uint32_t retried;
+    uint32_t piggybacked;
+    uint32_t bursts;
+    uint32_t burst_downlinks;
+    uint32_t burst_time;
+    uint32_t last_downlinks;
+    uint32_t last_time;
+} lorawan_drain_stats_t;
+
+extern void lorawan_drain_init();
+extern void lorawan_drain_enable(bool enable);
+extern bool lorawan_drain_enabled();
+extern void lorawan_drain_rx(LmHandlerRxParams_t *params);
+extern void lorawan_drain_request(LoRaMacStatus_t status, TimerTime_t nextTxIn);
+extern void lorawan_drain_uplink(LoRaMacStatus_t status, TimerTime_t nextTxIn);
+extern void lorawan_drain_process(bool traffic);
+extern void lorawan_drain_stats(lorawan_drain_stats_t *stats);
+
+#endif /* _LORAWAN_DRAIN_H_ */
@@ -0,0 +1,296 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <queue.h>
+
+#include <LmHandler.h>
+
+#include "lorawan.h"
+#include "lorawan_budget.h"
+#include "lorawan_config.h"
+#include "lorawan_fragment.h"
+#include "lorawan_mac_request.h"
+
+// Each fragment carries IndexAndN (2 bits session, 14 bits fragment index),
+// the number of uncoded fragments and the padding of the last fragment.
+// Coded fragments use the parity matrix of the LoRaWAN fragmented data
+// block transport specification so they can be decoded with the same
+// algorithm the stack uses for downlink sessions.
+#define FRAGMENT_HEADER_SIZE 5
+#define FRAGMENT_INDEX_MASK  0x3FFF
+
+static QueueHandle_t lorawan_blob_queue;
+
+static lorawan_blob_t blob;
+static bool           blob_active;
+static bool           blob_in_flight;
+static bool           blob_restart;
+static uint8_t        blob_session;
+static uint16_t       blob_fragment_size;
+static uint32_t       blob_uncoded;
+static uint32_t       blob_total;
+static uint32_t       blob_next;
+static uint32_t       blob_done;
+
+static uint8_t fragment_buffer[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+static uint8_t parity_row[(LORAWAN_FRAG_MAX_NB + 7) / 8];
+
+static int32_t fragment_prbs23(int32_t value)
+{
+    int32_t b0 = value & 0x01;
+    int32_t b1 = (value & 0x20) >> 5;
+
+    return (value >> 1) + ((b0 ^ b1) << 22);
+}
+
+static void fragment_parity_row(int32_t n, int32_t m)
+{
+    int32_t m_temp = ((m & (m - 1)) == 0) ? 1 : 0;
+    int32_t x = 1 + (1001 * n);
+    int32_t coefficients = 0;
+    int32_t r;
+
+    memset(parity_row, 0, (m + 7) / 8);
+
+    while (coefficients < (m >> 1)) {
+        r = 1 << 16;
+        while (r >= m) {
+            x = fragment_prbs23(x);
+            r = x % (m + m_temp);
+        }
+        parity_row[r >> 3] |= 1 << (r & 0x07);
+        coefficients++;
+    }
+}
+
+static void fragment_xor_block(uint8_t *out, uint32_t block)
+{
+    uint32_t offset = block * blob_fragment_size;
+    uint32_t size = blob_fragment_size;
+
+    // the tail of the last block is zero padding
+    if (offset + size > blob.length) {
+        size = blob.length - offset;
+    }
+
+    for (uint32_t i = 0; i < size; i++) {
+        out[i] ^= blob.buffer[offset + i];
+    }
+}
+
+static uint8_t fragment_build(uint32_t index)
+{
+    uint8_t *payload = &fragment_buffer[FRAGMENT_HEADER_SIZE];
+    uint16_t index_and_n = ((uint16_t)blob_session << 14) | (index + 1);
+    uint32_t padding = blob_uncoded * blob_fragment_size - blob.length;
+
+    fragment_buffer[0] = index_and_n & 0xFF;
+    fragment_buffer[1] = index_and_n >> 8;
+    fragment_buffer[2] = blob_uncoded & 0xFF;
+    fragment_buffer[3] = blob_uncoded >> 8;
+    fragment_buffer[4] = padding;
+
+    memset(payload, 0, blob_fragment_size);
+
+    if (index < blob_uncoded) {
+        fragment_xor_block(payload, index);
+    } else {
+        fragment_parity_row(index + 1 - blob_uncoded, blob_uncoded);
+        for (uint32_t block = 0; block < blob_uncoded; block++) {
+            if (parity_row[block >> 3] & (1 << (block & 0x07))) {
+                fragment_xor_block(payload, block);
+            }
+        }
+    }
+
+    return FRAGMENT_HEADER_SIZE + blob_fragment_size;
+}
+
+static void fragment_complete(bool success)
+{
+    blob_active = false;
+    blob_in_flight = false;
+
+    if (blob.callback) {
+        blob.callback(&blob, success);
+    }
+}
+
+static bool fragment_setup()
+{
+    LoRaMacTxInfo_t txInfo;
+    uint32_t max_payload;
+
+    if (LoRaMacQueryTxPossible(0, &txInfo) != LORAMAC_STATUS_OK) {
+        return false;
+    }
+
+    // the fragment size is fixed for the whole session, so size it for
+    // the datarate in use when its first fragment goes out
+    max_payload = txInfo.MaxPossibleApplicationDataSize;
+    if (max_payload > LORAWAN_APP_DATA_BUFFER_MAX_SIZE) {
+        max_payload = LORAWAN_APP_DATA_BUFFER_MAX_SIZE;
+    }
+    if (max_payload <= FRAGMENT_HEADER_SIZE) {
+        return false;
+    }
+
+    blob_fragment_size = max_payload - FRAGMENT_HEADER_SIZE;
+    blob_uncoded = (blob.length + blob_fragment_size - 1) / blob_fragment_size;
+    blob_total = blob_uncoded + (blob_uncoded * blob.redundancy + 99) / 100;
+    blob_next = 0;
+    blob_done = 0;
+    blob_in_flight = false;
+    blob_restart = false;
+    blob_session = (blob_session + 1) & 0x03;
+
+    return true;
+}
+
+static bool fragment_fits()
+{
+    return (blob_uncoded <= LORAWAN_FRAG_MAX_NB) &&
+           (blob_total <= FRAGMENT_INDEX_MASK);
+}
+
+void lorawan_fragment_init()
+{
+    lorawan_blob_queue = xQueueCreate(4, sizeof(lorawan_blob_t));
+    blob_active = false;
+}
+
+bool lorawan_send_blob(lorawan_blob_t *b)
+{
+    if ((b->buffer == NULL) || (b->length == 0)) {
+        return false;
+    }
+
+    return xQueueSend(lorawan_blob_queue, b, 0) == pdPASS;
+}
+
+void lorawan_fragment_process()
+{
+    LmHandlerAppData_t appData;
+    LmHandlerErrorStatus_t status;
+    uint32_t attached;
+    uint8_t fit;
+
+    if (!blob_active) {
+        if (xQueuePeek(lorawan_blob_queue, &blob, 0) != pdPASS) {
+            return;
+        }
+
+        if (LmHandlerIsBusy() == true) {
+            return;
+        }
+
+        if (!fragment_setup()) {
+            return;
+        }
+
+        xQueueReceive(lorawan_blob_queue, &blob, 0);
+        blob_active = true;
+
+        if (!fragment_fits()) {
+            fragment_complete(false);
+            return;
+        }
+    }
+
+    // start the blob over in a new session with fragments that fit
+    if (blob_restart) {
+        if ((LmHandlerIsBusy() == true) || !fragment_setup()) {
+            return;
+        }
+
+        if (!fragment_fits()) {
+            fragment_complete(false);
+            return;
+        }
+    }
+
+    if (blob_in_flight || (blob_next >= blob_total)) {
+        return;
+    }
+
+    if ((LmHandlerIsBusy() == true) ||
+        lorawan_budget_hold(FRAGMENT_HEADER_SIZE + blob_fragment_size)) {
+        return;
+    }
+
+    // the datarate dropped below the fragment size
+    fit = lorawan_payload_check(FRAGMENT_HEADER_SIZE + blob_fragment_size);
+    if (fit == LORAWAN_PAYLOAD_DEFERRED) {
+        return;
+    } else if (fit == LORAWAN_PAYLOAD_TOO_LONG) {
+        blob_restart = true;
+        return;
+    }
+
+    appData.Port = blob.port;
+    appData.BufferSize = fragment_build(blob_next);
+    appData.Buffer = fragment_buffer;
+
+    attached = lorawan_mac_request_attach();
+    status = LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
+    lorawan_mac_request_sent(attached, status);
+    if (status == LORAMAC_HANDLER_SUCCESS) {
+        blob_in_flight = true;
+        blob_next++;
+    }
+}
+
+void lorawan_fragment_tx_done(LmHandlerTxParams_t *params)
+{
+    if (!blob_active || !blob_in_flight) {
+        return;
+    }
+
+    // only the confirm of the fragment in flight, other uplinks may use
+    // the same port
+    if ((params->IsMcpsConfirm == 0) ||
+        (params->AppData.Buffer != fragment_buffer) ||
+        (params->AppData.Port != blob.port)) {
+        return;
+    }
+
+    blob_in_flight = false;
+    blob_done++;
+
+    if (blob_done >= blob_total) {
+        fragment_complete(true);
+    }
+}
@@ -0,0 +1,394 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <LmHandler.h>
+
+#include "cli_batch.h"
+#include "lorawan.h"
+#include "lorawan_buffer.h"
+#include "lorawan_class_policy.h"
+#include "lorawan_config.h"
+#include "lorawan_drain.h"
+#include "lorawan_frame.h"
+#include "lorawan_stats.h"
+
+// Binary console frames are COBS encoded and delimited by zero bytes.  The
+// decoded frame is
+//
+//   type, sequence, body, CRC-16/CCITT (0x1021, 0xFFFF, big-endian)
+//
+// and every frame is answered with type | 0x80, the same sequence, a
+// status byte and the reply body:
+//
+//   0x01 send    port, flags (bit 0 confirmed), key, payload -> id (4),
+//                status busy while no uplink buffer or confirmed queue
+//                room is free
+//   0x02 stats   -> stats version, size, lorawan_stats_t
+//   0x03 config  item, value
+//   0x04 exit    back to the text console
+//   0x05 batch   console commands separated by new lines
+//                -> elapsed ms (4), count, per command status, length (2),
+//                   output
+//
+// Multi-byte fields in the bodies are little-endian.  A send copies its
+// payload into a buffer of lorawan_buffer.c that is held until the uplink
+// leaves the stack.
+#define FRAME_SEND   0x01
+#define FRAME_STATS  0x02
+#define FRAME_CONFIG 0x03
+#define FRAME_EXIT   0x04
+#define FRAME_BATCH  0x05
+#define FRAME_ERROR  0x7F
+#define FRAME_REPLY  0x80
+
+#define FRAME_CONFIG_DRAIN       0x01
+#define FRAME_CONFIG_POWER       0x02
+#define FRAME_CONFIG_HINT        0x03
+#define FRAME_CONFIG_STATS_RESET 0x04
+
+#define FRAME_STATUS_OK      0
+#define FRAME_STATUS_CRC     1
+#define FRAME_STATUS_LENGTH  2
+#define FRAME_STATUS_UNKNOWN 3
+#define FRAME_STATUS_BUSY    4
+
+#define FRAME_HEADER      2
+#define FRAME_SEND_HEADER 3
+#define FRAME_CRC         2
+#define FRAME_SIZE \
+    (FRAME_HEADER + FRAME_SEND_HEADER + LORAWAN_APP_DATA_BUFFER_MAX_SIZE + \
+     FRAME_CRC)
+
+#define FRAME_BATCH_HEADER 5
+#define FRAME_BATCH_RECORD 3
+
+#define REPLY_BODY                                              \
+    ((LORAWAN_FRAME_BATCH_REPLY > 2 + sizeof(lorawan_stats_t)) \
+         ? LORAWAN_FRAME_BATCH_REPLY                            \
+         : 2 + sizeof(lorawan_stats_t))
+#define REPLY_SIZE (FRAME_HEADER + 1 + REPLY_BODY + FRAME_CRC)
+
+static uint8_t  frame_buffer[FRAME_SIZE];
+static uint32_t frame_length;
+static uint32_t frame_remaining;
+static bool     frame_zero;
+static bool     frame_overrun;
+static uint16_t frame_crc;
+static bool     frame_running;
+
+static uint8_t reply[REPLY_SIZE];
+static uint8_t reply_encoded[REPLY_SIZE + REPLY_SIZE / 254 + 3];
+
+static lorawan_frame_stats_t frame_stats;
+
+static uint16_t crc16(uint16_t crc, uint8_t byte)
+{
+    crc ^= byte << 8;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static void frame_reset()
+{
+    frame_length = 0;
+    frame_remaining = 0;
+    frame_zero = false;
+    frame_overrun = false;
+    frame_crc = 0xFFFF;
+}
+
+// Encodes the reply with a leading and a trailing delimiter so that any
+// text printed around it is dropped by the host as a bad frame.
+static void frame_reply(uint8_t type, uint8_t sequence, uint8_t status,
+                        uint32_t length)
+{
+    uint16_t crc = 0xFFFF;
+    uint32_t code = 1;
+    uint32_t n = 2;
+
+    reply[0] = type | FRAME_REPLY;
+    reply[1] = sequence;
+    reply[2] = status;
+    length += 3;
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc16(crc, reply[i]);
+    }
+    reply[length++] = crc >> 8;
+    reply[length++] = crc;
+
+    reply_encoded[0] = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        if (reply[i] == 0) {
+            reply_encoded[code] = n - code;
+            code = n++;
+        } else {
+            reply_encoded[n++] = reply[i];
+            if (n - code == 0xFF) {
+                reply_encoded[code] = 0xFF;
+                code = n++;
+            }
+        }
+    }
+    reply_encoded[code] = n - code;
+    reply_encoded[n++] = 0;
+
+    lorawan_frame_output(reply_encoded, n);
+}
+
+static void frame_send(uint8_t *frame, uint32_t length)
+{
+    lorawan_transaction_t transaction;
+    uint8_t *buffer;
+    uint32_t id;
+
+    if ((length < FRAME_SEND_HEADER) ||
+        (length - FRAME_SEND_HEADER > LORAWAN_APP_DATA_BUFFER_MAX_SIZE)) {
+        frame_reply(FRAME_SEND, frame[1], FRAME_STATUS_LENGTH, 0);
+        return;
+    }
+
+    buffer = lorawan_buffer_alloc();
+    if (buffer == NULL) {
+        frame_reply(FRAME_SEND, frame[1], FRAME_STATUS_BUSY, 0);
+        return;
+    }
+    memcpy(buffer, &frame[FRAME_HEADER + FRAME_SEND_HEADER],
+           length - FRAME_SEND_HEADER);
+
+    transaction.message_type = (frame[3] & 0x01)
+                                   ? LORAMAC_HANDLER_CONFIRMED_MSG
+                                   : LORAMAC_HANDLER_UNCONFIRMED_MSG;
+    transaction.length = length - FRAME_SEND_HEADER;
+    transaction.buffer = buffer;
+    transaction.port = frame[2];
+    transaction.key = frame[4];
+    transaction.callback = NULL;
+    transaction.context = NULL;
+
+    id = lorawan_send(&transaction);
+    if (id == 0) {
+        frame_reply(FRAME_SEND, frame[1], FRAME_STATUS_BUSY, 0);
+        return;
+    }
+    frame_stats.uplinks++;
+
+    reply[3] = id;
+    reply[4] = id >> 8;
+    reply[5] = id >> 16;
+    reply[6] = id >> 24;
+    frame_reply(FRAME_SEND, frame[1], FRAME_STATUS_OK, 4);
+}
+
+static void frame_config(uint8_t *frame, uint32_t length)
+{
+    const uint8_t *value = &frame[FRAME_HEADER + 1];
+    uint8_t status = FRAME_STATUS_OK;
+
+    if (length < 1) {
+        frame_reply(FRAME_CONFIG, frame[1], FRAME_STATUS_LENGTH, 0);
+        return;
+    }
+
+    switch (frame[FRAME_HEADER]) {
+    case FRAME_CONFIG_DRAIN:
+        if (length < 2) {
+            status = FRAME_STATUS_LENGTH;
+        } else {
+            lorawan_drain_enable(value[0] != 0);
+        }
+        break;
+    case FRAME_CONFIG_POWER:
+        if (length < 2) {
+            status = FRAME_STATUS_LENGTH;
+        } else {
+            lorawan_class_policy_set_power_source(
+                value[0] ? LORAWAN_POWER_MAINS : LORAWAN_POWER_BATTERY);
+        }
+        break;
+    case FRAME_CONFIG_HINT:
+        if (length < 5) {
+            status = FRAME_STATUS_LENGTH;
+        } else {
+            lorawan_class_policy_hint_downlink(
+                value[0] | (value[1] << 8) | (value[2] << 16) |
+                ((uint32_t)value[3] << 24));
+        }
+        break;
+    case FRAME_CONFIG_STATS_RESET:
+        lorawan_stats_reset();
+        break;
+    default:
+        status = FRAME_STATUS_UNKNOWN;
+        break;
+    }
+
+    frame_reply(FRAME_CONFIG, frame[1], status, 0);
+}
+
+// Runs the commands one after the other, each into the reply.  Commands
+// that no longer find room in the reply are left out of the count.
+static void frame_batch(uint8_t *frame, uint32_t length)
+{
+    const char *commands = (const char *)&frame[FRAME_HEADER];
+    TickType_t start = xTaskGetTickCount();
+    char line[CLI_BATCH_LINE];
+    uint32_t n = FRAME_HEADER + 1 + FRAME_BATCH_HEADER;
+    uint32_t elapsed;
+    uint32_t count = 0;
+    size_t output;
+
+    while ((count < 0xFF) &&
+           (n + FRAME_BATCH_RECORD + CLI_BATCH_PAGE_MIN <=
+            REPLY_SIZE - FRAME_CRC) &&
+           cli_batch_line(commands, length, count, line, sizeof(line))) {
+        reply[n] = cli_batch_run(line, (char *)&reply[n + FRAME_BATCH_RECORD],
+                                 REPLY_SIZE - FRAME_CRC - n -
+                                     FRAME_BATCH_RECORD,
+                                 &output);
+        reply[n + 1] = output;
+        reply[n + 2] = output >> 8;
+        n += FRAME_BATCH_RECORD + output;
+        count++;
+    }
+
+    elapsed = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    reply[3] = elapsed;
+    reply[4] = elapsed >> 8;
+    reply[5] = elapsed >> 16;
+    reply[6] = elapsed >> 24;
+    reply[7] = count;
+
+    frame_reply(FRAME_BATCH, frame[1], FRAME_STATUS_OK, n - 3);
+}
+
+static void frame_dispatch()
+{
+    uint8_t *frame = frame_buffer;
+    uint32_t length;
+
+    // the CRC over the frame including its own CRC leaves no remainder
+    if (frame_overrun || (frame_remaining != 0) ||
+        (frame_length < FRAME_HEADER + FRAME_CRC) || (frame_crc != 0)) {
+        frame_stats.errors++;
+        frame_reply(FRAME_ERROR, 0, FRAME_STATUS_CRC, 0);
+        return;
+    }
+
+    frame_stats.frames++;
+    length = frame_length - FRAME_HEADER - FRAME_CRC;
+
+    switch (frame[0]) {
+    case FRAME_SEND:
+        frame_send(frame, length);
+        break;
+    case FRAME_STATS:
+        reply[3] = LORAWAN_STATS_VERSION;
+        reply[4] = sizeof(lorawan_stats_t);
+        memcpy(&reply[5], &lorawan_stats, sizeof(lorawan_stats_t));
+        frame_reply(FRAME_STATS, frame[1], FRAME_STATUS_OK,
+                    2 + sizeof(lorawan_stats_t));
+        break;
+    case FRAME_CONFIG:
+        frame_config(frame, length);
+        break;
+    case FRAME_EXIT:
+        frame_reply(FRAME_EXIT, frame[1], FRAME_STATUS_OK, 0);
+        frame_running = false;
+        break;
+    case FRAME_BATCH:
+        frame_batch(frame, length);
+        break;
+    default:
+        frame_reply(frame[0], frame[1], FRAME_STATUS_UNKNOWN, 0);
+        break;
+    }
+}
+
+static void frame_store(uint8_t byte)
+{
+    if (frame_length < FRAME_SIZE) {
+        frame_buffer[frame_length++] = byte;
+        frame_crc = crc16(frame_crc, byte);
+    } else {
+        frame_overrun = true;
+    }
+}
+
+void lorawan_frame_start()
+{
+    frame_reset();
+    frame_running = true;
+}
+
+// Decodes one byte from the console, returns false once the host has
+// asked to go back to the text console.
+bool lorawan_frame_input(uint8_t byte)
+{
+    frame_stats.bytes++;
+
+    if (byte == 0) {
+        if ((frame_length > 0) || (frame_remaining > 0) || frame_zero) {
+            frame_dispatch();
+        }
+        frame_reset();
+    } else if (frame_remaining == 0) {
+        // a code byte, the zero owed by the previous block comes first
+        if (frame_zero) {
+            frame_store(0);
+        }
+        frame_remaining = byte - 1;
+        frame_zero = (byte != 0xFF);
+    } else {
+        frame_store(byte);
+        frame_remaining--;
+    }
+
+    return frame_running;
+}
+
+bool lorawan_frame_active()
+{
+    return frame_running;
+}
+
+void lorawan_frame_stats(lorawan_frame_stats_t *stats)
+{
+    memcpy(stats, &frame_stats, sizeof(lorawan_frame_stats_t));
+}
@@ -0,0 +1,241 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_mcu_apollo.h>
+#include <am_util.h>
+
+#include <LmHandler.h>
+#include <LmhpClockSync.h>
+#include <LmhpFragmentation.h>
+#include <LmhpRemoteMcastSetup.h>
+#include <timer.h>
+
+#include "amota_profile_config.h"
+#include "lorawan_config.h"
+#include "lorawan_fuota.h"
+
+#define FUOTA_PAGE_COUNT \
+    (AMOTA_INT_FLASH_OTA_MAX_SIZE / AM_HAL_FLASH_PAGE_SIZE)
+#define FUOTA_WRITE_WORDS ((LORAWAN_APP_DATA_BUFFER_MAX_SIZE + 7) / 4)
+
+#define FUOTA_FRAG_SESSION_SETUP_REQ 0x02
+
+// FRAG_MAX_NB and FRAG_MAX_SIZE come from the build flags, see application.mk
+#if (FRAG_MAX_NB * FRAG_MAX_SIZE) < AMOTA_INT_FLASH_OTA_MAX_SIZE
+#error "FRAG_MAX_NB fragments of FRAG_MAX_SIZE must cover the OTA storage area"
+#endif
+
+// parameter length of the fragmentation requests in front of the data
+// fragment, which takes the rest of the frame
+static const uint8_t fuota_frag_request_length[] = {0, 1, 10, 1};
+
+static LmhpFragmentationParams_t LmhpFragmentationParams;
+
+static uint32_t fuota_erased[(FUOTA_PAGE_COUNT + 31) / 32];
+static uint32_t fuota_words[FUOTA_WRITE_WORDS];
+
+static bool        clock_sync_pending;
+static bool        reboot_pending;
+static TimerTime_t reboot_scheduled_at;
+
+static void fuota_erase_page(uint32_t page)
+{
+    uint32_t address;
+
+    if (fuota_erased[page >> 5] & (1 << (page & 0x1F))) {
+        return;
+    }
+
+    address = AMOTA_INT_FLASH_OTA_ADDRESS + page * AM_HAL_FLASH_PAGE_SIZE;
+    am_hal_flash_page_erase(AM_HAL_FLASH_PROGRAM_KEY,
+                            AM_HAL_FLASH_ADDR2INST(address),
+                            AM_HAL_FLASH_ADDR2PAGE(address));
+
+    fuota_erased[page >> 5] |= 1 << (page & 0x1F);
+}
+
+static int8_t FragDecoderWrite(uint32_t addr, uint8_t *data, uint32_t size)
+{
+    uint32_t start;
+    uint32_t words;
+
+    if ((size == 0) || (addr + size > AMOTA_INT_FLASH_OTA_MAX_SIZE)) {
+        return -1;
+    }
+
+    // pages are erased on first use within a session so that nothing is
+    // erased ahead of a session that may never complete
+    for (uint32_t page = addr / AM_HAL_FLASH_PAGE_SIZE;
+         page <= (addr + size - 1) / AM_HAL_FLASH_PAGE_SIZE; page++) {
+        fuota_erase_page(page);
+    }
+
+    // fragments are not word aligned, merge the partial words at both ends
+    // with the current flash content before programming
+    start = (AMOTA_INT_FLASH_OTA_ADDRESS + addr) & ~0x03;
+    words = ((AMOTA_INT_FLASH_OTA_ADDRESS + addr + size + 3) & ~0x03) - start;
+    words /= 4;
+
+    if (words > FUOTA_WRITE_WORDS) {
+        return -1;
+    }
+
+    memcpy(fuota_words, (const void *)start, words * 4);
+    memcpy((uint8_t *)fuota_words + ((AMOTA_INT_FLASH_OTA_ADDRESS + addr) & 0x03),
+           data, size);
+
+    if (am_hal_flash_program_main(AM_HAL_FLASH_PROGRAM_KEY, fuota_words,
+                                  (uint32_t *)start, words) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int8_t FragDecoderRead(uint32_t addr, uint8_t *data, uint32_t size)
+{
+    if (addr + size > AMOTA_INT_FLASH_OTA_MAX_SIZE) {
+        return -1;
+    }
+
+    memcpy(data, (const void *)(AMOTA_INT_FLASH_OTA_ADDRESS + addr), size);
+
+    return 0;
+}
+
+static void OnFragProgress(uint16_t fragCounter, uint16_t fragNb,
+                           uint8_t fragSize, uint16_t fragNbLost)
+{
+    am_util_stdio_printf("\r\nFUOTA: %d/%d fragments, %d lost\r\n",
+                         fragCounter, fragNb, fragNbLost);
+}
+
+static void OnFragDone(int32_t status, uint32_t size)
+{
+    const uint8_t *image = (const uint8_t *)AMOTA_INT_FLASH_OTA_ADDRESS;
+
+    memset(fuota_erased, 0, sizeof(fuota_erased));
+
+    if (status < 0) {
+        am_util_stdio_printf("\r\nFUOTA: session failed\r\n");
+        return;
+    }
+
+    am_util_stdio_printf("\r\nFUOTA: received %d bytes\r\n", size);
+
+    // hand the image over to the secure bootloader the same way AMOTA
+    // does, the image header is validated again on the next boot
+    am_hal_ota_init(AM_HAL_FLASH_PROGRAM_KEY, (uint32_t *)OTA_POINTER_LOCATION);
+    if (am_hal_ota_add(AM_HAL_FLASH_PROGRAM_KEY, image[3],
+                       (uint32_t *)AMOTA_INT_FLASH_OTA_ADDRESS) != 0) {
+        am_util_stdio_printf("\r\nFUOTA: invalid image\r\n");
+        return;
+    }
+
+    reboot_scheduled_at = TimerGetCurrentTime();
+    reboot_pending = true;
+}
+
+void lorawan_fuota_setup()
+{
+#if (FRAG_DECODER_FILE_HANDLING_NEW_API == 1)
+    LmhpFragmentationParams.DecoderCallbacks.FragDecoderWrite = FragDecoderWrite;
+    LmhpFragmentationParams.DecoderCallbacks.FragDecoderRead = FragDecoderRead;
+#else
+    LmhpFragmentationParams.FragDecoderWrite = FragDecoderWrite;
+    LmhpFragmentationParams.FragDecoderRead = FragDecoderRead;
+#endif
+    LmhpFragmentationParams.OnProgress = OnFragProgress;
+    LmhpFragmentationParams.OnDone = OnFragDone;
+
+    memset(fuota_erased, 0, sizeof(fuota_erased));
+
+    LmHandlerPackageRegister(PACKAGE_ID_CLOCK_SYNC, NULL);
+    LmHandlerPackageRegister(PACKAGE_ID_REMOTE_MCAST_SETUP, NULL);
+    LmHandlerPackageRegister(PACKAGE_ID_FRAGMENTATION, &LmhpFragmentationParams);
+}
+
+// The fragmentation package does not tell when a new FragSession is set
+// up, the request is picked out of the downlink so that the pages written
+// by an abandoned session are erased again before they are reused.
+void lorawan_fuota_rx(LmHandlerAppData_t *appData)
+{
+    uint8_t i = 0;
+
+    while (i < appData->BufferSize) {
+        uint8_t cid = appData->Buffer[i++];
+
+        if (cid == FUOTA_FRAG_SESSION_SETUP_REQ) {
+            memset(fuota_erased, 0, sizeof(fuota_erased));
+            return;
+        }
+
+        if (cid >= sizeof(fuota_frag_request_length)) {
+            return;
+        }
+        i += fuota_frag_request_length[cid];
+    }
+}
+
+void lorawan_fuota_process()
+{
+    if (reboot_pending) {
+        // give the fragmentation package time to answer the server
+        if (TimerGetElapsedTime(reboot_scheduled_at) >= LORAWAN_FUOTA_REBOOT_DELAY) {
+            am_hal_reset_control(AM_HAL_RESET_CONTROL_SWPOI, 0);
+        }
+        return;
+    }
+
+    if (!clock_sync_pending || (LmHandlerIsBusy() == true)) {
+        return;
+    }
+
+    if (LmhpClockSyncAppTimeReq() == LORAMAC_HANDLER_SUCCESS) {
+        clock_sync_pending = false;
+    }
+}
+
+void lorawan_fuota_joined()
+{
+    clock_sync_pending = true;
+}
+
+void lorawan_fuota_time_sync(bool isSynchronized)
+{
+    if (!isSynchronized) {
+        clock_sync_pending = true;
+    }
+}
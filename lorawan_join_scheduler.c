@@ -0,0 +1,295 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_mcu_apollo.h>
+#include <am_util.h>
+#include <am_bootloader.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+#include <utilities.h>
+
+#include "lorawan.h"
+#include "lorawan_config.h"
+#include "lorawan_join_scheduler.h"
+
+#define JOIN_RECORD_MAGIC     0x4A4F494E
+#define JOIN_RECORD_WORDS     (sizeof(join_record_t) / sizeof(uint32_t))
+#define JOIN_RECORD_SLOTS     (AM_HAL_FLASH_PAGE_SIZE / sizeof(join_record_t))
+#define JOIN_SUBBAND_COUNT    8
+
+#define JOIN_DC_WINDOW_1      (3600UL * 1000)
+#define JOIN_DC_WINDOW_2      (11UL * 3600 * 1000)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t subband;
+    uint32_t reserved;
+    uint32_t crc;
+} join_record_t;
+
+static bool        join_pending;
+static TimerTime_t join_scheduled_at;
+static uint32_t    join_delay;
+static TimerTime_t join_first_attempt;
+static uint32_t    join_attempts;
+static uint32_t    join_sweep;
+static uint8_t     join_subband;
+
+static uint8_t  learned_subband = LORAWAN_JOIN_SUBBAND_UNKNOWN;
+static uint32_t record_slot;
+
+static bool join_region_has_subbands()
+{
+    return (ACTIVE_REGION == LORAMAC_REGION_US915) ||
+           (ACTIVE_REGION == LORAMAC_REGION_AU915);
+}
+
+static void join_record_load()
+{
+    const join_record_t *records =
+        (const join_record_t *)LORAWAN_JOIN_NVM_ADDRESS;
+
+    for (record_slot = 0; record_slot < JOIN_RECORD_SLOTS; record_slot++) {
+        const join_record_t *r = &records[record_slot];
+
+        if (r->magic == 0xFFFFFFFF) {
+            break;
+        }
+
+        if ((r->magic == JOIN_RECORD_MAGIC) &&
+            (r->crc == am_bootloader_fast_crc32(r, offsetof(join_record_t, crc))) &&
+            (r->subband < JOIN_SUBBAND_COUNT)) {
+            learned_subband = r->subband;
+        }
+    }
+}
+
+static void join_record_store()
+{
+    join_record_t record;
+
+    // records are appended until the page is full so the page is only
+    // erased once every JOIN_RECORD_SLOTS sub-band changes
+    if (record_slot >= JOIN_RECORD_SLOTS) {
+        am_hal_flash_page_erase(
+            AM_HAL_FLASH_PROGRAM_KEY,
+            AM_HAL_FLASH_ADDR2INST(LORAWAN_JOIN_NVM_ADDRESS),
+            AM_HAL_FLASH_ADDR2PAGE(LORAWAN_JOIN_NVM_ADDRESS));
+        record_slot = 0;
+    }
+
+    record.magic = JOIN_RECORD_MAGIC;
+    record.subband = learned_subband;
+    record.reserved = 0xFFFFFFFF;
+    record.crc = am_bootloader_fast_crc32(&record, offsetof(join_record_t, crc));
+
+    am_hal_flash_program_main(
+        AM_HAL_FLASH_PROGRAM_KEY, (uint32_t *)&record,
+        (uint32_t *)(LORAWAN_JOIN_NVM_ADDRESS +
+                     record_slot * sizeof(join_record_t)),
+        JOIN_RECORD_WORDS);
+    record_slot++;
+}
+
+static void join_apply_subband(uint8_t subband)
+{
+    MibRequestConfirm_t mibReq;
+    uint16_t channelsMask[6] = {0};
+
+    // each sub-band is eight 125 kHz channels plus one 500 kHz channel
+    channelsMask[subband >> 1] = 0x00FF << ((subband & 0x01) * 8);
+    channelsMask[4] = 1 << subband;
+
+    mibReq.Type = MIB_CHANNELS_DEFAULT_MASK;
+    mibReq.Param.ChannelsDefaultMask = channelsMask;
+    LoRaMacMibSetRequestConfirm(&mibReq);
+
+    mibReq.Type = MIB_CHANNELS_MASK;
+    mibReq.Param.ChannelsMask = channelsMask;
+    LoRaMacMibSetRequestConfirm(&mibReq);
+}
+
+static uint32_t join_sweep_length()
+{
+    if (learned_subband == LORAWAN_JOIN_SUBBAND_UNKNOWN) {
+        return JOIN_SUBBAND_COUNT * LORAWAN_JOIN_SUBBAND_ATTEMPTS;
+    }
+
+    return 2 * (JOIN_SUBBAND_COUNT - 1) * LORAWAN_JOIN_SUBBAND_ATTEMPTS;
+}
+
+static uint8_t join_sweep_subband(uint32_t position)
+{
+    // stay on each sub-band long enough to try both the 125 kHz and the
+    // 500 kHz join channels before moving on
+    if (learned_subband == LORAWAN_JOIN_SUBBAND_UNKNOWN) {
+        return (LORAWAN_JOIN_DEFAULT_SUBBAND +
+                position / LORAWAN_JOIN_SUBBAND_ATTEMPTS) % JOIN_SUBBAND_COUNT;
+    }
+
+    // every other attempt goes to the learned sub-band, the ones in between
+    // look for the network on the other sub-bands in turn
+    if ((position & 1) == 0) {
+        return learned_subband;
+    }
+
+    return (learned_subband + 1 +
+            position / (2 * LORAWAN_JOIN_SUBBAND_ATTEMPTS)) % JOIN_SUBBAND_COUNT;
+}
+
+static uint32_t join_backoff_delay()
+{
+    uint32_t exponent;
+    uint32_t delay;
+    uint32_t off_time;
+    TimerTime_t elapsed;
+
+    // back off within a sweep of the sub-bands and start over with the
+    // next one, so a network that comes back is found within a sweep and
+    // the long-term rate is set by the duty cycle limit below
+    if (join_region_has_subbands()) {
+        exponent = join_sweep / (2 * LORAWAN_JOIN_SUBBAND_ATTEMPTS);
+    } else {
+        exponent = join_attempts / LORAWAN_JOIN_SUBBAND_ATTEMPTS;
+    }
+
+    if (exponent > 16) {
+        exponent = 16;
+    }
+
+    delay = (uint32_t)LORAWAN_JOIN_BACKOFF_MIN << exponent;
+    if (delay > LORAWAN_JOIN_BACKOFF_MAX) {
+        delay = LORAWAN_JOIN_BACKOFF_MAX;
+    }
+
+    // randomize over the upper half of the window so that devices that
+    // lost the network at the same time do not retry in lock step
+    delay = delay / 2 + randr(0, delay / 2);
+
+    // aggregated join-request duty cycle from the LoRaWAN 1.0.3
+    // retransmission back-off rules: 1% in the first hour, 0.1% for
+    // the next ten hours and 0.01% afterwards
+    elapsed = TimerGetElapsedTime(join_first_attempt);
+    if (elapsed < JOIN_DC_WINDOW_1) {
+        off_time = LORAWAN_JOIN_TIME_ON_AIR * 99;
+    } else if (elapsed < JOIN_DC_WINDOW_2) {
+        off_time = LORAWAN_JOIN_TIME_ON_AIR * 999;
+    } else {
+        off_time = LORAWAN_JOIN_TIME_ON_AIR * 9999;
+    }
+
+    return delay > off_time ? delay : off_time;
+}
+
+static void join_schedule(uint32_t delay)
+{
+    join_scheduled_at = TimerGetCurrentTime();
+    join_delay = delay;
+    join_pending = true;
+}
+
+void lorawan_join_scheduler_init()
+{
+    join_pending = false;
+    join_attempts = 0;
+
+    join_record_load();
+}
+
+void lorawan_join_scheduler_start()
+{
+    join_attempts = 0;
+    join_sweep = 0;
+    join_subband = join_sweep_subband(join_sweep);
+    join_first_attempt = TimerGetCurrentTime();
+    join_schedule(0);
+}
+
+void lorawan_join_scheduler_process()
+{
+    if (!join_pending) {
+        return;
+    }
+
+    if (TimerGetElapsedTime(join_scheduled_at) < join_delay) {
+        lorawan_wake_in(join_delay - TimerGetElapsedTime(join_scheduled_at));
+        return;
+    }
+
+    if (LmHandlerIsBusy() == true) {
+        return;
+    }
+
+    join_pending = false;
+    join_attempts++;
+
+    if (join_region_has_subbands()) {
+        join_apply_subband(join_subband);
+    }
+
+    LmHandlerJoin();
+}
+
+void lorawan_join_scheduler_result(bool joined)
+{
+    if (joined) {
+        join_pending = false;
+
+        if (join_region_has_subbands() && (join_subband != learned_subband)) {
+            learned_subband = join_subband;
+            join_record_store();
+        }
+        return;
+    }
+
+    if (join_region_has_subbands()) {
+        join_sweep = (join_sweep + 1) % join_sweep_length();
+        join_subband = join_sweep_subband(join_sweep);
+    }
+
+    join_schedule(join_backoff_delay());
+}
+
+uint8_t lorawan_join_scheduler_subband()
+{
+    return learned_subband;
+}
+
+uint32_t lorawan_join_scheduler_attempts()
+{
+    return join_attempts;
+}
@@ -0,0 +1,424 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <am_bootloader.h>
+#include <am_mcu_apollo.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <LmHandler.h>
+
+#include "lorawan.h"
+#include "lorawan_budget.h"
+#include "lorawan_config.h"
+#include "lorawan_journal.h"
+#include "lorawan_mac_request.h"
+
+// The journal is a ring of flash pages, each starting with a sequence
+// number so that the newest and the oldest page are found from the page
+// headers alone at boot.  Records are appended with their state word left
+// erased and are marked consumed by programming it to zero once sent.  The
+// CRC covering the record follows the payload so that it is programmed
+// last.
+//
+// Producers only copy into a RAM staging ring; records are programmed and
+// pages erased by the LoRaWAN task.
+#define JOURNAL_PAGE_MAGIC    0x4C4A524E
+#define JOURNAL_RECORD_MARKER 0x5AA5
+#define JOURNAL_ERASED        0xFFFFFFFF
+#define JOURNAL_CONSUMED      0x00000000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+} journal_page_t;
+
+typedef struct {
+    uint32_t state;
+    uint8_t  length;
+    uint8_t  port;
+    uint16_t marker;
+} journal_record_t;
+
+#define JOURNAL_PAYLOAD_SIZE(length) (((length) + 3) & ~0x03)
+#define JOURNAL_RECORD_SIZE(length) \
+    (sizeof(journal_record_t) + JOURNAL_PAYLOAD_SIZE(length) + sizeof(uint32_t))
+#define JOURNAL_RECORD_WORDS \
+    (JOURNAL_RECORD_SIZE(LORAWAN_APP_DATA_BUFFER_MAX_SIZE) / 4)
+#define JOURNAL_STAGING_MASK (LORAWAN_JOURNAL_STAGING - 1)
+
+static uint8_t  staging[LORAWAN_JOURNAL_STAGING];
+static uint32_t staging_head;
+static uint32_t staging_tail;
+static uint32_t journal_words[JOURNAL_RECORD_WORDS];
+
+static uint32_t write_page;
+static uint32_t write_offset;
+static uint32_t write_sequence;
+static uint32_t read_page;
+static uint32_t read_offset;
+
+static volatile bool journal_online;
+static volatile bool journal_backlog;
+
+static lorawan_journal_stats_t journal_stats;
+
+static uint32_t journal_address(uint32_t page, uint32_t offset)
+{
+    return LORAWAN_JOURNAL_FLASH_ADDRESS + page * AM_HAL_FLASH_PAGE_SIZE +
+           offset;
+}
+
+static const journal_record_t *journal_record(uint32_t page, uint32_t offset)
+{
+    return (const journal_record_t *)journal_address(page, offset);
+}
+
+static uint32_t journal_marker_word(const journal_record_t *r)
+{
+    return *((const uint32_t *)r + 1);
+}
+
+static uint32_t *journal_crc_word(const journal_record_t *r)
+{
+    return (uint32_t *)((const uint8_t *)(r + 1) +
+                        JOURNAL_PAYLOAD_SIZE(r->length));
+}
+
+static uint32_t journal_crc(const journal_record_t *r)
+{
+    return am_bootloader_fast_crc32(
+        &r->length, sizeof(journal_record_t) -
+                        offsetof(journal_record_t, length) + r->length);
+}
+
+static void journal_page_start(uint32_t page, uint32_t sequence)
+{
+    uint32_t address = journal_address(page, 0);
+    journal_page_t header = {JOURNAL_PAGE_MAGIC, sequence};
+
+    am_hal_flash_page_erase(AM_HAL_FLASH_PROGRAM_KEY,
+                            AM_HAL_FLASH_ADDR2INST(address),
+                            AM_HAL_FLASH_ADDR2PAGE(address));
+    am_hal_flash_program_main(AM_HAL_FLASH_PROGRAM_KEY, (uint32_t *)&header,
+                              (uint32_t *)address,
+                              sizeof(header) / sizeof(uint32_t));
+}
+
+static void journal_recover()
+{
+    const journal_page_t *header;
+    uint32_t oldest = 0;
+    bool found = false;
+
+    for (uint32_t page = 0; page < LORAWAN_JOURNAL_PAGES; page++) {
+        header = (const journal_page_t *)journal_address(page, 0);
+        if (header->magic != JOURNAL_PAGE_MAGIC) {
+            continue;
+        }
+        if (!found || ((int32_t)(header->sequence - write_sequence) > 0)) {
+            write_page = page;
+            write_sequence = header->sequence;
+        }
+        if (!found || ((int32_t)(header->sequence - oldest) < 0)) {
+            read_page = page;
+            oldest = header->sequence;
+        }
+        found = true;
+    }
+
+    if (!found) {
+        write_page = 0;
+        write_sequence = 0;
+        read_page = 0;
+        journal_page_start(0, 0);
+    }
+
+    // only the newest page is walked to find the end of the journal
+    write_offset = sizeof(journal_page_t);
+    while (write_offset + sizeof(journal_record_t) <= AM_HAL_FLASH_PAGE_SIZE) {
+        const journal_record_t *r = journal_record(write_page, write_offset);
+
+        if (journal_marker_word(r) == JOURNAL_ERASED) {
+            break;
+        }
+        if (r->marker != JOURNAL_RECORD_MARKER) {
+            write_offset = AM_HAL_FLASH_PAGE_SIZE;
+            break;
+        }
+        write_offset += JOURNAL_RECORD_SIZE(r->length);
+    }
+    if (write_offset > AM_HAL_FLASH_PAGE_SIZE) {
+        write_offset = AM_HAL_FLASH_PAGE_SIZE;
+    }
+
+    read_offset = sizeof(journal_page_t);
+    journal_backlog = (read_page != write_page) || (read_offset < write_offset);
+}
+
+static void journal_commit(uint32_t size)
+{
+    uint32_t next;
+
+    if (write_offset + size > AM_HAL_FLASH_PAGE_SIZE) {
+        next = (write_page + 1) % LORAWAN_JOURNAL_PAGES;
+        if (next == read_page) {
+            // the ring is full, the oldest page is given up
+            journal_stats.pages_lost++;
+            read_page = (read_page + 1) % LORAWAN_JOURNAL_PAGES;
+            read_offset = sizeof(journal_page_t);
+        }
+        write_sequence++;
+        journal_page_start(next, write_sequence);
+        write_page = next;
+        write_offset = sizeof(journal_page_t);
+    }
+
+    am_hal_flash_program_main(
+        AM_HAL_FLASH_PROGRAM_KEY, journal_words,
+        (uint32_t *)journal_address(write_page, write_offset),
+        size / sizeof(uint32_t));
+    write_offset += size;
+}
+
+static void staging_read(uint32_t position, uint8_t *data, uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = staging[(position + i) & JOURNAL_STAGING_MASK];
+    }
+}
+
+static void staging_write(uint32_t position, const uint8_t *data,
+                          uint32_t length)
+{
+    for (uint32_t i = 0; i < length; i++) {
+        staging[(position + i) & JOURNAL_STAGING_MASK] = data[i];
+    }
+}
+
+// Moves the staged records to flash.  Only the LoRaWAN task advances the
+// tail so the records are copied out without holding off the producers.
+static void staging_drain()
+{
+    journal_record_t *r = (journal_record_t *)journal_words;
+    uint32_t head;
+
+    while (1) {
+        taskENTER_CRITICAL();
+        head = staging_head;
+        taskEXIT_CRITICAL();
+
+        if (staging_tail == head) {
+            break;
+        }
+
+        memset(journal_words, 0xFF, sizeof(journal_words));
+        staging_read(staging_tail, &r->length, 2);
+        staging_read(staging_tail + 2, (uint8_t *)(r + 1), r->length);
+        r->state = JOURNAL_ERASED;
+        r->marker = JOURNAL_RECORD_MARKER;
+        *journal_crc_word(r) = journal_crc(r);
+
+        journal_commit(JOURNAL_RECORD_SIZE(r->length));
+
+        taskENTER_CRITICAL();
+        staging_tail += 2 + r->length;
+        taskEXIT_CRITICAL();
+    }
+}
+
+// Returns the oldest record not sent yet.  The read cursor skips at most
+// LORAWAN_JOURNAL_SCAN_LIMIT consumed or damaged records per call so that
+// a long consumed journal after boot is worked through over several
+// iterations of the task.
+static const journal_record_t *journal_next()
+{
+    const journal_record_t *r;
+
+    for (uint32_t n = 0; n < LORAWAN_JOURNAL_SCAN_LIMIT; n++) {
+        if ((read_page == write_page) && (read_offset >= write_offset)) {
+            taskENTER_CRITICAL();
+            journal_backlog = (staging_tail != staging_head);
+            taskEXIT_CRITICAL();
+            return NULL;
+        }
+
+        r = journal_record(read_page, read_offset);
+        if ((read_offset + sizeof(journal_record_t) > AM_HAL_FLASH_PAGE_SIZE) ||
+            (r->marker != JOURNAL_RECORD_MARKER) ||
+            (read_offset + JOURNAL_RECORD_SIZE(r->length) >
+             AM_HAL_FLASH_PAGE_SIZE)) {
+            if ((read_offset + sizeof(journal_record_t) <=
+                 AM_HAL_FLASH_PAGE_SIZE) &&
+                (journal_marker_word(r) != JOURNAL_ERASED)) {
+                journal_stats.corrupt++;
+            }
+            read_page = (read_page + 1) % LORAWAN_JOURNAL_PAGES;
+            read_offset = sizeof(journal_page_t);
+            continue;
+        }
+
+        if (r->state == JOURNAL_ERASED) {
+            if (*journal_crc_word(r) == journal_crc(r)) {
+                return r;
+            }
+            journal_stats.corrupt++;
+        }
+        read_offset += JOURNAL_RECORD_SIZE(r->length);
+    }
+
+    return NULL;
+}
+
+// Records staged before the LoRaWAN task starts are kept.
+void lorawan_journal_init()
+{
+    journal_recover();
+}
+
+// Uplinks go to the journal while the device is not joined and until the
+// journal has been drained so that they are sent in order.
+bool lorawan_journal_active()
+{
+    return !journal_online || journal_backlog;
+}
+
+bool lorawan_journal_append(const lorawan_transaction_t *transaction)
+{
+    uint8_t header[2];
+    bool stored = false;
+
+    header[0] = transaction->length;
+    header[1] = transaction->port;
+
+    taskENTER_CRITICAL();
+    if ((transaction->length <= LORAWAN_APP_DATA_BUFFER_MAX_SIZE) &&
+        (LORAWAN_JOURNAL_STAGING - (staging_head - staging_tail) >=
+         2 + transaction->length)) {
+        staging_write(staging_head, header, 2);
+        staging_write(staging_head + 2, transaction->buffer,
+                      transaction->length);
+        staging_head += 2 + transaction->length;
+        journal_backlog = true;
+        journal_stats.appended++;
+        stored = true;
+    } else {
+        journal_stats.dropped++;
+    }
+    taskEXIT_CRITICAL();
+
+    return stored;
+}
+
+void lorawan_journal_process()
+{
+    journal_online = (LmHandlerJoinStatus() == LORAMAC_HANDLER_SET);
+    staging_drain();
+}
+
+// Sends the oldest journal record, called when the transmit queue is
+// empty.  Records go out back to back as fast as the MAC and the airtime
+// budget allow.
+bool lorawan_journal_send()
+{
+    const journal_record_t *r;
+    LmHandlerAppData_t appData;
+    uint32_t consumed = JOURNAL_CONSUMED;
+    uint32_t attached;
+    LmHandlerErrorStatus_t status;
+    uint8_t fit;
+
+    if (!journal_online || (LmHandlerIsBusy() == true)) {
+        return false;
+    }
+
+    r = journal_next();
+    if ((r == NULL) || lorawan_budget_hold(r->length)) {
+        return false;
+    }
+
+    fit = lorawan_payload_check(r->length);
+    if (fit == LORAWAN_PAYLOAD_DEFERRED) {
+        return false;
+    }
+
+    appData.Port = r->port;
+    appData.BufferSize = r->length;
+    appData.Buffer = (uint8_t *)(r + 1);
+
+    // a record the datarate cannot carry would hold up the journal
+    if (fit == LORAWAN_PAYLOAD_TOO_LONG) {
+        am_hal_flash_program_main(AM_HAL_FLASH_PROGRAM_KEY, &consumed,
+                                  (uint32_t *)&r->state, 1);
+        read_offset += JOURNAL_RECORD_SIZE(r->length);
+        journal_stats.dropped++;
+        return false;
+    }
+
+    attached = lorawan_mac_request_attach();
+    status = LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
+    lorawan_mac_request_sent(attached, status);
+    if (status != LORAMAC_HANDLER_SUCCESS) {
+        return false;
+    }
+
+    am_hal_flash_program_main(AM_HAL_FLASH_PROGRAM_KEY, &consumed,
+                              (uint32_t *)&r->state, 1);
+    read_offset += JOURNAL_RECORD_SIZE(r->length);
+    journal_stats.sent++;
+
+    return true;
+}
+
+void lorawan_journal_status(lorawan_journal_status_t *status)
+{
+    taskENTER_CRITICAL();
+    status->write_page = write_page;
+    status->write_offset = write_offset;
+    status->read_page = read_page;
+    status->read_offset = read_offset;
+    status->staged = staging_head - staging_tail;
+    status->backlog = journal_backlog;
+    taskEXIT_CRITICAL();
+}
+
+void lorawan_journal_stats(lorawan_journal_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = journal_stats;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,65 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_JOURNAL_H_
+#define _LORAWAN_JOURNAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lorawan.h"
+
+typedef struct {
+    uint32_t appended;
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t pages_lost;
+    uint32_t corrupt;
+} lorawan_journal_stats_t;
+
+typedef struct {
+    uint32_t write_page;
+    uint32_t write_offset;
+    uint32_t read_page;
+    uint32_t read_offset;
+    uint32_t staged;
+    bool     backlog;
+} lorawan_journal_status_t;
+
+extern void lorawan_journal_init();
+extern bool lorawan_journal_active();
+extern bool lorawan_journal_append(const lorawan_transaction_t *transaction);
+extern void lorawan_journal_process();
+extern bool lorawan_journal_send();
+extern void lorawan_journal_status(lorawan_journal_status_t *status);
+extern void lorawan_journal_stats(lorawan_journal_stats_t *stats);
+
+#endif /* _LORAWAN_JOURNAL_H_ */
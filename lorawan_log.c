@@ -0,0 +1,196 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <am_mcu_apollo.h>
+
+#include <LmHandler.h>
+#include <LmHandlerMsgDisplay.h>
+
+#include "lorawan_config.h"
+#include "lorawan_log.h"
+#include "token_log.h"
+
+// Logging of the MAC callbacks, either as token records or through the
+// LoRaMac-node Display functions.  Each call is timed with the cycle
+// counter to show how long it holds the LoRaWAN task; the host simulation
+// has no cycle counter and reports zero.
+#ifdef DWT
+#define LOG_CYCLES()       (DWT->CYCCNT)
+#define LOG_CYCLES_PER_US  AM_HAL_CLKGEN_FREQ_MAX_MHZ
+#else
+#define LOG_CYCLES()       0
+#define LOG_CYCLES_PER_US  1
+#endif
+
+static lorawan_log_stats_t log_stats;
+
+static void log_hold(uint32_t start)
+{
+    uint32_t cycles = LOG_CYCLES() - start;
+
+    log_stats.calls++;
+    log_stats.hold_total += cycles;
+    if (cycles > log_stats.hold_max) {
+        log_stats.hold_max = cycles;
+    }
+}
+
+void lorawan_log_init()
+{
+#ifdef DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    memset(&log_stats, 0, sizeof(log_stats));
+}
+
+void lorawan_log_stats(lorawan_log_stats_t *stats)
+{
+    stats->calls = log_stats.calls;
+    stats->hold_max = log_stats.hold_max / LOG_CYCLES_PER_US;
+    stats->hold_total = log_stats.hold_total / LOG_CYCLES_PER_US;
+}
+
+void lorawan_log_nvm(LmHandlerNvmContextStates_t state, uint16_t size)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    TOKEN_LOG("nvm: %c %d bytes",
+              state == LORAMAC_HANDLER_NVM_STORE ? 's' : 'r', size);
+#else
+    DisplayNvmDataChange(state, size);
+#endif
+    log_hold(start);
+}
+
+void lorawan_log_mcps(LoRaMacStatus_t status, McpsReq_t *mcpsReq,
+                      TimerTime_t nextTxIn)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    TOKEN_LOG("mcps: type %d, status %d, next tx in %u ms", mcpsReq->Type,
+              status, nextTxIn);
+#else
+    DisplayMacMcpsRequestUpdate(status, mcpsReq, nextTxIn);
+#endif
+    log_hold(start);
+}
+
+void lorawan_log_mlme(LoRaMacStatus_t status, MlmeReq_t *mlmeReq,
+                      TimerTime_t nextTxIn)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    TOKEN_LOG("mlme: type %d, status %d, next tx in %u ms", mlmeReq->Type,
+              status, nextTxIn);
+#else
+    DisplayMacMlmeRequestUpdate(status, mlmeReq, nextTxIn);
+#endif
+    log_hold(start);
+}
+
+void lorawan_log_join(LmHandlerJoinParams_t *params)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    TOKEN_LOG("join: status %d, dr %d", params->Status, params->Datarate);
+#else
+    DisplayJoinRequestUpdate(params);
+#endif
+    log_hold(start);
+}
+
+void lorawan_log_tx(LmHandlerTxParams_t *params)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    if (params->IsMcpsConfirm != 0) {
+        TOKEN_LOG("tx: uplink %u, status %d, port %d, %d bytes, dr %d, "
+                  "power %d, channel %d, ack %d",
+                  params->UplinkCounter, params->Status, params->AppData.Port,
+                  params->AppData.BufferSize, params->Datarate,
+                  params->TxPower, params->Channel, params->AckReceived);
+    }
+#else
+    DisplayTxUpdate(params);
+#endif
+    log_hold(start);
+}
+
+void lorawan_log_rx(LmHandlerAppData_t *appData, LmHandlerRxParams_t *params)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    if (params->IsMcpsIndication != 0) {
+        TOKEN_LOG("rx: downlink %u, status %d, port %d, %d bytes, dr %d, "
+                  "rssi %d, snr %d, slot %d",
+                  params->DownlinkCounter, params->Status, appData->Port,
+                  appData->BufferSize, params->Datarate, params->Rssi,
+                  params->Snr, params->RxSlot);
+    }
+#else
+    DisplayRxUpdate(appData, params);
+#endif
+    log_hold(start);
+}
+
+void lorawan_log_class(DeviceClass_t deviceClass)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    TOKEN_LOG("class: %c", 'A' + deviceClass);
+#else
+    DisplayClassUpdate(deviceClass);
+#endif
+    log_hold(start);
+}
+
+void lorawan_log_beacon(LoRaMAcHandlerBeaconParams_t *params)
+{
+    uint32_t start = LOG_CYCLES();
+
+#if LORAWAN_TOKEN_LOG
+    TOKEN_LOG("beacon: state %d", params->State);
+#else
+    DisplayBeaconUpdate(params);
+#endif
+    log_hold(start);
+}
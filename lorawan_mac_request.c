@@ -0,0 +1,194 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+
+#include "lorawan.h"
+#include "lorawan_budget.h"
+#include "lorawan_config.h"
+#include "lorawan_mac_request.h"
+
+// MAC requests are held until the next application uplink so that they
+// travel in its FOpts instead of costing a frame of their own.  An empty
+// frame is only sent once the earliest deadline of the pending requests
+// has passed.  LORAWAN_MAC_REQUEST_UPLINK carries no command and is
+// satisfied by any uplink, it is used to open a downlink opportunity.
+
+static volatile uint32_t request_pending;
+static TimerTime_t request_deadline;
+static lorawan_mac_request_stats_t request_stats;
+
+void lorawan_mac_request_init()
+{
+    request_pending = 0;
+    memset(&request_stats, 0, sizeof(request_stats));
+}
+
+void lorawan_mac_request(uint32_t requests, uint32_t deadline)
+{
+    TimerTime_t due = TimerGetCurrentTime() + deadline;
+
+    taskENTER_CRITICAL();
+    if ((request_pending == 0) || ((int32_t)(due - request_deadline) < 0)) {
+        request_deadline = due;
+    }
+    request_pending |= requests;
+    request_stats.requested++;
+    taskEXIT_CRITICAL();
+}
+
+static uint32_t request_attach()
+{
+    uint32_t pending;
+    uint32_t attached = 0;
+
+    taskENTER_CRITICAL();
+    pending = request_pending;
+    taskEXIT_CRITICAL();
+
+    if ((pending & LORAWAN_MAC_REQUEST_LINK_CHECK) &&
+        (LmHandlerLinkCheckReq() == LORAMAC_HANDLER_SUCCESS)) {
+        attached |= LORAWAN_MAC_REQUEST_LINK_CHECK;
+    }
+    if ((pending & LORAWAN_MAC_REQUEST_DEVICE_TIME) &&
+        (LmHandlerDeviceTimeReq() == LORAMAC_HANDLER_SUCCESS)) {
+        attached |= LORAWAN_MAC_REQUEST_DEVICE_TIME;
+    }
+    attached |= pending & LORAWAN_MAC_REQUEST_UPLINK;
+
+    taskENTER_CRITICAL();
+    request_pending &= ~attached;
+    taskEXIT_CRITICAL();
+
+    return attached;
+}
+
+static void request_repend(uint32_t attached)
+{
+    taskENTER_CRITICAL();
+    if (request_pending == 0) {
+        request_deadline = TimerGetCurrentTime() + LORAWAN_MAC_REQUEST_RETRY;
+    }
+    request_pending |= attached;
+    taskEXIT_CRITICAL();
+}
+
+// Called right before an application uplink is handed to LmHandlerSend,
+// the returned requests go to lorawan_mac_request_sent() with its result.
+// Requests the MAC rejects stay pending for the next uplink.
+uint32_t lorawan_mac_request_attach()
+{
+    if (request_pending == 0) {
+        return 0;
+    }
+
+    return request_attach();
+}
+
+// Requests that went out with an uplink the MAC did not send are pending
+// again, the commands are asked for anew with the next uplink.
+void lorawan_mac_request_sent(uint32_t attached, LmHandlerErrorStatus_t status)
+{
+    if (attached == 0) {
+        return;
+    }
+
+    if (status == LORAMAC_HANDLER_SUCCESS) {
+        request_stats.piggybacked++;
+    } else {
+        request_repend(attached);
+    }
+}
+
+void lorawan_mac_request_process()
+{
+    LmHandlerAppData_t appData = {.Buffer = NULL, .BufferSize = 0, .Port = 0};
+    uint32_t attached;
+
+    if (request_pending == 0) {
+        return;
+    }
+
+    if ((int32_t)(TimerGetCurrentTime() - request_deadline) < 0) {
+        lorawan_wake_in(request_deadline - TimerGetCurrentTime());
+        return;
+    }
+
+    if ((LmHandlerIsBusy() == true) ||
+        (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET)) {
+        return;
+    }
+
+    // the empty frame costs airtime like any other
+    if (lorawan_budget_hold(0)) {
+        lorawan_wake_in(lorawan_time_until_tx(0));
+        return;
+    }
+
+    attached = request_attach();
+    if (LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG) ==
+        LORAMAC_HANDLER_SUCCESS) {
+        request_stats.standalone++;
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    request_pending |= attached;
+    request_deadline = TimerGetCurrentTime() + LORAWAN_MAC_REQUEST_RETRY;
+    taskEXIT_CRITICAL();
+}
+
+// FOpts bytes the pending requests add to the next uplink
+uint8_t lorawan_mac_request_length()
+{
+    uint32_t pending = request_pending;
+
+    return ((pending & LORAWAN_MAC_REQUEST_LINK_CHECK) ? 1 : 0) +
+           ((pending & LORAWAN_MAC_REQUEST_DEVICE_TIME) ? 1 : 0);
+}
+
+uint32_t lorawan_mac_request_pending()
+{
+    return request_pending;
+}
+
+void lorawan_mac_request_stats(lorawan_mac_request_stats_t *stats)
+{
+    memcpy(stats, &request_stats, sizeof(lorawan_mac_request_stats_t));
+}
@@ -0,0 +1,59 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_MAC_REQUEST_H_
+#define _LORAWAN_MAC_REQUEST_H_
+
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+#define LORAWAN_MAC_REQUEST_LINK_CHECK  0x01
+#define LORAWAN_MAC_REQUEST_DEVICE_TIME 0x02
+#define LORAWAN_MAC_REQUEST_UPLINK      0x04
+
+typedef struct {
+    uint32_t requested;
+    uint32_t piggybacked;
+    uint32_t standalone;
+} lorawan_mac_request_stats_t;
+
+extern void     lorawan_mac_request_init();
+extern void     lorawan_mac_request(uint32_t requests, uint32_t deadline);
+extern uint32_t lorawan_mac_request_attach();
+extern void     lorawan_mac_request_sent(uint32_t attached,
+                                         LmHandlerErrorStatus_t status);
+extern void     lorawan_mac_request_process();
+extern uint8_t  lorawan_mac_request_length();
+extern uint32_t lorawan_mac_request_pending();
+extern void     lorawan_mac_request_stats(lorawan_mac_request_stats_t *stats);
+
+#endif /* _LORAWAN_MAC_REQUEST_H_ */
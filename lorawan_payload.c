@@ -0,0 +1,338 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lorawan_payload.h"
+
+// Single pass decoder for console payloads.  A payload is text with \xNN
+// and \\ escapes, or raw hex after a "hex:" prefix, or base64 after a
+// "b64:" prefix.  It can be fed in chunks, an escape, a hex digit pair or
+// a base64 quantum may be split across them.  Output beyond the buffer
+// size and malformed input put the decoder in the error state.
+
+#define PAYLOAD_START      0
+#define PAYLOAD_DATA       1
+#define PAYLOAD_ESCAPE     2
+#define PAYLOAD_ESCAPE_HEX 3
+#define PAYLOAD_PAD        4
+#define PAYLOAD_DONE       5
+#define PAYLOAD_ERROR      6
+
+#define INVALID   0xFF
+#define BASE64_PAD 0x40
+
+static const uint8_t hex_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+static const uint8_t base64_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B,
+    0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0x40, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+    0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20,
+    0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30,
+    0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+void lorawan_payload_init(lorawan_payload_t *payload, uint8_t *buffer,
+                          uint32_t size)
+{
+    memset(payload, 0, sizeof(lorawan_payload_t));
+    payload->buffer = buffer;
+    payload->size = size;
+}
+
+static bool decode_text(lorawan_payload_t *p, const uint8_t *in,
+                        const uint8_t *end)
+{
+    uint8_t value;
+
+    while (in < end) {
+        uint8_t c = *in++;
+
+        switch (p->state) {
+        case PAYLOAD_DATA:
+            if (c == '\\') {
+                p->state = PAYLOAD_ESCAPE;
+                continue;
+            }
+            break;
+        case PAYLOAD_ESCAPE:
+            if (c == 'x') {
+                p->state = PAYLOAD_ESCAPE_HEX;
+                p->count = 0;
+                continue;
+            }
+            if (c != '\\') {
+                return false;
+            }
+            p->state = PAYLOAD_DATA;
+            break;
+        default:
+            value = hex_table[c];
+            if (value == INVALID) {
+                return false;
+            }
+            p->bits = (p->bits << 4) | value;
+            if (++p->count < 2) {
+                continue;
+            }
+            c = p->bits;
+            p->state = PAYLOAD_DATA;
+            break;
+        }
+
+        if (p->length >= p->size) {
+            return false;
+        }
+        p->buffer[p->length++] = c;
+    }
+
+    return true;
+}
+
+static bool decode_hex(lorawan_payload_t *p, const uint8_t *in,
+                       const uint8_t *end)
+{
+    uint8_t value;
+
+    while (in < end) {
+        value = hex_table[*in++];
+        if (value == INVALID) {
+            return false;
+        }
+        p->bits = (p->bits << 4) | value;
+        if (++p->count == 2) {
+            if (p->length >= p->size) {
+                return false;
+            }
+            p->buffer[p->length++] = p->bits;
+            p->count = 0;
+        }
+    }
+
+    return true;
+}
+
+static bool emit_base64(lorawan_payload_t *p, uint32_t count)
+{
+    if (p->length + count > p->size) {
+        return false;
+    }
+
+    // the first count bytes of the bits accumulated so far
+    for (uint32_t i = 0; i < count; i++) {
+        p->buffer[p->length++] = p->bits >> (6 * p->count - 8 * (i + 1));
+    }
+    p->count = 0;
+    p->bits = 0;
+
+    return true;
+}
+
+static bool decode_base64(lorawan_payload_t *p, const uint8_t *in,
+                          const uint8_t *end)
+{
+    uint8_t value;
+
+    while (in < end) {
+        value = base64_table[*in++];
+        if ((value == INVALID) || (p->state == PAYLOAD_DONE)) {
+            return false;
+        }
+
+        if (value == BASE64_PAD) {
+            if (p->state == PAYLOAD_PAD) {
+                p->state = PAYLOAD_DONE;
+            } else if (p->count == 2) {
+                p->state = PAYLOAD_PAD;
+                if (!emit_base64(p, 1)) {
+                    return false;
+                }
+            } else if (p->count == 3) {
+                p->state = PAYLOAD_DONE;
+                if (!emit_base64(p, 2)) {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+            continue;
+        }
+
+        if (p->state == PAYLOAD_PAD) {
+            return false;
+        }
+        p->bits = (p->bits << 6) | value;
+        if ((++p->count == 4) && !emit_base64(p, 3)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Decodes the next chunk of the payload, returns false once the payload
+// is malformed or does not fit.
+bool lorawan_payload_decode(lorawan_payload_t *payload, const char *in,
+                            uint32_t length)
+{
+    const uint8_t *start = (const uint8_t *)in;
+    const uint8_t *end = start + length;
+    bool valid;
+
+    if (payload->state == PAYLOAD_ERROR) {
+        return false;
+    }
+
+    if (payload->state == PAYLOAD_START) {
+        payload->format = LORAWAN_PAYLOAD_TEXT;
+        if ((length >= 4) && (memcmp(in, "hex:", 4) == 0)) {
+            payload->format = LORAWAN_PAYLOAD_HEX;
+            start += 4;
+        } else if ((length >= 4) && (memcmp(in, "b64:", 4) == 0)) {
+            payload->format = LORAWAN_PAYLOAD_BASE64;
+            start += 4;
+        }
+        payload->state = PAYLOAD_DATA;
+    }
+
+    switch (payload->format) {
+    case LORAWAN_PAYLOAD_HEX:
+        valid = decode_hex(payload, start, end);
+        break;
+    case LORAWAN_PAYLOAD_BASE64:
+        valid = decode_base64(payload, start, end);
+        break;
+    default:
+        valid = decode_text(payload, start, end);
+        break;
+    }
+
+    if (!valid) {
+        payload->state = PAYLOAD_ERROR;
+    }
+
+    return valid;
+}
+
+// Checks that the payload does not end in the middle of an escape, a hex
+// digit pair or a base64 quantum.  Unpadded base64 is accepted.
+bool lorawan_payload_finish(lorawan_payload_t *payload)
+{
+    switch (payload->state) {
+    case PAYLOAD_START:
+    case PAYLOAD_DONE:
+        return true;
+    case PAYLOAD_DATA:
+        break;
+    default:
+        return false;
+    }
+
+    if (payload->format == LORAWAN_PAYLOAD_TEXT) {
+        return true;
+    }
+    if (payload->format == LORAWAN_PAYLOAD_HEX) {
+        return payload->count == 0;
+    }
+
+    switch (payload->count) {
+    case 0:
+        return true;
+    case 2:
+        return emit_base64(payload, 1);
+    case 3:
+        return emit_base64(payload, 2);
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_PAYLOAD_H_
+#define _LORAWAN_PAYLOAD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    LORAWAN_PAYLOAD_TEXT,
+    LORAWAN_PAYLOAD_HEX,
+    LORAWAN_PAYLOAD_BASE64,
+} lorawan_payload_format_t;
+
+typedef struct {
+    uint8_t  *buffer;
+    uint32_t  size;
+    uint32_t  length;
+    uint8_t   format;
+    uint8_t   state;
+    uint8_t   count;
+    uint32_t  bits;
+} lorawan_payload_t;
+
+extern void lorawan_payload_init(lorawan_payload_t *payload, uint8_t *buffer,
+                                 uint32_t size);
+extern bool lorawan_payload_decode(lorawan_payload_t *payload, const char *in,
+                                   uint32_t length);
+extern bool lorawan_payload_finish(lorawan_payload_t *payload);
+
+#endif /* _LORAWAN_PAYLOAD_H_ */
@@ -0,0 +1,262 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <LmHandler.h>
+#include <timer.h>
+
+#include "lorawan_airtime.h"
+#include "lorawan_config.h"
+#include "lorawan_mac_request.h"
+#include "lorawan_rx_calibration.h"
+
+// The receive windows are widened by twice the max RX error.  Instead of a
+// fixed worst case, the error is derived from the drift of the RTC against
+// the network time, measured between two DeviceTime answers at least
+// LORAWAN_RX_CAL_SYNC_INTERVAL apart, over the longest receive delay.
+//
+// Downlinks received in RX1 or RX2 confirm the current error.  Confirmed
+// uplinks that go unanswered LORAWAN_RX_CAL_MISSES times in a row double
+// it, up to LORAWAN_RX_ERROR_MAX, and it walks back down towards the
+// target after LORAWAN_RX_CAL_RECOVERY downlinks.
+
+static lorawan_rx_calibration_t cal;
+
+static bool        sync_valid;
+static TimerTime_t sync_local;
+static uint64_t    sync_network;
+static bool        sync_requested;
+static TimerTime_t sync_requested_at;
+static uint32_t    drift_bound;
+static bool        drift_measured;
+static uint32_t    miss_streak;
+static uint32_t    hit_streak;
+
+static void rx_cal_apply(uint32_t rx_error)
+{
+    if (rx_error < LORAWAN_RX_ERROR_MIN) {
+        rx_error = LORAWAN_RX_ERROR_MIN;
+    }
+    if (rx_error > LORAWAN_RX_ERROR_MAX) {
+        rx_error = LORAWAN_RX_ERROR_MAX;
+    }
+
+    if ((rx_error != cal.rx_error) &&
+        (LmHandlerSetSystemMaxRxError(rx_error) == LORAMAC_HANDLER_SUCCESS)) {
+        cal.rx_error = rx_error;
+    }
+}
+
+void lorawan_rx_calibration_init()
+{
+    memset(&cal, 0, sizeof(cal));
+    sync_valid = false;
+    sync_requested = false;
+    drift_measured = false;
+    miss_streak = 0;
+    hit_streak = 0;
+
+    cal.target = LORAWAN_RX_ERROR_MAX;
+    LmHandlerSetSystemMaxRxError(LORAWAN_RX_ERROR_MAX);
+    cal.rx_error = LORAWAN_RX_ERROR_MAX;
+}
+
+void lorawan_rx_calibration_process()
+{
+    uint32_t interval = drift_measured ? LORAWAN_RX_CAL_RESYNC_INTERVAL
+                                       : LORAWAN_RX_CAL_SYNC_INTERVAL;
+
+    if (LmHandlerJoinStatus() != LORAMAC_HANDLER_SET) {
+        return;
+    }
+    if (sync_requested &&
+        (TimerGetElapsedTime(sync_requested_at) < LORAWAN_RX_CAL_SYNC_INTERVAL)) {
+        return;
+    }
+    if (sync_valid && (TimerGetElapsedTime(sync_local) < interval)) {
+        return;
+    }
+
+    // the request rides on an application uplink when there is one
+    lorawan_mac_request(LORAWAN_MAC_REQUEST_DEVICE_TIME,
+                        LORAWAN_RX_CAL_REQUEST_DEADLINE);
+    sync_requested = true;
+    sync_requested_at = TimerGetCurrentTime();
+}
+
+void lorawan_rx_calibration_time_sync(bool isSynchronized)
+{
+    TimerTime_t local = TimerGetCurrentTime();
+    SysTime_t time = SysTimeGet();
+    uint64_t network = (uint64_t)time.Seconds * 1000 + time.SubSeconds;
+    int64_t local_elapsed;
+    int64_t network_elapsed;
+    uint32_t sample;
+
+    if (!isSynchronized) {
+        return;
+    }
+
+    sync_requested = false;
+    cal.syncs++;
+
+    if (sync_valid) {
+        local_elapsed = (uint32_t)(local - sync_local);
+        network_elapsed = network - sync_network;
+
+        // a short baseline is dominated by the DeviceTime resolution, keep
+        // the older reference until the interval is long enough
+        if ((local_elapsed < LORAWAN_RX_CAL_SYNC_INTERVAL) ||
+            (network_elapsed <= 0)) {
+            return;
+        }
+
+        cal.drift_ppm = (int32_t)((local_elapsed - network_elapsed) * 1000000 /
+                                  network_elapsed);
+        sample = (cal.drift_ppm < 0) ? -cal.drift_ppm : cal.drift_ppm;
+
+        // follow increases at once and decreases slowly
+        if (!drift_measured || (sample > drift_bound)) {
+            drift_bound = sample;
+        } else {
+            drift_bound = (3 * drift_bound + sample) / 4;
+        }
+
+        cal.target = LORAWAN_RX_ERROR_MIN +
+                     ((uint64_t)drift_bound * LORAWAN_RX_ERROR_HORIZON +
+                      999999) / 1000000;
+        if (cal.target > LORAWAN_RX_ERROR_MAX) {
+            cal.target = LORAWAN_RX_ERROR_MAX;
+        }
+
+        // the first measurement applies directly, once windows have been
+        // missed the error only comes down with received downlinks
+        if ((cal.target > cal.rx_error) || (cal.backoffs == 0)) {
+            rx_cal_apply(cal.target);
+        }
+        drift_measured = true;
+    }
+
+    sync_valid = true;
+    sync_local = local;
+    sync_network = network;
+}
+
+void lorawan_rx_calibration_tx(LmHandlerTxParams_t *params)
+{
+    if ((params->IsMcpsConfirm == 0) ||
+        (params->MsgType != LORAMAC_HANDLER_CONFIRMED_MSG) ||
+        params->AckReceived) {
+        return;
+    }
+
+    cal.misses++;
+    hit_streak = 0;
+    if (++miss_streak >= LORAWAN_RX_CAL_MISSES) {
+        miss_streak = 0;
+        if (cal.rx_error < LORAWAN_RX_ERROR_MAX) {
+            rx_cal_apply(cal.rx_error * 2);
+            cal.backoffs++;
+        }
+    }
+}
+
+void lorawan_rx_calibration_rx(LmHandlerRxParams_t *params)
+{
+    if ((params->IsMcpsIndication == 0) ||
+        (params->Status != LORAMAC_EVENT_INFO_STATUS_OK) ||
+        ((params->RxSlot != RX_SLOT_WIN_1) &&
+         (params->RxSlot != RX_SLOT_WIN_2))) {
+        return;
+    }
+
+    cal.downlinks++;
+    miss_streak = 0;
+    if ((++hit_streak >= LORAWAN_RX_CAL_RECOVERY) &&
+        (cal.rx_error > cal.target)) {
+        hit_streak = 0;
+        rx_cal_apply(cal.target + (cal.rx_error - cal.target) / 2);
+    }
+}
+
+void lorawan_rx_calibration_status(lorawan_rx_calibration_t *status)
+{
+    memcpy(status, &cal, sizeof(lorawan_rx_calibration_t));
+}
+
+// Receive time in us of a window that sees no preamble, as computed by
+// RegionCommonComputeRxWindowParameters for the given error.
+static uint32_t rx_window_time(int8_t datarate, uint32_t rx_error)
+{
+    uint32_t symbol_time = lorawan_symbol_time(datarate);
+    uint32_t symbols;
+
+    if (symbol_time == 0) {
+        return 0;
+    }
+
+    symbols = ((2 * LORAWAN_RX_MIN_SYMBOLS - 8) * symbol_time +
+               2 * rx_error * 1000 + symbol_time - 1) /
+              symbol_time;
+    if (symbols < LORAWAN_RX_MIN_SYMBOLS) {
+        symbols = LORAWAN_RX_MIN_SYMBOLS;
+    }
+
+    return symbols * symbol_time;
+}
+
+// Radio on time in us saved on an uplink without downlink, RX1 and RX2
+// both run to their timeout, compared to LORAWAN_RX_ERROR_MAX.
+uint32_t lorawan_rx_calibration_saving(int8_t datarate)
+{
+    MibRequestConfirm_t mibReq;
+    int8_t rx1 = datarate;
+    uint32_t saved = 0;
+
+    if (ACTIVE_REGION == LORAMAC_REGION_US915) {
+        rx1 = (datarate == DR_4) ? DR_13 : datarate + DR_10;
+    }
+    saved += rx_window_time(rx1, LORAWAN_RX_ERROR_MAX) -
+             rx_window_time(rx1, cal.rx_error);
+
+    mibReq.Type = MIB_RX2_CHANNEL;
+    if (LoRaMacMibGetRequestConfirm(&mibReq) == LORAMAC_STATUS_OK) {
+        saved += rx_window_time(mibReq.Param.Rx2Channel.Datarate,
+                                LORAWAN_RX_ERROR_MAX) -
+                 rx_window_time(mibReq.Param.Rx2Channel.Datarate,
+                                cal.rx_error);
+    }
+
+    return saved;
+}
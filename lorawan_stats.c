@@ -0,0 +1,139 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <LmHandler.h>
+
+#include "lorawan_airtime.h"
+#include "lorawan_stats.h"
+
+// RSSI buckets are 10 dB wide from -130 dBm, SNR buckets 4 dB wide from
+// -20 dB, the first and last buckets also collect everything beyond them
+#define RSSI_HISTOGRAM_START -130
+#define RSSI_HISTOGRAM_STEP  10
+#define SNR_HISTOGRAM_START  -20
+#define SNR_HISTOGRAM_STEP   4
+
+lorawan_stats_t lorawan_stats;
+
+static uint32_t stats_bucket(int32_t value, int32_t start, int32_t step)
+{
+    int32_t bucket = (value - start) / step;
+
+    if (value < start) {
+        bucket = 0;
+    }
+    if (bucket >= LORAWAN_STATS_HISTOGRAM) {
+        bucket = LORAWAN_STATS_HISTOGRAM - 1;
+    }
+
+    return bucket;
+}
+
+void lorawan_stats_reset()
+{
+    memset(&lorawan_stats, 0, sizeof(lorawan_stats));
+}
+
+void lorawan_stats_tx(LmHandlerTxParams_t *params)
+{
+    if (params->IsMcpsConfirm == 0) {
+        return;
+    }
+
+    if (params->Status != LORAMAC_EVENT_INFO_STATUS_OK) {
+        lorawan_stats.uplink_failures++;
+    }
+
+    lorawan_stats.uplinks++;
+    lorawan_stats.airtime_last =
+        lorawan_time_on_air(params->Datarate, params->AppData.BufferSize);
+    lorawan_stats.airtime_total += lorawan_stats.airtime_last;
+
+    if ((params->Datarate >= 0) &&
+        (params->Datarate < LORAWAN_STATS_DATARATES)) {
+        lorawan_stats.datarate[params->Datarate]++;
+    }
+
+    if (params->MsgType == LORAMAC_HANDLER_CONFIRMED_MSG) {
+        lorawan_stats.confirmed++;
+        if (params->AckReceived) {
+            lorawan_stats.confirmed_acked++;
+        }
+    }
+}
+
+void lorawan_stats_rx(LmHandlerRxParams_t *params)
+{
+    if (params->IsMcpsIndication == 0) {
+        return;
+    }
+
+    lorawan_stats.downlinks++;
+    lorawan_stats.rssi[stats_bucket(params->Rssi, RSSI_HISTOGRAM_START,
+                                    RSSI_HISTOGRAM_STEP)]++;
+    lorawan_stats.snr[stats_bucket(params->Snr, SNR_HISTOGRAM_START,
+                                   SNR_HISTOGRAM_STEP)]++;
+}
+
+void lorawan_stats_request(LoRaMacStatus_t status, TimerTime_t nextTxIn)
+{
+    if (status == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED) {
+        lorawan_stats.dutycycle_waits++;
+        lorawan_stats.dutycycle_wait_total += nextTxIn;
+    }
+}
+
+void lorawan_stats_dequeue(uint32_t residency)
+{
+    lorawan_stats.queue_dequeued++;
+    lorawan_stats.queue_residency_total += residency;
+    if (residency > lorawan_stats.queue_residency_max) {
+        lorawan_stats.queue_residency_max = residency;
+    }
+}
+
+void lorawan_stats_confirmed_retry()
+{
+    lorawan_stats.confirmed_retries++;
+}
+
+void lorawan_stats_coalesced()
+{
+    lorawan_stats.queue_coalesced++;
+}
+
+void lorawan_stats_uplink_rejected()
+{
+    lorawan_stats.uplink_failures++;
+}
@@ -0,0 +1,74 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _LORAWAN_STATS_H_
+#define _LORAWAN_STATS_H_
+
+#include <stdint.h>
+
+#include <LmHandler.h>
+
+#define LORAWAN_STATS_VERSION     2
+#define LORAWAN_STATS_DATARATES   16
+#define LORAWAN_STATS_HISTOGRAM   8
+
+typedef struct {
+    uint32_t uplinks;
+    uint32_t uplink_failures;
+    uint32_t confirmed;
+    uint32_t confirmed_acked;
+    uint32_t confirmed_retries;
+    uint32_t airtime_total;
+    uint32_t airtime_last;
+    uint32_t datarate[LORAWAN_STATS_DATARATES];
+    uint32_t downlinks;
+    uint32_t rssi[LORAWAN_STATS_HISTOGRAM];
+    uint32_t snr[LORAWAN_STATS_HISTOGRAM];
+    uint32_t dutycycle_waits;
+    uint32_t dutycycle_wait_total;
+    uint32_t queue_dequeued;
+    uint32_t queue_residency_total;
+    uint32_t queue_residency_max;
+    uint32_t queue_coalesced;
+} lorawan_stats_t;
+
+extern lorawan_stats_t lorawan_stats;
+
+extern void lorawan_stats_reset();
+extern void lorawan_stats_tx(LmHandlerTxParams_t *params);
+extern void lorawan_stats_rx(LmHandlerRxParams_t *params);
+extern void lorawan_stats_request(LoRaMacStatus_t status, TimerTime_t nextTxIn);
+extern void lorawan_stats_dequeue(uint32_t residency);
+extern void lorawan_stats_confirmed_retry();
+extern void lorawan_stats_coalesced();
+extern void lorawan_stats_uplink_rejected();
+
+#endif /* _LORAWAN_STATS_H_ */
@@ -19,6 +19,8 @@
 
 #include "application.h"
 #include "ble.h"
+#include "console_uart.h"
+#include "idle_stats.h"
 #include "lorawan.h"
 
 //*****************************************************************************
@@ -31,7 +33,12 @@
 //*****************************************************************************
 uint32_t am_freertos_sleep(uint32_t idleTime)
 {
-    am_hal_sysctrl_sleep(AM_HAL_SYSCTRL_SLEEP_DEEP);
+    // the console UART stops in deep sleep, let queued output drain first
+    bool deep = !console_uart_busy();
+
+    idle_stats_sleep(deep);
+    am_hal_sysctrl_sleep(deep ? AM_HAL_SYSCTRL_SLEEP_DEEP
+                              : AM_HAL_SYSCTRL_SLEEP_NORMAL);
     return 0;
 }
 
@@ -41,7 +48,7 @@ uint32_t am_freertos_sleep(uint32_t idleTime)
 // Do necessary 'wakeup' operations here, e.g. to power up/enable peripherals etc.
 //
 //*****************************************************************************
-void am_freertos_wakeup(uint32_t idleTime) { return; }
+void am_freertos_wakeup(uint32_t idleTime) { idle_stats_wakeup(); }
 
 void am_gpio_isr(void)
 {
@@ -50,6 +57,9 @@ void am_gpio_isr(void)
     am_hal_gpio_interrupt_status_get(true, &ui64Status);
     am_hal_gpio_interrupt_clear(ui64Status);
     am_hal_gpio_interrupt_service(ui64Status);
+
+    // the radio DIO interrupt is serviced from the LoRaWAN task
+    lorawan_wake();
 }
 
 void am_ctimer_isr(void)
@@ -123,6 +133,11 @@ void system_setup(void)
     am_devices_led_array_out(am_bsp_psLEDs, AM_BSP_NUM_LEDS, 0x0);
     am_devices_button_array_init(am_bsp_psButtons, AM_BSP_NUM_BUTTONS);
 
+    //
+    // Console output from here on goes through the UART rings.
+    //
+    console_uart_init();
+
     am_hal_interrupt_master_enable();
 }
 
@@ -11,6 +11,17 @@ INCLUDES += -I$(LORAMAC)/src/apps/LoRaMac/common
 INCLUDES += -I$(LORAMAC)/src/apps/LoRaMac/common/LmHandler
 INCLUDES += -I$(LORAMAC)/src/apps/LoRaMac/common/LmHandler/packages
 
+# The FUOTA packages and the fragment decoder are always built from source
+# so that the FRAG_MAX_NB and FRAG_MAX_SIZE of application.mk size the
+# decoder that lorawan_fuota.c checks them against.  Their copies in the
+# prebuilt library are not linked since these define the same symbols.
+VPATH += $(LORAMAC)/src/apps/LoRaMac/common/LmHandler/packages
+
+SRC += LmhpClockSync.c
+SRC += LmhpFragmentation.c
+SRC += LmhpRemoteMcastSetup.c
+SRC += FragDecoder.c
+
 ifdef DEBUG
     LIBS += -lloramac-dev
 else
@@ -0,0 +1,181 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lorawan_payload.h"
+
+// Host microbenchmark of the console payload decoder against the
+// ConvertHexString() it replaced in lorawan_cli.c.
+
+#define BENCH_PAYLOAD    242
+#define BENCH_ITERATIONS 200000
+
+static void ConvertHexString(const char *in, size_t inlen, uint8_t *out,
+                             size_t *outlen)
+{
+    size_t n = 0;
+    char cNum[3];
+    *outlen = 0;
+    while (n < inlen) {
+        switch (in[n]) {
+        case '\\':
+            n++;
+            switch (in[n]) {
+            case 'x':
+                n++;
+                memset(cNum, 0, 3);
+                memcpy(cNum, &in[n], 2);
+                n++;
+                out[*outlen] = strtol(cNum, NULL, 16);
+                break;
+            }
+            break;
+        default:
+            out[*outlen] = in[n];
+            break;
+        }
+        *outlen = *outlen + 1;
+        n++;
+    }
+}
+
+static uint8_t expected[BENCH_PAYLOAD];
+static uint8_t output[BENCH_PAYLOAD];
+static char    escaped[4 * BENCH_PAYLOAD + 1];
+static char    hex[4 + 2 * BENCH_PAYLOAD + 1];
+static char    base64[4 + 4 * (BENCH_PAYLOAD + 2) / 3 + 1];
+
+static double elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+static void encode_inputs()
+{
+    static const char digits[] = "0123456789abcdef";
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char *p;
+
+    for (int i = 0; i < BENCH_PAYLOAD; i++) {
+        expected[i] = rand();
+        sprintf(&escaped[4 * i], "\\x%02x", expected[i]);
+    }
+
+    p = hex + sprintf(hex, "hex:");
+    for (int i = 0; i < BENCH_PAYLOAD; i++) {
+        *p++ = digits[expected[i] >> 4];
+        *p++ = digits[expected[i] & 0x0F];
+    }
+    *p = 0;
+
+    p = base64 + sprintf(base64, "b64:");
+    for (int i = 0; i < BENCH_PAYLOAD; i += 3) {
+        uint32_t bits = expected[i] << 16;
+        int left = BENCH_PAYLOAD - i;
+
+        bits |= (left > 1) ? expected[i + 1] << 8 : 0;
+        bits |= (left > 2) ? expected[i + 2] : 0;
+        *p++ = alphabet[(bits >> 18) & 0x3F];
+        *p++ = alphabet[(bits >> 12) & 0x3F];
+        *p++ = (left > 1) ? alphabet[(bits >> 6) & 0x3F] : '=';
+        *p++ = (left > 2) ? alphabet[bits & 0x3F] : '=';
+    }
+    *p = 0;
+}
+
+static void bench_decoder(const char *name, const char *in, uint32_t chunk)
+{
+    lorawan_payload_t payload;
+    struct timespec start;
+    uint32_t length = strlen(in);
+    bool valid = true;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        lorawan_payload_init(&payload, output, sizeof(output));
+        for (uint32_t n = 0; n < length; n += chunk) {
+            valid &= lorawan_payload_decode(
+                &payload, &in[n], (length - n < chunk) ? length - n : chunk);
+        }
+        valid &= lorawan_payload_finish(&payload);
+    }
+    ns = elapsed_ns(&start) / BENCH_ITERATIONS;
+
+    valid &= (payload.length == BENCH_PAYLOAD) &&
+             (memcmp(output, expected, BENCH_PAYLOAD) == 0);
+    printf("%-24s %8.0f ns %6.2f ns/byte %s\n", name, ns, ns / BENCH_PAYLOAD,
+           valid ? "ok" : "MISMATCH");
+}
+
+static void bench_legacy()
+{
+    struct timespec start;
+    size_t length;
+    double ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        ConvertHexString(escaped, strlen(escaped), output, &length);
+    }
+    ns = elapsed_ns(&start) / BENCH_ITERATIONS;
+
+    printf("%-24s %8.0f ns %6.2f ns/byte %s\n", "ConvertHexString escaped",
+           ns, ns / BENCH_PAYLOAD,
+           ((length == BENCH_PAYLOAD) &&
+            (memcmp(output, expected, BENCH_PAYLOAD) == 0))
+               ? "ok"
+               : "MISMATCH");
+}
+
+int main()
+{
+    encode_inputs();
+
+    printf("%d byte payload, %d iterations\n", BENCH_PAYLOAD,
+           BENCH_ITERATIONS);
+    bench_legacy();
+    bench_decoder("decoder escaped", escaped, 1024);
+    bench_decoder("decoder escaped 61/line", escaped, 61);
+    bench_decoder("decoder hex", hex, 1024);
+    bench_decoder("decoder base64", base64, 1024);
+
+    return 0;
+}
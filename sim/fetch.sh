@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Fetch the FreeRTOS kernel and LoRaMac-node revisions the simulation is
+# built against into sim/deps.  The Makefile uses them in place of the
+# FREERTOS and LORAMAC defaults when present.  FreeRTOS-Plus-CLI is taken
+# from NM_SDK as in the firmware build, its FreeRTOS_CLI.c exports
+# FreeRTOS_CLIGetNumberOfParameters which upstream keeps static.
+#
+set -e
+
+FREERTOS_URL=https://github.com/FreeRTOS/FreeRTOS-Kernel.git
+FREERTOS_REV=V10.4.6
+LORAMAC_URL=https://github.com/Lora-net/LoRaMac-node.git
+LORAMAC_REV=v4.5.2
+
+cd "$(dirname "$0")"
+mkdir -p deps
+
+fetch() {
+    dir=deps/$1
+    if [ ! -d "$dir" ]; then
+        git clone --quiet --depth 1 --branch "$3" "$2" "$dir"
+    fi
+    have=$(git -C "$dir" describe --tags --exact-match 2>/dev/null || true)
+    if [ "$have" != "$3" ]; then
+        echo "$dir is at ${have:-an untagged revision}, expected $3" >&2
+        exit 1
+    fi
+    echo "$dir $3"
+}
+
+fetch FreeRTOS-Kernel "$FREERTOS_URL" "$FREERTOS_REV"
+fetch LoRaMac-node "$LORAMAC_URL" "$LORAMAC_REV"
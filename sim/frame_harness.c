@@ -0,0 +1,370 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "cli_batch.h"
+#include "lorawan.h"
+#include "lorawan_buffer.h"
+#include "lorawan_class_policy.h"
+#include "lorawan_config.h"
+#include "lorawan_drain.h"
+#include "lorawan_frame.h"
+#include "lorawan_stats.h"
+
+// Host harness of the binary console decoder in lorawan_frame.c.  Frames
+// are fed one byte at a time as from the UART and every reply is decoded
+// and checked: uplinks with zero bytes, the largest payload, oversize and
+// truncated frames, CRC errors, stray delimiters, busy and unknown types.
+// The decoding is then timed and the uplink rate over the UART computed
+// for the text and the binary console.  The LoRaWAN side is stubbed.
+
+#define HARNESS_FRAMES 200000
+#define HARNESS_BAUD   115200
+
+#define FRAME_SEND   0x01
+#define FRAME_STATS  0x02
+#define FRAME_CONFIG 0x03
+#define FRAME_EXIT   0x04
+#define FRAME_ERROR  0x7F
+#define FRAME_REPLY  0x80
+
+#define STATUS_OK      0
+#define STATUS_CRC     1
+#define STATUS_LENGTH  2
+#define STATUS_UNKNOWN 3
+#define STATUS_BUSY    4
+
+lorawan_stats_t lorawan_stats;
+
+static uint8_t pool[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+static lorawan_transaction_t sent;
+static uint32_t sent_count;
+static bool pool_busy;
+static bool drain;
+
+static uint8_t reply[1024];
+static uint32_t reply_length;
+static uint32_t replies;
+
+static int failures;
+
+uint8_t *lorawan_buffer_alloc()
+{
+    return pool_busy ? NULL : pool;
+}
+
+uint32_t lorawan_send(lorawan_transaction_t *transaction)
+{
+    sent = *transaction;
+    return ++sent_count;
+}
+
+void lorawan_stats_reset()
+{
+    memset(&lorawan_stats, 0, sizeof(lorawan_stats));
+}
+
+void lorawan_drain_enable(bool enable)
+{
+    drain = enable;
+}
+
+void lorawan_class_policy_set_power_source(lorawan_power_source_t source)
+{
+}
+
+void lorawan_class_policy_hint_downlink(uint32_t window)
+{
+}
+
+// batches run console commands and are left to the simulation
+bool cli_batch_line(const char *commands, size_t length, uint32_t index,
+                    char *line, size_t size)
+{
+    return false;
+}
+
+uint8_t cli_batch_run(const char *line, char *buffer, size_t size,
+                      size_t *length)
+{
+    *length = 0;
+    return 0;
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return 0;
+}
+
+static uint16_t crc16(uint16_t crc, uint8_t byte)
+{
+    crc ^= byte << 8;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+// Keeps the decoded reply, its CRC is checked by expect()
+void lorawan_frame_output(const uint8_t *data, uint32_t length)
+{
+    uint32_t i = 1;
+
+    reply_length = 0;
+    while (i < length - 1) {
+        uint8_t code = data[i++];
+
+        for (uint8_t k = 1; k < code; k++) {
+            reply[reply_length++] = data[i++];
+        }
+        if ((code < 0xFF) && (i < length - 1)) {
+            reply[reply_length++] = 0;
+        }
+    }
+    replies++;
+}
+
+// COBS encodes type, sequence, body and CRC between two delimiters
+static uint32_t encode(uint8_t *out, uint8_t type, uint8_t sequence,
+                       const uint8_t *body, uint32_t length)
+{
+    uint8_t frame[512];
+    uint16_t crc = 0xFFFF;
+    uint32_t code = 1;
+    uint32_t n = 2;
+
+    frame[0] = type;
+    frame[1] = sequence;
+    memcpy(&frame[2], body, length);
+    length += 2;
+    for (uint32_t i = 0; i < length; i++) {
+        crc = crc16(crc, frame[i]);
+    }
+    frame[length++] = crc >> 8;
+    frame[length++] = crc;
+
+    out[0] = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        if (frame[i] == 0) {
+            out[code] = n - code;
+            code = n++;
+        } else {
+            out[n++] = frame[i];
+            if (n - code == 0xFF) {
+                out[code] = 0xFF;
+                code = n++;
+            }
+        }
+    }
+    out[code] = n - code;
+    out[n++] = 0;
+
+    return n;
+}
+
+static bool feed(const uint8_t *data, uint32_t length)
+{
+    bool running = true;
+
+    replies = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        running = lorawan_frame_input(data[i]);
+    }
+
+    return running;
+}
+
+static void check(const char *name, bool ok)
+{
+    printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+static bool expect(uint8_t type, uint8_t sequence, uint8_t status)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (uint32_t i = 0; i < reply_length; i++) {
+        crc = crc16(crc, reply[i]);
+    }
+
+    return (replies == 1) && (reply_length >= 5) && (crc == 0) &&
+           (reply[0] == (type | FRAME_REPLY)) && (reply[1] == sequence) &&
+           (reply[2] == status);
+}
+
+static uint32_t send_frame(uint8_t *out, uint8_t sequence,
+                           const uint8_t *payload, uint32_t length)
+{
+    uint8_t body[512];
+
+    body[0] = 2;
+    body[1] = 0;
+    body[2] = 0;
+    memcpy(&body[3], payload, length);
+    return encode(out, FRAME_SEND, sequence, body, 3 + length);
+}
+
+static void test_frames()
+{
+    static const uint8_t zeros[] = {0x00, 0x01, 0x00, 0x00, 0x02, 0x00};
+    uint8_t payload[300];
+    uint8_t out[700];
+    uint32_t n;
+
+    n = send_frame(out, 1, zeros, sizeof(zeros));
+    feed(out, n);
+    check("send with zero bytes",
+          expect(FRAME_SEND, 1, STATUS_OK) && (sent.length == sizeof(zeros)) &&
+              (memcmp(sent.buffer, zeros, sizeof(zeros)) == 0) &&
+              (sent.port == 2));
+
+    memset(payload, 0x5A, sizeof(payload));
+    n = send_frame(out, 2, payload, LORAWAN_APP_DATA_BUFFER_MAX_SIZE);
+    feed(out, n);
+    check("send of the largest payload",
+          expect(FRAME_SEND, 2, STATUS_OK) &&
+              (sent.length == LORAWAN_APP_DATA_BUFFER_MAX_SIZE));
+
+    n = send_frame(out, 3, payload, LORAWAN_APP_DATA_BUFFER_MAX_SIZE + 1);
+    feed(out, n);
+    check("send one byte over the largest payload",
+          expect(FRAME_ERROR, 0, STATUS_CRC));
+
+    // more than 254 bytes without a zero take a 0xFF code block
+    n = send_frame(out, 4, payload, sizeof(payload));
+    feed(out, n);
+    check("oversize frame with a 0xFF block",
+          expect(FRAME_ERROR, 0, STATUS_CRC));
+
+    n = send_frame(out, 5, zeros, sizeof(zeros));
+    out[n / 2] ^= 0x40;
+    feed(out, n);
+    check("corrupted byte", expect(FRAME_ERROR, 0, STATUS_CRC));
+
+    n = send_frame(out, 6, payload, 20);
+    out[12] = 0;
+    feed(out, 13);
+    check("frame cut short by a delimiter", expect(FRAME_ERROR, 0, STATUS_CRC));
+
+    n = send_frame(out, 7, zeros, 2);
+    feed(out, n);
+    check("next frame after the errors", expect(FRAME_SEND, 7, STATUS_OK));
+
+    memset(out, 0, 16);
+    feed(out, 16);
+    check("delimiters only, no reply", replies == 0);
+
+    n = encode(out, FRAME_SEND, 8, zeros, 2);
+    feed(out, n);
+    check("send without its header", expect(FRAME_SEND, 8, STATUS_LENGTH));
+
+    pool_busy = true;
+    n = send_frame(out, 9, zeros, 2);
+    feed(out, n);
+    pool_busy = false;
+    check("send without a free buffer", expect(FRAME_SEND, 9, STATUS_BUSY));
+
+    n = encode(out, 0x42, 10, NULL, 0);
+    feed(out, n);
+    check("unknown type", expect(0x42, 10, STATUS_UNKNOWN));
+
+    n = encode(out, FRAME_STATS, 11, NULL, 0);
+    feed(out, n);
+    check("stats",
+          expect(FRAME_STATS, 11, STATUS_OK) &&
+              (reply[3] == LORAWAN_STATS_VERSION) &&
+              (reply[4] == sizeof(lorawan_stats_t)));
+
+    payload[0] = 0x01;
+    payload[1] = 0x01;
+    n = encode(out, FRAME_CONFIG, 12, payload, 2);
+    feed(out, n);
+    check("config drain on", expect(FRAME_CONFIG, 12, STATUS_OK) && drain);
+
+    n = encode(out, FRAME_EXIT, 13, NULL, 0);
+    check("exit", !feed(out, n) && expect(FRAME_EXIT, 13, STATUS_OK));
+}
+
+static void rate(uint32_t size)
+{
+    uint8_t payload[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+    uint8_t out[700];
+    struct timespec start;
+    struct timespec stop;
+    uint32_t text;
+    uint32_t binary;
+    double ns;
+
+    memset(payload, 0x5A, size);
+    binary = send_frame(out, 0, payload, size);
+
+    lorawan_frame_start();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < HARNESS_FRAMES; i++) {
+        feed(out, binary);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    ns = ((stop.tv_sec - start.tv_sec) * 1e9 +
+          (stop.tv_nsec - start.tv_nsec)) /
+         HARNESS_FRAMES;
+
+    // "lorawan send 2 0 " with \xNN per byte and the line end
+    text = strlen("lorawan send 2 0 ") + 4 * size + 1;
+
+    printf("%3d bytes: host decode %6.0f ns/frame, at %d baud "
+           "text %4d bytes %5.1f uplinks/s, binary %4d bytes %5.1f "
+           "uplinks/s, %.1fx\n",
+           size, ns, HARNESS_BAUD, text, HARNESS_BAUD / 10.0 / text, binary,
+           HARNESS_BAUD / 10.0 / binary, (double)text / binary);
+}
+
+int main()
+{
+    lorawan_frame_start();
+    test_frames();
+
+    printf("\nUplink rates are computed from the bytes per uplink on the\n"
+           "UART, not measured on the device.\n");
+    rate(12);
+    rate(51);
+    rate(LORAWAN_APP_DATA_BUFFER_MAX_SIZE);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,11 @@
+/*
+ * Host simulation stand-in for the AmbiqSuite bootloader helpers.
+ */
+#ifndef _AM_BOOTLOADER_H_
+#define _AM_BOOTLOADER_H_
+
+#include <stdint.h>
+
+extern uint32_t am_bootloader_fast_crc32(const void *pvData, uint32_t ui32NumBytes);
+
+#endif /* _AM_BOOTLOADER_H_ */
@@ -0,0 +1,9 @@
+/*
+ * Host simulation stand-in for the NM180100EVB board support package.
+ */
+#ifndef _AM_BSP_H_
+#define _AM_BSP_H_
+
+#include "am_mcu_apollo.h"
+
+#endif /* _AM_BSP_H_ */
@@ -0,0 +1,47 @@
+/*
+ * Host simulation stand-in for the Apollo3 HAL.  Only the flash, OTA and
+ * reset services used by the LoRaWAN modules are provided.  The internal
+ * flash is mapped at its real address range by the simulator so that the
+ * modules can keep reading it through plain pointers.
+ */
+#ifndef _AM_MCU_APOLLO_H_
+#define _AM_MCU_APOLLO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AM_HAL_STATUS_SUCCESS               0
+
+#define AM_HAL_FLASH_PROGRAM_KEY            0x12344321
+#define AM_HAL_FLASH_ADDR                   0x00000000
+#define AM_HAL_FLASH_INSTANCE_SIZE          (512 * 1024)
+#define AM_HAL_FLASH_NUM_INSTANCES          2
+#define AM_HAL_FLASH_PAGE_SIZE              (8 * 1024)
+#define AM_HAL_FLASH_TOTAL_SIZE             (AM_HAL_FLASH_INSTANCE_SIZE * AM_HAL_FLASH_NUM_INSTANCES)
+#define AM_HAL_FLASH_LARGEST_VALID_ADDR     (AM_HAL_FLASH_ADDR + AM_HAL_FLASH_TOTAL_SIZE - 1)
+#define AM_HAL_FLASH_ADDR2INST(addr)        (((addr) >> 19) & 1)
+#define AM_HAL_FLASH_ADDR2PAGE(addr)        (((addr) >> 13) & 0x3F)
+
+#define AM_HAL_OTA_STATUS_ERROR             0xFFFFFFFF
+
+#define AM_HAL_RESET_CONTROL_SWPOI          1
+
+typedef struct {
+    uint32_t ui32Status;
+} am_hal_ota_status_t;
+
+// The tick hook stands in for the interrupts of the target, code that
+// picks the FromISR variants of the FreeRTOS calls asks for it this way.
+extern bool sim_in_tick_hook();
+#define __get_IPSR() ((uint32_t)sim_in_tick_hook())
+
+extern int am_hal_flash_page_erase(uint32_t ui32ProgramKey, uint32_t ui32FlashInst,
+                                   uint32_t ui32PageNum);
+extern int am_hal_flash_program_main(uint32_t ui32ProgramKey, uint32_t *pui32Src,
+                                     uint32_t *pui32Dst, uint32_t ui32NumWords);
+extern uint32_t am_hal_ota_init(uint32_t ui32ProgamKey, uint32_t *pOtaDesc);
+extern uint32_t am_hal_ota_add(uint32_t ui32ProgamKey, uint8_t imageMagic,
+                               uint32_t *pImage);
+extern uint32_t am_hal_reset_control(uint32_t ui32Control, void *pArgs);
+
+#endif /* _AM_MCU_APOLLO_H_ */
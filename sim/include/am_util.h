@@ -0,0 +1,30 @@
+/*
+ * Host simulation stand-in for the AmbiqSuite utilities.
+ */
+#ifndef _AM_UTIL_H_
+#define _AM_UTIL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+    uint32_t ui32ChipID0;
+    uint32_t ui32ChipID1;
+    uint32_t ui32ChipRev;
+} am_util_id_mcuctrl_device_t;
+
+typedef struct {
+    am_util_id_mcuctrl_device_t sMcuCtrlDevice;
+} am_util_id_t;
+
+extern uint32_t am_util_id_device(am_util_id_t *psIDDevice);
+
+#define am_util_stdio_printf    printf
+#define am_util_stdio_sprintf   sprintf
+#define am_util_stdio_snprintf  snprintf
+#define am_util_stdio_vsnprintf vsnprintf
+#define am_util_delay_ms(ms)    DelayMsMcu(ms)
+
+extern void DelayMsMcu(uint32_t ms);
+
+#endif /* _AM_UTIL_H_ */
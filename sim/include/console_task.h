@@ -0,0 +1,13 @@
+/*
+ * Host simulation stand-in for the NMSDK console.  The simulator feeds
+ * stdin and the scenario script to the FreeRTOS CLI directly.
+ */
+#ifndef _CONSOLE_TASK_H_
+#define _CONSOLE_TASK_H_
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+extern TaskHandle_t nm_console_task_handle;
+
+#endif /* _CONSOLE_TASK_H_ */
@@ -0,0 +1,14 @@
+/*
+ * Host simulation stand-in for the NMSDK task message definition.
+ */
+#ifndef _TASK_MESSAGE_H_
+#define _TASK_MESSAGE_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t ui32Event;
+    void    *psContent;
+} task_message_t;
+
+#endif /* _TASK_MESSAGE_H_ */
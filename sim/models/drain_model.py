@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# Monte Carlo model of a frame pending burst with draining on and off
+#
+# This is a model, not a measurement.  The rejection and loss
+# probabilities are chosen by hand and nothing here runs the firmware,
+# the numbers only show how the burst time scales with them.  Measure
+# with sim/scripts/drain.txt in the simulator.
+#
+# Follows sim/scripts/drain.txt: a class A device sends a 12 byte uplink
+# every 15 minutes at DR1 and the network queues a burst of downlinks,
+# each sent with FPending set while more are queued.  LmHandler answers
+# FPending with an empty uplink from the MCPS indication, which the MAC
+# rejects with the given probability (busy or duty cycle).  With draining
+# the rejected frame is retried as soon as the MAC allows, without it the
+# rest of the burst waits for the next application uplink.  The burst time
+# is taken from the first to the last downlink as lorawan_drain.c does.
+
+import argparse
+import math
+import random
+
+PERIOD = 900.0              # application uplink interval, seconds
+APP_LENGTH = 12
+FRAME_OVERHEAD = 13         # MHDR, FHDR, FPort and MIC
+SF = 9                      # US915 DR1
+BANDWIDTH = 125.0
+RX1_DELAY = 1.0
+RX2_END = 2.0 + 0.05        # end of the RX2 window after the uplink
+DRAIN_RETRY = 1.0           # LORAWAN_DRAIN_RETRY
+
+
+def time_on_air(length):
+    symbol = (1 << SF) / BANDWIDTH / 1000
+    low_dr = 1 if symbol > 0.016 else 0
+    numerator = 8 * (length + FRAME_OVERHEAD) - 4 * SF + 28 + 16
+    symbols = 8 + max(math.ceil(numerator / (4 * (SF - 2 * low_dr))), 0) * 5
+    return symbol * (8 + 4.25 + symbols)
+
+
+def burst(downlinks, p_reject, p_loss, duty, drain):
+    app = random.uniform(0, PERIOD)
+    t = app
+    empty = False
+    first = None
+    last = None
+    uplinks = 0
+    while downlinks > 0:
+        uplinks += 1
+        toa = time_on_air(0 if empty else APP_LENGTH)
+        if not empty:
+            app += PERIOD
+        free = t + toa + RX2_END
+        if duty:
+            free = max(free, t + toa * 100)
+
+        if random.random() < p_loss:
+            # the device never learns of the downlink, nothing is owed
+            t = app
+            empty = False
+            continue
+
+        rx = t + toa + RX1_DELAY
+        if first is None:
+            first = rx
+        last = rx
+        downlinks -= 1
+        if downlinks == 0:
+            break
+
+        if random.random() >= p_reject:
+            t = free
+            empty = True
+        elif drain:
+            t = max(free, rx + DRAIN_RETRY)
+            empty = True
+        else:
+            t = app
+            empty = False
+
+    return last - first, uplinks
+
+
+def run(name, fn, runs):
+    times = []
+    uplinks = 0
+    for _ in range(runs):
+        dt, n = fn()
+        times.append(dt)
+        uplinks += n
+    times.sort()
+    print('  {:<12s} median {:8.0f} s  p90 {:8.0f} s  uplinks {:5.1f}'.format(
+        name, times[runs // 2], times[runs * 9 // 10], uplinks / runs))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='frame pending drain model, not a measurement')
+    parser.add_argument('--runs', type=int, default=2000)
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--downlinks', type=int, default=8)
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    n = args.downlinks
+
+    print('MODEL: hand-chosen probabilities, not measured on the device '
+          'or in the simulator')
+
+    for p_reject, p_loss, duty in ((1.0, 0.0, False), (0.5, 0.0, False),
+                                   (1.0, 0.1, False), (1.0, 0.0, True),
+                                   (0.0, 0.0, False)):
+        print('{} downlinks, empty uplink rejected {:.1f}, downlink loss {:.1f}, '
+              'duty cycle {}'.format(n, p_reject, p_loss, '1%' if duty else 'off'))
+        run('drain on', lambda: burst(n, p_reject, p_loss, duty, True), args.runs)
+        run('drain off', lambda: burst(n, p_reject, p_loss, duty, False), args.runs)
+
+
+if __name__ == '__main__':
+    main()
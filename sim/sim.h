@@ -0,0 +1,112 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t seed;
+    uint32_t chip_id;
+    uint32_t idle_step;
+} sim_config_t;
+
+typedef struct {
+    uint64_t mac_process_calls;
+    uint64_t mac_cpu_ns;
+    uint64_t mac_cpu_max_ns;
+
+    uint32_t tx_frames;
+    uint32_t tx_airtime;
+    uint32_t rx_windows;
+    uint32_t rx_frames;
+    uint32_t rx_timeouts;
+    uint32_t rx_window_frames;
+    uint64_t rx_on_time;
+    int32_t  rx_margin_min;
+    int32_t  rx_margin_max;
+    int64_t  rx_margin_total;
+
+    uint32_t ns_uplinks;
+    uint32_t ns_uplinks_unheard;
+    uint32_t ns_uplinks_lost;
+    uint32_t ns_mic_failures;
+    uint32_t ns_joins;
+    uint32_t ns_downlinks;
+    uint32_t ns_downlinks_missed;
+    uint32_t ns_acks;
+
+    uint32_t flash_erases;
+    uint32_t flash_words;
+} sim_metrics_t;
+
+// radio transmission planned by the network server
+typedef struct {
+    uint32_t time;
+    uint32_t frequency;
+    uint8_t  sf;
+    uint8_t  bw;
+    int16_t  rssi;
+    int8_t   snr;
+    uint8_t  size;
+    uint8_t  payload[255];
+} sim_transmission_t;
+
+extern sim_config_t  sim_config;
+extern sim_metrics_t sim_metrics;
+
+extern void     sim_stop(int code);
+
+extern uint32_t sim_time_now();
+extern void     sim_time_set(uint32_t now);
+extern bool     sim_time_next_alarm(uint32_t *alarm);
+
+extern void     sim_flash_init();
+
+extern uint32_t sim_radio_time_on_air(uint8_t sf, uint8_t bw, uint16_t preamble,
+                                      uint8_t size);
+extern uint32_t sim_radio_symbol_time(uint8_t sf, uint8_t bw);
+extern bool     sim_radio_next_event(uint32_t *time);
+extern bool     sim_radio_irq_pending();
+extern void     sim_radio_process(uint32_t now);
+
+extern void     sim_server_init();
+extern void     sim_server_uplink(uint32_t end, uint32_t frequency, uint8_t sf,
+                                  uint8_t bw, const uint8_t *frame, uint8_t size);
+extern const sim_transmission_t *sim_server_transmission();
+extern void     sim_server_delivered();
+extern bool     sim_server_next_event(uint32_t *time);
+extern void     sim_server_process(uint32_t now);
+extern int      sim_server_command(int argc, char **argv);
+
+#endif /* _SIM_H_ */
@@ -0,0 +1,396 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <am_bootloader.h>
+#include <am_mcu_apollo.h>
+#include <am_util.h>
+
+#include <board.h>
+#include <delay-board.h>
+#include <eeprom-board.h>
+#include <rtc-board.h>
+#include <timer.h>
+
+#include "sim.h"
+
+// Only the part of the flash the application stores data in is mapped, the
+// application image itself lives in the host executable.
+#define SIM_FLASH_START     0x0004C000
+#define SIM_FLASH_END       (AM_HAL_FLASH_LARGEST_VALID_ADDR + 1)
+
+#define SIM_EEPROM_SIZE     4096
+
+static uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+
+static volatile uint32_t sim_now;
+static uint32_t sim_timer_context;
+static uint32_t sim_alarm;
+static volatile bool sim_alarm_armed;
+static uint32_t sim_backup[2];
+
+//*****************************************************************************
+//
+// Virtual time
+//
+//*****************************************************************************
+uint32_t sim_time_now()
+{
+    return sim_now;
+}
+
+bool sim_time_next_alarm(uint32_t *alarm)
+{
+    if (sim_alarm_armed) {
+        *alarm = sim_alarm;
+    }
+    return sim_alarm_armed;
+}
+
+void sim_time_set(uint32_t now)
+{
+    sim_now = now;
+
+    if (sim_alarm_armed && ((int32_t)(sim_now - sim_alarm) >= 0)) {
+        sim_alarm_armed = false;
+        TimerIrqHandler();
+    }
+}
+
+//*****************************************************************************
+//
+// Flash
+//
+//*****************************************************************************
+void sim_flash_init()
+{
+    void *flash = mmap((void *)SIM_FLASH_START, SIM_FLASH_END - SIM_FLASH_START,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (flash != (void *)SIM_FLASH_START) {
+        fprintf(stderr, "sim: unable to map the flash at 0x%08x\n", SIM_FLASH_START);
+        exit(1);
+    }
+
+    memset(flash, 0xFF, SIM_FLASH_END - SIM_FLASH_START);
+}
+
+int am_hal_flash_page_erase(uint32_t ui32ProgramKey, uint32_t ui32FlashInst,
+                            uint32_t ui32PageNum)
+{
+    uint32_t address = ui32FlashInst * AM_HAL_FLASH_INSTANCE_SIZE +
+                       ui32PageNum * AM_HAL_FLASH_PAGE_SIZE;
+
+    if ((address < SIM_FLASH_START) || (address >= SIM_FLASH_END)) {
+        return -1;
+    }
+
+    memset((void *)(uintptr_t)address, 0xFF, AM_HAL_FLASH_PAGE_SIZE);
+    sim_metrics.flash_erases++;
+
+    return 0;
+}
+
+int am_hal_flash_program_main(uint32_t ui32ProgramKey, uint32_t *pui32Src,
+                              uint32_t *pui32Dst, uint32_t ui32NumWords)
+{
+    uintptr_t address = (uintptr_t)pui32Dst;
+
+    if ((address < SIM_FLASH_START) ||
+        (address + ui32NumWords * 4 > SIM_FLASH_END) || (address & 0x03)) {
+        return -1;
+    }
+
+    // programming can only clear bits, exactly like the NOR array
+    for (uint32_t i = 0; i < ui32NumWords; i++) {
+        pui32Dst[i] &= pui32Src[i];
+    }
+    sim_metrics.flash_words += ui32NumWords;
+
+    return 0;
+}
+
+uint32_t am_hal_ota_init(uint32_t ui32ProgamKey, uint32_t *pOtaDesc)
+{
+    printf("sim: OTA descriptor at %p\n", (void *)pOtaDesc);
+    return AM_HAL_STATUS_SUCCESS;
+}
+
+uint32_t am_hal_ota_add(uint32_t ui32ProgamKey, uint8_t imageMagic,
+                        uint32_t *pImage)
+{
+    printf("sim: OTA image at %p, magic 0x%02x\n", (void *)pImage, imageMagic);
+    return AM_HAL_STATUS_SUCCESS;
+}
+
+uint32_t am_hal_reset_control(uint32_t ui32Control, void *pArgs)
+{
+    printf("sim: reset requested at %u ms\n", sim_now);
+    sim_stop(0);
+    return AM_HAL_STATUS_SUCCESS;
+}
+
+uint32_t am_bootloader_fast_crc32(const void *pvData, uint32_t ui32NumBytes)
+{
+    const uint8_t *data = pvData;
+    uint32_t crc = 0xFFFFFFFF;
+
+    while (ui32NumBytes--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+uint32_t am_util_id_device(am_util_id_t *psIDDevice)
+{
+    memset(psIDDevice, 0, sizeof(am_util_id_t));
+    psIDDevice->sMcuCtrlDevice.ui32ChipID0 = sim_config.chip_id;
+    return 0;
+}
+
+//*****************************************************************************
+//
+// Board
+//
+//*****************************************************************************
+void BoardCriticalSectionBegin(uint32_t *mask)
+{
+    *mask = 0;
+    taskENTER_CRITICAL();
+}
+
+void BoardCriticalSectionEnd(uint32_t *mask)
+{
+    taskEXIT_CRITICAL();
+}
+
+void BoardInitPeriph(void)
+{
+}
+
+void BoardInitMcu(void)
+{
+    RtcInit();
+}
+
+void BoardResetMcu(void)
+{
+    am_hal_reset_control(AM_HAL_RESET_CONTROL_SWPOI, 0);
+}
+
+void BoardDeInitMcu(void)
+{
+}
+
+void BoardLowPowerHandler(void)
+{
+}
+
+uint8_t BoardGetPotiLevel(void)
+{
+    return 0;
+}
+
+uint16_t BoardGetBatteryVoltage(void)
+{
+    return 3300;
+}
+
+uint8_t BoardGetBatteryLevel(void)
+{
+    return 254;
+}
+
+uint32_t BoardGetRandomSeed(void)
+{
+    return sim_config.seed;
+}
+
+int16_t BoardGetTemperature(void)
+{
+    return 25;
+}
+
+Version_t BoardGetVersion(void)
+{
+    Version_t version = {.Value = 0};
+    return version;
+}
+
+void DelayMsMcu(uint32_t ms)
+{
+    uint32_t start = sim_now;
+
+    while ((sim_now - start) < ms) {
+        vTaskDelay(1);
+    }
+}
+
+//*****************************************************************************
+//
+// RTC, one tick per millisecond of virtual time
+//
+//*****************************************************************************
+void RtcInit(void)
+{
+    sim_alarm_armed = false;
+    sim_timer_context = sim_now;
+}
+
+uint32_t RtcGetMinimumTimeout(void)
+{
+    return 1;
+}
+
+uint32_t RtcMs2Tick(TimerTime_t milliseconds)
+{
+    return milliseconds;
+}
+
+TimerTime_t RtcTick2Ms(uint32_t tick)
+{
+    return tick;
+}
+
+void RtcDelayMs(TimerTime_t milliseconds)
+{
+    DelayMsMcu(milliseconds);
+}
+
+void RtcSetAlarm(uint32_t timeout)
+{
+    RtcStartAlarm(timeout);
+}
+
+void RtcStopAlarm(void)
+{
+    sim_alarm_armed = false;
+}
+
+void RtcStartAlarm(uint32_t timeout)
+{
+    sim_alarm = sim_timer_context + timeout;
+    sim_alarm_armed = true;
+}
+
+uint32_t RtcSetTimerContext(void)
+{
+    sim_timer_context = sim_now;
+    return sim_timer_context;
+}
+
+uint32_t RtcGetTimerContext(void)
+{
+    return sim_timer_context;
+}
+
+uint32_t RtcGetCalendarTime(uint16_t *milliseconds)
+{
+    *milliseconds = sim_now % 1000;
+    return sim_now / 1000;
+}
+
+uint32_t RtcGetTimerValue(void)
+{
+    return sim_now;
+}
+
+uint32_t RtcGetTimerElapsedTime(void)
+{
+    return sim_now - sim_timer_context;
+}
+
+void RtcBkupWrite(uint32_t data0, uint32_t data1)
+{
+    sim_backup[0] = data0;
+    sim_backup[1] = data1;
+}
+
+void RtcBkupRead(uint32_t *data0, uint32_t *data1)
+{
+    *data0 = sim_backup[0];
+    *data1 = sim_backup[1];
+}
+
+void RtcProcess(void)
+{
+}
+
+TimerTime_t RtcTempCompensation(TimerTime_t period, float temperature)
+{
+    return period;
+}
+
+//*****************************************************************************
+//
+// EEPROM, backs the LoRaMAC NVM contexts
+//
+//*****************************************************************************
+LmnStatus_t EepromMcuWriteBuffer(uint16_t addr, uint8_t *buffer, uint16_t size)
+{
+    if (addr + size > SIM_EEPROM_SIZE) {
+        return LMN_STATUS_ERROR;
+    }
+    memcpy(&sim_eeprom[addr], buffer, size);
+    return LMN_STATUS_OK;
+}
+
+LmnStatus_t EepromMcuReadBuffer(uint16_t addr, uint8_t *buffer, uint16_t size)
+{
+    if (addr + size > SIM_EEPROM_SIZE) {
+        return LMN_STATUS_ERROR;
+    }
+    memcpy(buffer, &sim_eeprom[addr], size);
+    return LMN_STATUS_OK;
+}
+
+void EepromMcuSetDeviceAddr(uint8_t addr)
+{
+}
+
+LmnStatus_t EepromMcuGetDeviceAddr(void)
+{
+    return LMN_STATUS_OK;
+}
@@ -0,0 +1,490 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+#include <FreeRTOS_CLI.h>
+#include <task.h>
+
+#include <LmHandler.h>
+
+#include "lorawan.h"
+#include "lorawan_bench.h"
+#include "lorawan_config.h"
+#include "lorawan_downlink.h"
+#include "lorawan_drain.h"
+#include "lorawan_frame.h"
+#include "lorawan_stats.h"
+#include "sim.h"
+
+#define SIM_SCRIPT_LINES    1024
+#define SIM_SCRIPT_ARGS     8
+#define SIM_TRAFFIC_BUFFERS 16
+
+sim_config_t  sim_config = {.seed = 1, .chip_id = 0x5349, .idle_step = 1000};
+sim_metrics_t sim_metrics;
+
+TaskHandle_t nm_console_task_handle;
+
+static char *script[SIM_SCRIPT_LINES];
+static int script_lines;
+
+static volatile bool sim_wake_armed;
+static volatile uint32_t sim_wake;
+static volatile bool sim_stopping;
+static volatile bool sim_tick_hook;
+static struct timespec sim_started;
+
+static struct {
+    bool     enabled;
+    uint32_t period;
+    uint32_t next;
+    uint8_t  size;
+    uint8_t  port;
+    uint8_t  key;
+    LmHandlerMsgTypes_t type;
+    uint32_t sent;
+    uint8_t  buffers[SIM_TRAFFIC_BUFFERS][LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+} traffic;
+
+static uint64_t elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000ULL +
+           end->tv_nsec - start->tv_nsec;
+}
+
+// The MAC processing time is measured by wrapping LmHandlerProcess at link
+// time (-Wl,--wrap=LmHandlerProcess).
+extern void __real_LmHandlerProcess(void);
+
+void __wrap_LmHandlerProcess(void)
+{
+    struct timespec start, end;
+    uint64_t ns;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    __real_LmHandlerProcess();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+
+    ns = elapsed_ns(&start, &end);
+    sim_metrics.mac_process_calls++;
+    sim_metrics.mac_cpu_ns += ns;
+    if (ns > sim_metrics.mac_cpu_max_ns) {
+        sim_metrics.mac_cpu_max_ns = ns;
+    }
+}
+
+static bool earlier(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+bool sim_in_tick_hook()
+{
+    return sim_tick_hook;
+}
+
+// Every FreeRTOS tick moves the virtual clock to the next pending event:
+// RTC alarm, radio completion, network server transmission or script
+// deadline.  Without any pending event the clock moves by the idle step so
+// that polled timeouts still expire.  The LoRaWAN task is woken on every
+// tick, its deadlines in ticks do not follow the virtual clock.
+static void sim_tick()
+{
+    uint32_t now = sim_time_now();
+    uint32_t next = now + sim_config.idle_step;
+    uint32_t t;
+
+    // let the LoRaWAN task service the radio interrupt first
+    if (sim_stopping || sim_radio_irq_pending()) {
+        return;
+    }
+
+    if (sim_time_next_alarm(&t) && earlier(t, next)) {
+        next = t;
+    }
+    if (sim_radio_next_event(&t) && earlier(t, next)) {
+        next = t;
+    }
+    if (sim_server_next_event(&t) && earlier(t, next)) {
+        next = t;
+    }
+    if (sim_wake_armed && earlier(sim_wake, next)) {
+        next = sim_wake;
+    }
+    if (earlier(next, now)) {
+        next = now;
+    }
+
+    sim_time_set(next);
+    sim_radio_process(next);
+    sim_server_process(next);
+}
+
+void vApplicationTickHook(void)
+{
+    sim_tick_hook = true;
+    sim_tick();
+    lorawan_wake();
+    sim_tick_hook = false;
+}
+
+void vApplicationMallocFailedHook(void)
+{
+    fprintf(stderr, "sim: out of heap\n");
+    sim_stop(1);
+}
+
+void vApplicationIdleHook(void)
+{
+    usleep(100);
+}
+
+void vAssertCalled(const char *file, unsigned long line)
+{
+    fprintf(stderr, "sim: assertion failed at %s:%lu\n", file, line);
+    sim_stop(1);
+}
+
+static void sim_report()
+{
+    struct timespec now;
+    uint64_t wall;
+    uint32_t windows = sim_metrics.rx_window_frames;
+    lorawan_drain_stats_t drain;
+    lorawan_bench_result_t bench;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    wall = elapsed_ns(&sim_started, &now) / 1000000;
+    lorawan_drain_stats(&drain);
+    lorawan_bench_result(&bench);
+
+    printf("\n");
+    printf("sim.virtual_ms              %u\n", sim_time_now());
+    printf("sim.wall_ms                 %llu\n", (unsigned long long)wall);
+    printf("sim.mac_process_calls       %llu\n",
+           (unsigned long long)sim_metrics.mac_process_calls);
+    printf("sim.mac_cpu_us              %llu\n",
+           (unsigned long long)(sim_metrics.mac_cpu_ns / 1000));
+    printf("sim.mac_cpu_max_us          %llu\n",
+           (unsigned long long)(sim_metrics.mac_cpu_max_ns / 1000));
+    printf("sim.queue_dequeued          %u\n", lorawan_stats.queue_dequeued);
+    printf("sim.queue_latency_avg_ms    %u\n",
+           lorawan_stats.queue_dequeued
+               ? lorawan_stats.queue_residency_total / lorawan_stats.queue_dequeued
+               : 0);
+    printf("sim.queue_latency_max_ms    %u\n", lorawan_stats.queue_residency_max);
+    printf("sim.queue_coalesced         %u\n", lorawan_stats.queue_coalesced);
+    printf("sim.traffic_sent            %u\n", traffic.sent);
+    printf("sim.tx_frames               %u\n", sim_metrics.tx_frames);
+    printf("sim.tx_airtime_ms           %u\n", sim_metrics.tx_airtime);
+    printf("sim.rx_windows              %u\n", sim_metrics.rx_windows);
+    printf("sim.rx_frames               %u\n", sim_metrics.rx_frames);
+    printf("sim.rx_timeouts             %u\n", sim_metrics.rx_timeouts);
+    printf("sim.rx_on_ms                %llu\n",
+           (unsigned long long)sim_metrics.rx_on_time);
+    printf("sim.rx_margin_ms            %d/%d/%d\n", sim_metrics.rx_margin_min,
+           windows ? (int32_t)(sim_metrics.rx_margin_total / windows) : 0,
+           sim_metrics.rx_margin_max);
+    printf("sim.ns_uplinks              %u\n", sim_metrics.ns_uplinks);
+    printf("sim.ns_uplinks_unheard      %u\n", sim_metrics.ns_uplinks_unheard);
+    printf("sim.ns_uplinks_lost         %u\n", sim_metrics.ns_uplinks_lost);
+    printf("sim.ns_mic_failures         %u\n", sim_metrics.ns_mic_failures);
+    printf("sim.ns_joins                %u\n", sim_metrics.ns_joins);
+    printf("sim.ns_downlinks            %u\n", sim_metrics.ns_downlinks);
+    printf("sim.ns_downlinks_missed     %u\n", sim_metrics.ns_downlinks_missed);
+    printf("sim.ns_acks                 %u\n", sim_metrics.ns_acks);
+    printf("sim.drain_bursts            %u\n", drain.bursts);
+    printf("sim.drain_last_burst        %u/%u\n", drain.last_downlinks,
+           drain.last_time);
+    printf("sim.bench_done              %u/%u\n", bench.done,
+           bench.submitted);
+    printf("sim.bench_elapsed_ms        %u\n", bench.elapsed);
+    printf("sim.bench_latency_ms        %u/%u/%u\n", bench.total.p50,
+           bench.total.p99, bench.total.max);
+    printf("sim.flash_erases            %u\n", sim_metrics.flash_erases);
+    printf("sim.flash_words             %u\n", sim_metrics.flash_words);
+    fflush(stdout);
+}
+
+void sim_stop(int code)
+{
+    sim_stopping = true;
+    sim_report();
+    exit(code);
+}
+
+static uint32_t parse_time(const char *s)
+{
+    char *end;
+    double value = strtod(s, &end);
+
+    switch (*end) {
+    case 'h':
+        value *= 3600;
+        break;
+    case 'm':
+        value *= 60;
+        break;
+    default:
+        break;
+    }
+    return (uint32_t)(value * 1000);
+}
+
+// Binary console frames are read from stdin, the replies are printed in
+// hex.  Run the scenario from a file to pipe a frame stream in.
+void lorawan_frame_output(const uint8_t *data, uint32_t length)
+{
+    printf("frame>");
+    for (uint32_t i = 0; i < length; i++) {
+        printf(" %02x", data[i]);
+    }
+    printf("\n");
+}
+
+void lorawan_frame_run()
+{
+    int c;
+
+    lorawan_frame_start();
+    while ((c = getchar()) != EOF) {
+        if (!lorawan_frame_input(c)) {
+            break;
+        }
+    }
+}
+
+static void traffic_process()
+{
+    lorawan_transaction_t transaction;
+    uint8_t *buffer;
+
+    if (!traffic.enabled || earlier(sim_time_now(), traffic.next)) {
+        return;
+    }
+
+    buffer = traffic.buffers[traffic.sent % SIM_TRAFFIC_BUFFERS];
+    memset(buffer, (uint8_t)traffic.sent, traffic.size);
+
+    transaction.message_type = traffic.type;
+    transaction.length = traffic.size;
+    transaction.buffer = buffer;
+    transaction.port = traffic.port;
+    transaction.key = traffic.key;
+    transaction.callback = NULL;
+    transaction.context = NULL;
+    lorawan_send(&transaction);
+
+    traffic.sent++;
+    traffic.next += traffic.period;
+}
+
+static void wait_until(uint32_t target)
+{
+    while (earlier(sim_time_now(), target)) {
+        traffic_process();
+
+        sim_wake = target;
+        if (traffic.enabled && earlier(traffic.next, target)) {
+            sim_wake = traffic.next;
+        }
+        sim_wake_armed = true;
+        vTaskDelay(1);
+    }
+    sim_wake_armed = false;
+}
+
+static void run_cli(const char *command)
+{
+    static char output[configCOMMAND_INT_MAX_OUTPUT_SIZE];
+    BaseType_t more;
+
+    do {
+        output[0] = 0;
+        more = FreeRTOS_CLIProcessCommand(command, output, sizeof(output));
+        fputs(output, stdout);
+    } while (more != pdFALSE);
+    fflush(stdout);
+}
+
+static void run_command(char *line)
+{
+    char copy[256];
+    char *argv[SIM_SCRIPT_ARGS];
+    int argc = 0;
+
+    strncpy(copy, line, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = 0;
+    for (char *t = strtok(copy, " \t"); t && (argc < SIM_SCRIPT_ARGS);
+         t = strtok(NULL, " \t")) {
+        argv[argc++] = t;
+    }
+    if (argc == 0) {
+        return;
+    }
+
+    printf("[%10.3f] %s\n", sim_time_now() / 1000.0, line);
+
+    if (strcmp(argv[0], "ns") == 0) {
+        if (sim_server_command(argc, argv) != 0) {
+            printf("sim: invalid network server command\n");
+        }
+    } else if ((strcmp(argv[0], "traffic") == 0) && (argc >= 2)) {
+        if (strcmp(argv[1], "off") == 0) {
+            traffic.enabled = false;
+        } else if (argc >= 4) {
+            traffic.period = parse_time(argv[1]);
+            traffic.size = atoi(argv[2]);
+            traffic.port = atoi(argv[3]);
+            traffic.type = ((argc >= 5) && (strcmp(argv[4], "confirmed") == 0))
+                               ? LORAMAC_HANDLER_CONFIRMED_MSG
+                               : LORAMAC_HANDLER_UNCONFIRMED_MSG;
+            traffic.key = ((argc >= 6) && (strcmp(argv[4], "key") == 0))
+                              ? atoi(argv[5])
+                              : LORAWAN_KEY_NONE;
+            traffic.next = sim_time_now();
+            traffic.enabled = (traffic.period > 0) &&
+                              (traffic.size <= LORAWAN_APP_DATA_BUFFER_MAX_SIZE);
+        }
+    } else if ((strcmp(argv[0], "step") == 0) && (argc == 2)) {
+        sim_config.idle_step = parse_time(argv[1]);
+    } else if (strcmp(argv[0], "reload") == 0) {
+        // the downlink sessions are read back from the simulated flash as
+        // after a reboot, the RAM state of the other modules is kept
+        vTaskSuspendAll();
+        lorawan_downlink_init();
+        xTaskResumeAll();
+    } else if (strcmp(argv[0], "report") == 0) {
+        sim_report();
+    } else if (strcmp(argv[0], "end") == 0) {
+        sim_stop(0);
+    } else {
+        run_cli(line);
+    }
+}
+
+// Script lines are "[@<time>] <command>".  The time is absolute virtual
+// time in seconds, or with an m or h suffix.
+static void sim_script_task(void *pvParameters)
+{
+    // let the LoRaWAN task register its commands
+    vTaskDelay(10);
+
+    for (int i = 0; i < script_lines; i++) {
+        char *line = script[i];
+
+        if (line[0] == '@') {
+            char *command = strpbrk(line, " \t");
+
+            wait_until(parse_time(&line[1]));
+            line = command ? command + strspn(command, " \t") : "";
+        }
+        run_command(line);
+    }
+
+    sim_stop(0);
+}
+
+static void load_script(FILE *f)
+{
+    char line[256];
+
+    while (fgets(line, sizeof(line), f) && (script_lines < SIM_SCRIPT_LINES)) {
+        line[strcspn(line, "#\r\n")] = 0;
+        if (line[strspn(line, " \t")] != 0) {
+            script[script_lines++] = strdup(line + strspn(line, " \t"));
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-r seed] [-i id] [-t idle step ms] [script]\n"
+            "the script is read from stdin when no file is given\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f = stdin;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:i:t:h")) != -1) {
+        switch (opt) {
+        case 'r':
+            sim_config.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            sim_config.chip_id = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            sim_config.idle_step = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind < argc) {
+        f = fopen(argv[optind], "r");
+        if (f == NULL) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+    load_script(f);
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    srand(sim_config.seed);
+    sim_flash_init();
+    sim_server_init();
+    clock_gettime(CLOCK_MONOTONIC, &sim_started);
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    xTaskCreate(lorawan_task, "LoRaWAN", 8192, 0, 1, &lorawan_task_handle);
+    xTaskCreate(sim_script_task, "Script", 8192, 0, 1, NULL);
+    vTaskStartScheduler();
+
+    return 0;
+}
@@ -0,0 +1,494 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <radio.h>
+#include <utilities.h>
+
+#include "sim.h"
+
+// number of preamble symbols the receiver needs to lock on a frame
+#define SIM_RADIO_LOCK_SYMBOLS  4
+#define SIM_RADIO_PREAMBLE      8
+
+typedef enum {
+    SIM_RADIO_EVENT_NONE,
+    SIM_RADIO_EVENT_TX_DONE,
+    SIM_RADIO_EVENT_RX_DONE,
+    SIM_RADIO_EVENT_RX_TIMEOUT,
+} sim_radio_event_t;
+
+typedef struct {
+    uint8_t  sf;
+    uint8_t  bw;
+    uint8_t  coderate;
+    uint16_t preamble;
+    bool     fix_length;
+    bool     crc;
+} sim_radio_modulation_t;
+
+static RadioEvents_t *radio_events;
+static RadioState_t radio_state;
+static uint32_t radio_frequency;
+static uint32_t radio_tx_frequency;
+
+static sim_radio_modulation_t radio_tx;
+static sim_radio_modulation_t radio_rx;
+static uint16_t radio_symbol_timeout;
+static bool radio_rx_continuous;
+static uint32_t radio_rx_start;
+
+static uint8_t radio_buffer[255];
+static uint8_t radio_size;
+static int16_t radio_rssi;
+static int8_t radio_snr;
+
+static sim_radio_event_t radio_event;
+static uint32_t radio_event_time;
+static volatile sim_radio_event_t radio_irq;
+
+static uint32_t bandwidth_hz(uint8_t bw)
+{
+    switch (bw) {
+    case 1:
+        return 250000;
+    case 2:
+        return 500000;
+    default:
+        return 125000;
+    }
+}
+
+static uint32_t time_on_air_us(const sim_radio_modulation_t *m, uint8_t size)
+{
+    uint32_t symbol = ((uint32_t)1 << m->sf) * 1000000 / bandwidth_hz(m->bw);
+    bool low_datarate = ((m->sf >= 11) && (m->bw == 0)) ||
+                        ((m->sf == 12) && (m->bw == 1));
+    int32_t numerator = 8 * size - 4 * m->sf + 28 + (m->crc ? 16 : 0) -
+                        (m->fix_length ? 20 : 0);
+    int32_t denominator = 4 * (m->sf - (low_datarate ? 2 : 0));
+    int32_t symbols = 8;
+
+    if (numerator > 0) {
+        symbols += ((numerator + denominator - 1) / denominator) * (m->coderate + 4);
+    }
+
+    return (4 * m->preamble + 17) * symbol / 4 + symbols * symbol;
+}
+
+uint32_t sim_radio_time_on_air(uint8_t sf, uint8_t bw, uint16_t preamble, uint8_t size)
+{
+    sim_radio_modulation_t m = {.sf = sf, .bw = bw, .coderate = 1,
+                                .preamble = preamble, .crc = true};
+
+    return (time_on_air_us(&m, size) + 999) / 1000;
+}
+
+uint32_t sim_radio_symbol_time(uint8_t sf, uint8_t bw)
+{
+    return ((uint32_t)1 << sf) * 1000 / bandwidth_hz(bw);
+}
+
+static void radio_schedule(sim_radio_event_t event, uint32_t time)
+{
+    radio_event = event;
+    radio_event_time = time;
+}
+
+static void radio_rx_stop(uint32_t now)
+{
+    if (radio_state == RF_RX_RUNNING) {
+        sim_metrics.rx_on_time += now - radio_rx_start;
+    }
+}
+
+// Looks for a transmission of the network server that the receiver can lock
+// on given its current configuration.  Returns false when there is nothing
+// to receive within the window.
+static bool radio_rx_lookup(uint32_t now, uint32_t window)
+{
+    const sim_transmission_t *t = sim_server_transmission();
+    uint32_t lock;
+    int32_t margin;
+
+    if ((t == NULL) || (t->frequency != radio_frequency) ||
+        (t->sf != radio_rx.sf) || (t->bw != radio_rx.bw)) {
+        return false;
+    }
+
+    // the receiver must be listening before the preamble is over and the
+    // preamble must start before the symbol timeout expires
+    lock = t->time + (radio_rx.preamble - SIM_RADIO_LOCK_SYMBOLS) *
+                         sim_radio_symbol_time(t->sf, t->bw);
+    margin = (int32_t)(t->time - radio_rx_start);
+    if (((int32_t)(now - lock) > 0) ||
+        (!radio_rx_continuous && (margin > (int32_t)window))) {
+        return false;
+    }
+
+    if (!radio_rx_continuous) {
+        if ((sim_metrics.rx_window_frames == 0) ||
+            (margin < sim_metrics.rx_margin_min)) {
+            sim_metrics.rx_margin_min = margin;
+        }
+        if ((sim_metrics.rx_window_frames == 0) ||
+            (margin > sim_metrics.rx_margin_max)) {
+            sim_metrics.rx_margin_max = margin;
+        }
+        sim_metrics.rx_margin_total += margin;
+        sim_metrics.rx_window_frames++;
+    }
+
+    memcpy(radio_buffer, t->payload, t->size);
+    radio_size = t->size;
+    radio_rssi = t->rssi;
+    radio_snr = t->snr;
+    sim_server_delivered();
+
+    radio_schedule(SIM_RADIO_EVENT_RX_DONE,
+                   t->time + sim_radio_time_on_air(t->sf, t->bw, SIM_RADIO_PREAMBLE,
+                                                   t->size));
+    return true;
+}
+
+static void RadioInit(RadioEvents_t *events)
+{
+    radio_events = events;
+    radio_state = RF_IDLE;
+    radio_event = SIM_RADIO_EVENT_NONE;
+    radio_irq = SIM_RADIO_EVENT_NONE;
+}
+
+static RadioState_t RadioGetStatus(void)
+{
+    return radio_state;
+}
+
+static void RadioSetModem(RadioModems_t modem)
+{
+}
+
+static void RadioSetChannel(uint32_t freq)
+{
+    radio_frequency = freq;
+}
+
+static bool RadioIsChannelFree(uint32_t freq, uint32_t rxBandwidth,
+                               int16_t rssiThresh, uint32_t maxCarrierSenseTime)
+{
+    return true;
+}
+
+static uint32_t RadioRandom(void)
+{
+    return (uint32_t)rand();
+}
+
+static void RadioSetRxConfig(RadioModems_t modem, uint32_t bandwidth,
+                             uint32_t datarate, uint8_t coderate,
+                             uint32_t bandwidthAfc, uint16_t preambleLen,
+                             uint16_t symbTimeout, bool fixLen,
+                             uint8_t payloadLen, bool crcOn, bool freqHopOn,
+                             uint8_t hopPeriod, bool iqInverted, bool rxContinuous)
+{
+    radio_rx.sf = datarate;
+    radio_rx.bw = bandwidth;
+    radio_rx.coderate = coderate;
+    radio_rx.preamble = preambleLen;
+    radio_rx.fix_length = fixLen;
+    radio_rx.crc = crcOn;
+    radio_symbol_timeout = symbTimeout;
+    radio_rx_continuous = rxContinuous;
+}
+
+static void RadioSetTxConfig(RadioModems_t modem, int8_t power, uint32_t fdev,
+                             uint32_t bandwidth, uint32_t datarate,
+                             uint8_t coderate, uint16_t preambleLen,
+                             bool fixLen, bool crcOn, bool freqHopOn,
+                             uint8_t hopPeriod, bool iqInverted, uint32_t timeout)
+{
+    radio_tx.sf = datarate;
+    radio_tx.bw = bandwidth;
+    radio_tx.coderate = coderate;
+    radio_tx.preamble = preambleLen;
+    radio_tx.fix_length = fixLen;
+    radio_tx.crc = crcOn;
+}
+
+static bool RadioCheckRfFrequency(uint32_t frequency)
+{
+    return true;
+}
+
+static uint32_t RadioTimeOnAir(RadioModems_t modem, uint32_t bandwidth,
+                               uint32_t datarate, uint8_t coderate,
+                               uint16_t preambleLen, bool fixLen,
+                               uint8_t payloadLen, bool crcOn)
+{
+    sim_radio_modulation_t m = {.sf = datarate, .bw = bandwidth,
+                                .coderate = coderate, .preamble = preambleLen,
+                                .fix_length = fixLen, .crc = crcOn};
+
+    return (time_on_air_us(&m, payloadLen) + 999) / 1000;
+}
+
+static void RadioSend(uint8_t *buffer, uint8_t size)
+{
+    uint32_t now = sim_time_now();
+    uint32_t airtime = (time_on_air_us(&radio_tx, size) + 999) / 1000;
+
+    radio_rx_stop(now);
+    memcpy(radio_buffer, buffer, size);
+    radio_size = size;
+    radio_tx_frequency = radio_frequency;
+    radio_state = RF_TX_RUNNING;
+
+    sim_metrics.tx_frames++;
+    sim_metrics.tx_airtime += airtime;
+
+    radio_schedule(SIM_RADIO_EVENT_TX_DONE, now + airtime);
+}
+
+static void RadioSleep(void)
+{
+    radio_rx_stop(sim_time_now());
+    radio_state = RF_IDLE;
+    radio_event = SIM_RADIO_EVENT_NONE;
+}
+
+static void RadioStandby(void)
+{
+    RadioSleep();
+}
+
+static void RadioRx(uint32_t timeout)
+{
+    uint32_t now = sim_time_now();
+    uint32_t window;
+
+    radio_rx_stop(now);
+    radio_state = RF_RX_RUNNING;
+    radio_rx_start = now;
+    radio_event = SIM_RADIO_EVENT_NONE;
+
+    window = radio_symbol_timeout * sim_radio_symbol_time(radio_rx.sf, radio_rx.bw);
+    if ((timeout != 0) && (timeout < window)) {
+        window = timeout;
+    }
+
+    if (!radio_rx_continuous) {
+        sim_metrics.rx_windows++;
+    }
+
+    if (!radio_rx_lookup(now, window) && !radio_rx_continuous) {
+        radio_schedule(SIM_RADIO_EVENT_RX_TIMEOUT, now + window);
+    }
+}
+
+static void RadioStartCad(void)
+{
+}
+
+static void RadioSetTxContinuousWave(uint32_t freq, int8_t power, uint16_t time)
+{
+}
+
+static int16_t RadioRssi(RadioModems_t modem)
+{
+    return -120;
+}
+
+static void RadioWrite(uint32_t addr, uint8_t data)
+{
+}
+
+static uint8_t RadioRead(uint32_t addr)
+{
+    return 0;
+}
+
+static void RadioWriteBuffer(uint32_t addr, uint8_t *buffer, uint8_t size)
+{
+}
+
+static void RadioReadBuffer(uint32_t addr, uint8_t *buffer, uint8_t size)
+{
+}
+
+static void RadioSetMaxPayloadLength(RadioModems_t modem, uint8_t max)
+{
+}
+
+static void RadioSetPublicNetwork(bool enable)
+{
+}
+
+static uint32_t RadioGetWakeupTime(void)
+{
+    return 1;
+}
+
+// Radio interrupts are raised by the simulation clock and serviced from the
+// LoRaWAN task, the same way the SX126x driver defers its DIO1 interrupt.
+static void RadioIrqProcess(void)
+{
+    sim_radio_event_t irq;
+
+    CRITICAL_SECTION_BEGIN();
+    irq = radio_irq;
+    radio_irq = SIM_RADIO_EVENT_NONE;
+    CRITICAL_SECTION_END();
+
+    if (radio_events == NULL) {
+        return;
+    }
+
+    switch (irq) {
+    case SIM_RADIO_EVENT_TX_DONE:
+        if (radio_events->TxDone != NULL) {
+            radio_events->TxDone();
+        }
+        break;
+    case SIM_RADIO_EVENT_RX_DONE:
+        if (radio_events->RxDone != NULL) {
+            radio_events->RxDone(radio_buffer, radio_size, radio_rssi, radio_snr);
+        }
+        break;
+    case SIM_RADIO_EVENT_RX_TIMEOUT:
+        if (radio_events->RxTimeout != NULL) {
+            radio_events->RxTimeout();
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void RadioRxBoosted(uint32_t timeout)
+{
+    RadioRx(timeout);
+}
+
+static void RadioSetRxDutyCycle(uint32_t rxTime, uint32_t sleepTime)
+{
+}
+
+const struct Radio_s Radio = {
+    .Init                = RadioInit,
+    .GetStatus           = RadioGetStatus,
+    .SetModem            = RadioSetModem,
+    .SetChannel          = RadioSetChannel,
+    .IsChannelFree       = RadioIsChannelFree,
+    .Random              = RadioRandom,
+    .SetRxConfig         = RadioSetRxConfig,
+    .SetTxConfig         = RadioSetTxConfig,
+    .CheckRfFrequency    = RadioCheckRfFrequency,
+    .TimeOnAir           = RadioTimeOnAir,
+    .Send                = RadioSend,
+    .Sleep               = RadioSleep,
+    .Standby             = RadioStandby,
+    .Rx                  = RadioRx,
+    .StartCad            = RadioStartCad,
+    .SetTxContinuousWave = RadioSetTxContinuousWave,
+    .Rssi                = RadioRssi,
+    .Write               = RadioWrite,
+    .Read                = RadioRead,
+    .WriteBuffer         = RadioWriteBuffer,
+    .ReadBuffer          = RadioReadBuffer,
+    .SetMaxPayloadLength = RadioSetMaxPayloadLength,
+    .SetPublicNetwork    = RadioSetPublicNetwork,
+    .GetWakeupTime       = RadioGetWakeupTime,
+    .IrqProcess          = RadioIrqProcess,
+    .RxBoosted           = RadioRxBoosted,
+    .SetRxDutyCycle      = RadioSetRxDutyCycle,
+};
+
+bool sim_radio_next_event(uint32_t *time)
+{
+    if (radio_event != SIM_RADIO_EVENT_NONE) {
+        *time = radio_event_time;
+        return true;
+    }
+    return false;
+}
+
+bool sim_radio_irq_pending()
+{
+    return radio_irq != SIM_RADIO_EVENT_NONE;
+}
+
+// Called from the simulation clock (tick hook) after time has advanced.
+void sim_radio_process(uint32_t now)
+{
+    if ((radio_state == RF_RX_RUNNING) && radio_rx_continuous &&
+        (radio_event == SIM_RADIO_EVENT_NONE)) {
+        radio_rx_lookup(now, 0);
+    }
+
+    if ((radio_event == SIM_RADIO_EVENT_NONE) ||
+        ((int32_t)(now - radio_event_time) < 0)) {
+        return;
+    }
+
+    switch (radio_event) {
+    case SIM_RADIO_EVENT_TX_DONE:
+        radio_state = RF_IDLE;
+        sim_server_uplink(radio_event_time, radio_tx_frequency, radio_tx.sf,
+                          radio_tx.bw, radio_buffer, radio_size);
+        break;
+    case SIM_RADIO_EVENT_RX_DONE:
+        sim_metrics.rx_frames++;
+        radio_rx_stop(radio_event_time);
+        if (radio_rx_continuous) {
+            radio_rx_start = radio_event_time;
+        } else {
+            radio_state = RF_IDLE;
+        }
+        break;
+    case SIM_RADIO_EVENT_RX_TIMEOUT:
+        sim_metrics.rx_timeouts++;
+        radio_rx_stop(radio_event_time);
+        radio_state = RF_IDLE;
+        break;
+    default:
+        break;
+    }
+
+    radio_irq = radio_event;
+    radio_event = SIM_RADIO_EVENT_NONE;
+}
@@ -0,0 +1,540 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <aes.h>
+#include <cmac.h>
+
+#include "sim.h"
+
+// Stand-in LoRaWAN 1.0.x network server for the US915 region.  It accepts
+// joins from any device using the root key of se-identity.h, answers
+// LinkCheckReq and DeviceTimeReq and delivers scripted downlinks in RX1 or
+// RX2.  Uplinks are heard by a single 8 channel gateway unless configured
+// otherwise.
+
+#define NS_NET_ID               0x000013
+#define NS_DEV_ADDR             0x26011234
+#define NS_RX1_DELAY            1000
+#define NS_JOIN_ACCEPT_DELAY1   5000
+#define NS_RX2_FREQUENCY        923300000
+#define NS_RX2_DATARATE         8
+#define NS_DOWNLINK_QUEUE       16
+#define NS_FOPTS_MAX            15
+
+// GPS time at the start of the simulation, 2021-01-01
+#define NS_GPS_EPOCH            1293494418
+
+#define MHDR_JOIN_REQUEST       0x00
+#define MHDR_JOIN_ACCEPT        0x20
+#define MHDR_UNCONFIRMED_UP     0x40
+#define MHDR_UNCONFIRMED_DOWN   0x60
+#define MHDR_CONFIRMED_UP       0x80
+#define MHDR_CONFIRMED_DOWN     0xA0
+
+#define FCTRL_ADR               0x80
+#define FCTRL_ADR_ACK_REQ       0x40
+#define FCTRL_ACK               0x20
+#define FCTRL_FPENDING          0x10
+
+#define CID_LINK_CHECK          0x02
+#define CID_DEVICE_TIME         0x0D
+
+typedef struct {
+    uint8_t port;
+    uint8_t size;
+    bool    confirmed;
+    uint8_t payload[242];
+} ns_downlink_t;
+
+static const uint8_t ns_root_key[16] = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE,
+                                        0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88,
+                                        0x09, 0xCF, 0x4F, 0x3C};
+
+static struct {
+    bool     joined;
+    uint32_t join_nonce;
+    uint8_t  nwk_s_key[16];
+    uint8_t  app_s_key[16];
+    uint32_t fcnt_up;
+    uint32_t fcnt_down;
+
+    int      window;
+    int      subband;
+    int      loss;
+    int16_t  rssi;
+    int8_t   snr;
+
+    ns_downlink_t queue[NS_DOWNLINK_QUEUE];
+    uint32_t      queue_head;
+    uint32_t      queue_tail;
+
+    sim_transmission_t transmission;
+    bool               transmission_planned;
+    bool               transmission_has_data;
+} ns;
+
+static void put_le(uint8_t *p, uint32_t value, int size)
+{
+    for (int i = 0; i < size; i++) {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_le(const uint8_t *p, int size)
+{
+    uint32_t value = 0;
+
+    for (int i = size - 1; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static void cmac(const uint8_t *key, const uint8_t *b0, const uint8_t *data,
+                 uint32_t size, uint8_t *mic)
+{
+    AES_CMAC_CTX ctx;
+    uint8_t digest[16];
+
+    AES_CMAC_Init(&ctx);
+    AES_CMAC_SetKey(&ctx, key);
+    if (b0 != NULL) {
+        AES_CMAC_Update(&ctx, b0, 16);
+    }
+    AES_CMAC_Update(&ctx, data, size);
+    AES_CMAC_Final(digest, &ctx);
+    memcpy(mic, digest, 4);
+}
+
+static void frame_mic(const uint8_t *key, uint8_t dir, uint32_t fcnt,
+                      const uint8_t *frame, uint8_t size, uint8_t *mic)
+{
+    uint8_t b0[16] = {0x49};
+
+    b0[5] = dir;
+    put_le(&b0[6], NS_DEV_ADDR, 4);
+    put_le(&b0[10], fcnt, 4);
+    b0[15] = size;
+    cmac(key, b0, frame, size, mic);
+}
+
+static void payload_crypt(const uint8_t *key, uint8_t dir, uint32_t fcnt,
+                          uint8_t *data, uint8_t size)
+{
+    aes_context ctx;
+    uint8_t a[16];
+    uint8_t s[16];
+
+    aes_set_key(key, 16, &ctx);
+    for (int i = 0; i * 16 < size; i++) {
+        memset(a, 0, sizeof(a));
+        a[0] = 0x01;
+        a[5] = dir;
+        put_le(&a[6], NS_DEV_ADDR, 4);
+        put_le(&a[10], fcnt, 4);
+        a[15] = i + 1;
+        aes_encrypt(a, s, &ctx);
+        for (int j = 0; (j < 16) && (i * 16 + j < size); j++) {
+            data[i * 16 + j] ^= s[j];
+        }
+    }
+}
+
+static uint8_t uplink_datarate(uint8_t sf, uint8_t bw)
+{
+    return (bw == 2) ? 4 : (10 - sf);
+}
+
+static int uplink_channel(uint32_t frequency, uint8_t bw)
+{
+    if (bw == 2) {
+        return 64 + (frequency - 903000000) / 1600000;
+    }
+    return (frequency - 902300000) / 200000;
+}
+
+static bool uplink_heard(int channel)
+{
+    int subband = (channel < 64) ? (channel / 8) : (channel - 64);
+
+    if ((ns.subband >= 0) && (subband != ns.subband)) {
+        sim_metrics.ns_uplinks_unheard++;
+        return false;
+    }
+
+    if ((rand() % 100) < ns.loss) {
+        sim_metrics.ns_uplinks_lost++;
+        return false;
+    }
+
+    return true;
+}
+
+static void plan(uint32_t end, int channel, uint8_t datarate, uint32_t delay,
+                 const uint8_t *frame, uint8_t size)
+{
+    sim_transmission_t *t = &ns.transmission;
+
+    if (ns.window == 2) {
+        t->time = end + delay + 1000;
+        t->frequency = NS_RX2_FREQUENCY;
+        t->sf = 20 - NS_RX2_DATARATE;
+    } else {
+        uint8_t rx1 = (datarate < 4) ? (10 + datarate) : 13;
+
+        t->time = end + delay;
+        t->frequency = 923300000 + (channel % 8) * 600000;
+        t->sf = 20 - rx1;
+    }
+    t->bw = 2;
+    t->rssi = ns.rssi;
+    t->snr = ns.snr;
+    t->size = size;
+    memcpy(t->payload, frame, size);
+
+    ns.transmission_planned = true;
+    sim_metrics.ns_downlinks++;
+}
+
+static void join_request(uint32_t end, int channel, uint8_t datarate,
+                         const uint8_t *frame, uint8_t size)
+{
+    uint8_t mic[4];
+    uint8_t accept[17];
+    uint8_t block[16];
+    aes_context ctx;
+
+    if (size != 23) {
+        return;
+    }
+
+    cmac(ns_root_key, NULL, frame, 19, mic);
+    if (memcmp(mic, &frame[19], 4) != 0) {
+        sim_metrics.ns_mic_failures++;
+        return;
+    }
+
+    ns.join_nonce++;
+
+    // session keys, LoRaWAN 1.0.x derivation
+    aes_set_key(ns_root_key, 16, &ctx);
+    memset(block, 0, sizeof(block));
+    put_le(&block[1], ns.join_nonce, 3);
+    put_le(&block[4], NS_NET_ID, 3);
+    memcpy(&block[7], &frame[17], 2);
+    block[0] = 0x01;
+    aes_encrypt(block, ns.nwk_s_key, &ctx);
+    block[0] = 0x02;
+    aes_encrypt(block, ns.app_s_key, &ctx);
+
+    accept[0] = MHDR_JOIN_ACCEPT;
+    put_le(&accept[1], ns.join_nonce, 3);
+    put_le(&accept[4], NS_NET_ID, 3);
+    put_le(&accept[7], NS_DEV_ADDR, 4);
+    accept[11] = NS_RX2_DATARATE;
+    accept[12] = NS_RX1_DELAY / 1000;
+    cmac(ns_root_key, NULL, accept, 13, &accept[13]);
+
+    // the device encrypts to decrypt the join accept
+    aes_decrypt(&accept[1], block, &ctx);
+    memcpy(&accept[1], block, 16);
+
+    ns.joined = true;
+    ns.fcnt_up = 0;
+    ns.fcnt_down = 0;
+    ns.transmission_has_data = false;
+    sim_metrics.ns_joins++;
+
+    plan(end, channel, datarate, NS_JOIN_ACCEPT_DELAY1, accept, sizeof(accept));
+}
+
+// Parses the MAC commands of an uplink.  Parsing stops at the first
+// unknown command as its length, and therefore the rest, is unknown.
+static int mac_commands(const uint8_t *cmd, int size, bool *link_check,
+                        bool *device_time)
+{
+    static const uint8_t length[] = {0, 0, 0, 1, 0, 1, 2, 1, 0, 0, 1};
+    int i = 0;
+
+    while (i < size) {
+        uint8_t cid = cmd[i++];
+
+        if (cid == CID_LINK_CHECK) {
+            *link_check = true;
+        } else if (cid == CID_DEVICE_TIME) {
+            *device_time = true;
+        } else if ((cid >= 3) && (cid < sizeof(length))) {
+            i += length[cid];
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint8_t build_downlink(uint8_t *downlink, bool ack, const uint8_t *fopts,
+                              uint8_t fopts_len)
+{
+    ns_downlink_t *data = NULL;
+    uint8_t n = 0;
+
+    if (ns.queue_head != ns.queue_tail) {
+        data = &ns.queue[ns.queue_tail % NS_DOWNLINK_QUEUE];
+    }
+
+    downlink[n++] = ((data != NULL) && data->confirmed) ? MHDR_CONFIRMED_DOWN
+                                                        : MHDR_UNCONFIRMED_DOWN;
+    put_le(&downlink[n], NS_DEV_ADDR, 4);
+    n += 4;
+    downlink[n++] = (ack ? FCTRL_ACK : 0) | fopts_len |
+                    (((ns.queue_head - ns.queue_tail) > 1) ? FCTRL_FPENDING : 0);
+    put_le(&downlink[n], ns.fcnt_down, 2);
+    n += 2;
+    if (fopts_len > 0) {
+        memcpy(&downlink[n], fopts, fopts_len);
+        n += fopts_len;
+    }
+    if (data != NULL) {
+        downlink[n++] = data->port;
+        memcpy(&downlink[n], data->payload, data->size);
+        payload_crypt(data->port ? ns.app_s_key : ns.nwk_s_key, 1,
+                      ns.fcnt_down, &downlink[n], data->size);
+        n += data->size;
+    }
+    frame_mic(ns.nwk_s_key, 1, ns.fcnt_down, downlink, n, &downlink[n]);
+    n += 4;
+    ns.fcnt_down++;
+
+    ns.transmission_has_data = (data != NULL);
+    return n;
+}
+
+static void data_uplink(uint32_t end, int channel, uint8_t datarate,
+                        const uint8_t *frame, uint8_t size)
+{
+    uint8_t mic[4];
+    uint8_t fctrl, fopts_len;
+    uint32_t fcnt;
+    bool confirmed, link_check = false, device_time = false;
+    uint8_t downlink[255];
+    uint8_t fopts[NS_FOPTS_MAX];
+    uint8_t n, i = 0;
+
+    if (!ns.joined || (size < 12) || (get_le(&frame[1], 4) != NS_DEV_ADDR)) {
+        return;
+    }
+
+    fctrl = frame[5];
+    fopts_len = fctrl & 0x0F;
+    fcnt = (ns.fcnt_up & 0xFFFF0000) | get_le(&frame[6], 2);
+    if (fcnt < ns.fcnt_up) {
+        fcnt += 0x10000;
+    }
+
+    frame_mic(ns.nwk_s_key, 0, fcnt, frame, size - 4, mic);
+    if (memcmp(mic, &frame[size - 4], 4) != 0) {
+        sim_metrics.ns_mic_failures++;
+        return;
+    }
+    ns.fcnt_up = fcnt;
+
+    confirmed = (frame[0] & 0xE0) == MHDR_CONFIRMED_UP;
+    if (fctrl & FCTRL_ACK) {
+        sim_metrics.ns_acks++;
+    }
+
+    mac_commands(&frame[8], fopts_len, &link_check, &device_time);
+    if ((size > 12 + fopts_len) && (frame[8 + fopts_len] == 0)) {
+        uint8_t port0[255];
+        uint8_t port0_size = size - 13 - fopts_len;
+
+        memcpy(port0, &frame[9 + fopts_len], port0_size);
+        payload_crypt(ns.nwk_s_key, 0, fcnt, port0, port0_size);
+        mac_commands(port0, port0_size, &link_check, &device_time);
+    }
+
+    if (link_check) {
+        fopts[i++] = CID_LINK_CHECK;
+        fopts[i++] = (ns.snr + 20 > 0) ? (ns.snr + 20) : 0;
+        fopts[i++] = 1;
+    }
+    if (device_time) {
+        fopts[i++] = CID_DEVICE_TIME;
+        put_le(&fopts[i], NS_GPS_EPOCH + end / 1000, 4);
+        fopts[i + 4] = (end % 1000) * 256 / 1000;
+        i += 5;
+    }
+
+    if (!confirmed && (i == 0) && (ns.queue_head == ns.queue_tail) &&
+        !(fctrl & FCTRL_ADR_ACK_REQ)) {
+        return;
+    }
+
+    n = build_downlink(downlink, confirmed, fopts, i);
+    plan(end, channel, datarate, NS_RX1_DELAY, downlink, n);
+}
+
+void sim_server_init()
+{
+    memset(&ns, 0, sizeof(ns));
+    ns.window = 1;
+    ns.subband = -1;
+    ns.rssi = -80;
+    ns.snr = 8;
+}
+
+void sim_server_uplink(uint32_t end, uint32_t frequency, uint8_t sf, uint8_t bw,
+                       const uint8_t *frame, uint8_t size)
+{
+    int channel = uplink_channel(frequency, bw);
+    uint8_t datarate = uplink_datarate(sf, bw);
+
+    if ((size < 1) || !uplink_heard(channel)) {
+        return;
+    }
+    sim_metrics.ns_uplinks++;
+
+    // a new uplink supersedes whatever was not delivered
+    ns.transmission_planned = false;
+
+    switch (frame[0] & 0xE0) {
+    case MHDR_JOIN_REQUEST:
+        join_request(end, channel, datarate, frame, size);
+        break;
+    case MHDR_UNCONFIRMED_UP:
+    case MHDR_CONFIRMED_UP:
+        data_uplink(end, channel, datarate, frame, size);
+        break;
+    default:
+        break;
+    }
+}
+
+const sim_transmission_t *sim_server_transmission()
+{
+    return ns.transmission_planned ? &ns.transmission : NULL;
+}
+
+void sim_server_delivered()
+{
+    if (ns.transmission_has_data) {
+        ns.queue_tail++;
+        ns.transmission_has_data = false;
+    }
+    ns.transmission_planned = false;
+}
+
+bool sim_server_next_event(uint32_t *time)
+{
+    if (ns.transmission_planned) {
+        *time = ns.transmission.time;
+    }
+    return ns.transmission_planned;
+}
+
+void sim_server_process(uint32_t now)
+{
+    const sim_transmission_t *t = &ns.transmission;
+
+    if (ns.transmission_planned &&
+        ((int32_t)(now - t->time) > (int32_t)sim_radio_time_on_air(t->sf, t->bw, 8, t->size))) {
+        // nobody was listening, queued data is kept for the next uplink
+        ns.transmission_planned = false;
+        ns.transmission_has_data = false;
+        sim_metrics.ns_downlinks_missed++;
+    }
+}
+
+static int parse_hex(const char *hex, uint8_t *data, int max)
+{
+    int size = 0;
+    unsigned int byte;
+
+    while (hex[0] && hex[1] && (size < max)) {
+        if (sscanf(hex, "%2x", &byte) != 1) {
+            return -1;
+        }
+        data[size++] = byte;
+        hex += 2;
+    }
+    return *hex ? -1 : size;
+}
+
+int sim_server_command(int argc, char **argv)
+{
+    if ((argc >= 3) && (strcmp(argv[1], "downlink") == 0)) {
+        ns_downlink_t *d = &ns.queue[ns.queue_head % NS_DOWNLINK_QUEUE];
+        int size = (argc >= 4) ? parse_hex(argv[3], d->payload, sizeof(d->payload)) : 0;
+
+        if ((size < 0) || (ns.queue_head - ns.queue_tail >= NS_DOWNLINK_QUEUE)) {
+            return -1;
+        }
+        d->port = atoi(argv[2]);
+        d->size = size;
+        d->confirmed = (argc >= 5) && (strcmp(argv[4], "confirmed") == 0);
+        ns.queue_head++;
+    } else if ((argc == 2) && (strcmp(argv[1], "push") == 0)) {
+        // class C delivery on the RX2 parameters without waiting for an uplink
+        sim_transmission_t *t = &ns.transmission;
+
+        if (!ns.joined || (ns.queue_head == ns.queue_tail)) {
+            return -1;
+        }
+        t->size = build_downlink(t->payload, false, NULL, 0);
+        t->time = sim_time_now() + 100;
+        t->frequency = NS_RX2_FREQUENCY;
+        t->sf = 20 - NS_RX2_DATARATE;
+        t->bw = 2;
+        t->rssi = ns.rssi;
+        t->snr = ns.snr;
+        ns.transmission_planned = true;
+        sim_metrics.ns_downlinks++;
+    } else if ((argc == 3) && (strcmp(argv[1], "window") == 0)) {
+        ns.window = atoi(argv[2]);
+    } else if ((argc == 3) && (strcmp(argv[1], "loss") == 0)) {
+        ns.loss = atoi(argv[2]);
+    } else if ((argc == 4) && (strcmp(argv[1], "link") == 0)) {
+        ns.rssi = atoi(argv[2]);
+        ns.snr = atoi(argv[3]);
+    } else if ((argc == 3) && (strcmp(argv[1], "subband") == 0)) {
+        ns.subband = (strcmp(argv[2], "all") == 0) ? -1 : atoi(argv[2]);
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
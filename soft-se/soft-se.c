@@ -39,6 +39,24 @@
 
 static SecureElementNvmData_t* SeNvm;
 
+/*
+ * Number of multicast key identifiers, from MC_KEY_0 to MC_NWK_S_KEY_3
+ */
+#define MC_KEY_SCHEDULE_CACHE_SIZE ( MC_NWK_S_KEY_3 - MC_KEY_0 + 1 )
+
+/*
+ * Expanded AES key schedules of the multicast keys. The schedules are
+ * computed on first use after SecureElementSetKey and reused for every
+ * frame of the multicast session.
+ */
+typedef struct sKeySchedule
+{
+    bool        IsValid;
+    aes_context Context;
+} KeySchedule_t;
+
+static KeySchedule_t McKeySchedules[MC_KEY_SCHEDULE_CACHE_SIZE];
+
 /*
  * Local functions
  */
@@ -63,6 +81,44 @@ static SecureElementStatus_t GetKeyByID( KeyIdentifier_t keyID, Key_t** keyItem
     return SECURE_ELEMENT_ERROR_INVALID_KEY_ID;
 }
 
+/*
+ * Gets the cached key schedule of a multicast key, expanding it if needed.
+ *
+ * \param[IN]  keyItem        - Key item
+ * \retval                    - Key schedule or NULL if the key is not cached
+ */
+static const aes_context* GetKeySchedule( Key_t* keyItem )
+{
+    if( ( keyItem->KeyID < MC_KEY_0 ) || ( keyItem->KeyID > MC_NWK_S_KEY_3 ) )
+    {
+        return NULL;
+    }
+
+    KeySchedule_t* schedule = &McKeySchedules[keyItem->KeyID - MC_KEY_0];
+
+    if( schedule->IsValid == false )
+    {
+        memset1( schedule->Context.ksch, '\0', 240 );
+        aes_set_key( keyItem->KeyValue, 16, &schedule->Context );
+        schedule->IsValid = true;
+    }
+
+    return &schedule->Context;
+}
+
+/*
+ * Drops the cached key schedule of a key after its value changed.
+ *
+ * \param[IN]  keyID          - Key identifier
+ */
+static void InvalidateKeySchedule( KeyIdentifier_t keyID )
+{
+    if( ( keyID >= MC_KEY_0 ) && ( keyID <= MC_NWK_S_KEY_3 ) )
+    {
+        McKeySchedules[keyID - MC_KEY_0].IsValid = false;
+    }
+}
+
 /*
  * Computes a CMAC of a message using provided initial Bx block
  *
@@ -93,7 +149,16 @@ static SecureElementStatus_t ComputeCmac( uint8_t* micBxBuffer, uint8_t* buffer,
 
     if( retval == SECURE_ELEMENT_SUCCESS )
     {
-        AES_CMAC_SetKey( aesCmacCtx, keyItem->KeyValue );
+        const aes_context* schedule = GetKeySchedule( keyItem );
+
+        if( schedule != NULL )
+        {
+            memcpy1( ( uint8_t* )&aesCmacCtx->rijndael, ( const uint8_t* )schedule, sizeof( aes_context ) );
+        }
+        else
+        {
+            AES_CMAC_SetKey( aesCmacCtx, keyItem->KeyValue );
+        }
 
         if( micBxBuffer != NULL )
         {
@@ -152,6 +217,7 @@ SecureElementStatus_t SecureElementInit( SecureElementNvmData_t* nvm )
 
     // Initialize data
     memcpy1( ( uint8_t* )SeNvm, ( uint8_t* )&seNvmInit, sizeof( seNvmInit ) );
+    memset1( ( uint8_t* )McKeySchedules, 0, sizeof( McKeySchedules ) );
 
 #if !defined( SECURE_ELEMENT_PRE_PROVISIONED )
 #if( STATIC_DEVICE_EUI == 0 )
@@ -173,6 +239,8 @@ SecureElementStatus_t SecureElementSetKey( KeyIdentifier_t keyID, uint8_t* key )
     {
         if( SeNvm->KeyList[i].KeyID == keyID )
         {
+            InvalidateKeySchedule( keyID );
+
             if( ( keyID == MC_KEY_0 ) || ( keyID == MC_KEY_1 ) || ( keyID == MC_KEY_2 ) || ( keyID == MC_KEY_3 ) )
             {  // Decrypt the key if its a Mckey
                 SecureElementStatus_t retval           = SECURE_ELEMENT_ERROR;
@@ -244,21 +312,27 @@ SecureElementStatus_t SecureElementAesEncrypt( uint8_t* buffer, uint16_t size, K
         return SECURE_ELEMENT_ERROR_BUF_SIZE;
     }
 
-    aes_context aesContext;
-    memset1( aesContext.ksch, '\0', 240 );
+    aes_context        aesContext;
+    const aes_context* schedule;
 
     Key_t*                pItem;
     SecureElementStatus_t retval = GetKeyByID( keyID, &pItem );
 
     if( retval == SECURE_ELEMENT_SUCCESS )
     {
-        aes_set_key( pItem->KeyValue, 16, &aesContext );
+        schedule = GetKeySchedule( pItem );
+        if( schedule == NULL )
+        {
+            memset1( aesContext.ksch, '\0', 240 );
+            aes_set_key( pItem->KeyValue, 16, &aesContext );
+            schedule = &aesContext;
+        }
 
         uint8_t block = 0;
 
         while( size != 0 )
         {
-            aes_encrypt( &buffer[block], &encBuffer[block], &aesContext );
+            aes_encrypt( &buffer[block], &encBuffer[block], schedule );
             block = block + 16;
             size  = size - 16;
         }
@@ -0,0 +1,145 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "lorawan_config.h"
+#include "token_log.h"
+
+// A record is a header word, the tick count and the arguments.  Writers
+// reserve their words by moving head with a compare and swap and publish
+// the record by writing its header last, so that tasks never wait for
+// each other.  The console reads from tail and clears what it has read,
+// a zero header is a record still being written.  A full ring drops the
+// new records and counts them.
+#if (LORAWAN_TOKEN_LOG_WORDS & (LORAWAN_TOKEN_LOG_WORDS - 1)) != 0
+#error "LORAWAN_TOKEN_LOG_WORDS must be a power of two"
+#endif
+
+#define RING_MASK (LORAWAN_TOKEN_LOG_WORDS - 1)
+
+#define HEADER_VALID    0x80000000
+#define HEADER_ARGC(h)  (((h) >> 24) & 0x0F)
+#define HEADER_ID(h)    ((h) & 0x00FFFFFF)
+
+extern const char __start_token_log[];
+
+static uint32_t ring[LORAWAN_TOKEN_LOG_WORDS];
+static uint32_t ring_head;
+static uint32_t ring_tail;
+
+static token_log_stats_t log_stats;
+
+void token_log_write(const char *format, const uint32_t *args, uint32_t argc)
+{
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    uint32_t length;
+    uint32_t used;
+
+    if (argc > TOKEN_LOG_ARGS) {
+        argc = TOKEN_LOG_ARGS;
+    }
+    length = 2 + argc;
+
+    do {
+        used = head + length - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+        if (used > LORAWAN_TOKEN_LOG_WORDS) {
+            __atomic_fetch_add(&log_stats.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&ring_head, &head, head + length,
+                                          true, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    ring[(head + 1) & RING_MASK] = xTaskGetTickCount();
+    for (uint32_t i = 0; i < argc; i++) {
+        ring[(head + 2 + i) & RING_MASK] = args[i];
+    }
+    __atomic_store_n(&ring[head & RING_MASK],
+                     HEADER_VALID | (argc << 24) |
+                         (uint32_t)(format - __start_token_log),
+                     __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&log_stats.written, 1, __ATOMIC_RELAXED);
+    if (used > log_stats.high_water) {
+        log_stats.high_water = used;
+    }
+}
+
+// Copies the oldest record without removing it, returns false if there
+// is none yet.
+bool token_log_peek(token_log_record_t *record)
+{
+    uint32_t tail = ring_tail;
+    uint32_t header = __atomic_load_n(&ring[tail & RING_MASK],
+                                      __ATOMIC_ACQUIRE);
+
+    if (header == 0) {
+        return false;
+    }
+
+    record->id = HEADER_ID(header);
+    record->argc = HEADER_ARGC(header);
+    record->time = ring[(tail + 1) & RING_MASK];
+    for (uint32_t i = 0; i < record->argc; i++) {
+        record->args[i] = ring[(tail + 2 + i) & RING_MASK];
+    }
+
+    return true;
+}
+
+void token_log_consume()
+{
+    uint32_t tail = ring_tail;
+    uint32_t header = ring[tail & RING_MASK];
+    uint32_t length;
+
+    if (header == 0) {
+        return;
+    }
+
+    // a later record may start on any of these words
+    length = 2 + HEADER_ARGC(header);
+    for (uint32_t i = 0; i < length; i++) {
+        ring[(tail + i) & RING_MASK] = 0;
+    }
+    __atomic_store_n(&ring_tail, tail + length, __ATOMIC_RELEASE);
+}
+
+void token_log_stats(token_log_stats_t *stats)
+{
+    memcpy(stats, &log_stats, sizeof(token_log_stats_t));
+}
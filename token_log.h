@@ -0,0 +1,72 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _TOKEN_LOG_H_
+#define _TOKEN_LOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Most arguments of a record, further ones are dropped
+#define TOKEN_LOG_ARGS 8
+
+typedef struct {
+    uint32_t id;
+    uint32_t time;
+    uint32_t argc;
+    uint32_t args[TOKEN_LOG_ARGS];
+} token_log_record_t;
+
+typedef struct {
+    uint32_t written;
+    uint32_t dropped;
+    uint32_t high_water;
+} token_log_stats_t;
+
+// Logs the integer arguments of format without formatting them.  The
+// format string only goes to the token_log section of the ELF, the record
+// holds its offset there and tools/token_log.py prints the text.
+#define TOKEN_LOG(format, ...)                                              \
+    do {                                                                    \
+        static const char token_log_format[]                                \
+            __attribute__((section("token_log"), used)) = format;           \
+        const uint32_t token_log_args[] = {0, ##__VA_ARGS__};               \
+        token_log_write(token_log_format, &token_log_args[1],               \
+                        sizeof(token_log_args) / sizeof(uint32_t) - 1);     \
+    } while (0)
+
+extern void token_log_write(const char *format, const uint32_t *args,
+                            uint32_t argc);
+extern bool token_log_peek(token_log_record_t *record);
+extern void token_log_consume();
+extern void token_log_stats(token_log_stats_t *stats);
+
+#endif /* _TOKEN_LOG_H_ */
@@ -0,0 +1,113 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2021, Northern Mechatronics, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <FreeRTOS.h>
+#include <FreeRTOS_CLI.h>
+
+#include "cli_table.h"
+#include "cli_writer.h"
+#include "lorawan_config.h"
+#include "token_log.h"
+#include "token_log_cli.h"
+
+// "L <time> <id> <args...>" in hex, the longest record
+#define RECORD_LINE (2 + 9 + 7 + 9 * TOKEN_LOG_ARGS + 3)
+
+static portBASE_TYPE token_log_command(char *pcWriteBuffer,
+                                       size_t xWriteBufferLen,
+                                       const char *pcCommandString);
+
+CLI_Command_Definition_t token_log_command_definition = {
+    (const char *const) "log",
+    (const char *const) "log:\tTokenized log.\r\n",
+    token_log_command, -1};
+
+// Records are only removed from the ring once they made it into a page
+static portBASE_TYPE token_log_dump(cli_writer_t *writer,
+                                    const char *pcCommandString)
+{
+    token_log_record_t record;
+    char buffer[RECORD_LINE];
+    cli_writer_t line;
+
+    while (token_log_peek(&record)) {
+        cli_writer_init(&line, buffer, sizeof(buffer));
+        cli_writer_printf(&line, "L %08x %06x", record.time, record.id);
+        for (uint32_t i = 0; i < record.argc; i++) {
+            cli_writer_printf(&line, " %08x", record.args[i]);
+        }
+        cli_writer_puts(&line, "\r\n");
+
+        if (!cli_writer_puts(writer, buffer)) {
+            return pdTRUE;
+        }
+        token_log_consume();
+    }
+
+    return pdFALSE;
+}
+
+static portBASE_TYPE token_log_status(cli_writer_t *writer,
+                                      const char *pcCommandString)
+{
+    token_log_stats_t stats;
+
+    token_log_stats(&stats);
+    cli_writer_printf(writer,
+                      "%d records, %d dropped, high water %d of %d words\r\n",
+                      stats.written, stats.dropped, stats.high_water,
+                      LORAWAN_TOKEN_LOG_WORDS);
+
+    return pdFALSE;
+}
+
+// Sorted by name
+static const cli_subcommand_t token_log_subcommands[] = {
+    {"dump", NULL,
+     "Print and remove the records, decode them with tools/token_log.py.\r\n",
+     0, 0, token_log_dump},
+    {"stats", NULL, "Show the records written and dropped.\r\n", 0, 0,
+     token_log_status},
+};
+
+const cli_table_t token_log_command_table =
+    CLI_TABLE("log", token_log_subcommands);
+
+static portBASE_TYPE token_log_command(char *pcWriteBuffer,
+                                       size_t xWriteBufferLen,
+                                       const char *pcCommandString)
+{
+    return cli_table_dispatch(&token_log_command_table, pcWriteBuffer,
+                              xWriteBufferLen, pcCommandString);
+}
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# Monte Carlo comparison of the join retry strategies in lorawan.c
+#
+# Models a US915 device whose network only listens on one sub-band.  The
+# baseline retries immediately on all 72 channels; the scheduler restricts
+# each attempt to one sub-band, backs off exponentially within each sweep
+# of the sub-bands and starts over with the next one.  Once a sub-band has
+# been learned on a previous join every other attempt goes to it.
+
+import argparse
+import random
+
+JOIN_TOA = 0.371            # join request at DR0, seconds
+JOIN_ACCEPT_DELAY2 = 6.0    # end of the RX2 window after the join request
+BACKOFF_MIN = 8.0
+BACKOFF_MAX = 3600.0
+SUBBAND_ATTEMPTS = 2
+SUBBANDS = 8
+DEFAULT_SUBBAND = 1
+
+
+def dc_off_time(elapsed):
+    if elapsed < 3600:
+        return JOIN_TOA * 99
+    elif elapsed < 11 * 3600:
+        return JOIN_TOA * 999
+    return JOIN_TOA * 9999
+
+
+def attempt(t, outage, p_link, on_subband):
+    return t >= outage and on_subband and random.random() < p_link
+
+
+def baseline(network_subband, outage, p_link):
+    t = 0.0
+    attempts = 0
+    while True:
+        attempts += 1
+        # the stack alternates a random 125 kHz channel and a random 500 kHz
+        # channel, each hits the network sub-band 1 time out of 8
+        if attempt(t, outage, p_link, random.randrange(SUBBANDS) == network_subband):
+            return t + JOIN_TOA + JOIN_ACCEPT_DELAY2, attempts
+        t += JOIN_TOA + JOIN_ACCEPT_DELAY2
+
+
+def sweep_subband(position, learned):
+    if learned is None:
+        return (DEFAULT_SUBBAND + position // SUBBAND_ATTEMPTS) % SUBBANDS
+    if position % 2 == 0:
+        return learned
+    return (learned + 1 + position // (2 * SUBBAND_ATTEMPTS)) % SUBBANDS
+
+
+def scheduler(network_subband, outage, p_link, learned):
+    t = 0.0
+    attempts = 0
+    position = 0
+    if learned is None:
+        length = SUBBANDS * SUBBAND_ATTEMPTS
+    else:
+        length = 2 * (SUBBANDS - 1) * SUBBAND_ATTEMPTS
+    while True:
+        attempts += 1
+        if attempt(t, outage, p_link, sweep_subband(position, learned) == network_subband):
+            return t + JOIN_TOA + JOIN_ACCEPT_DELAY2, attempts
+        t += JOIN_TOA + JOIN_ACCEPT_DELAY2
+        position = (position + 1) % length
+        exponent = position // (2 * SUBBAND_ATTEMPTS)
+        delay = min(BACKOFF_MAX, BACKOFF_MIN * 2 ** min(exponent, 16))
+        delay = delay / 2 + random.uniform(0, delay / 2)
+        t += max(delay, dc_off_time(t))
+
+
+def run(name, fn, runs):
+    times = []
+    tries = []
+    for _ in range(runs):
+        dt, n = fn()
+        times.append(dt)
+        tries.append(n)
+    times.sort()
+    airtime = sum(tries) / runs * JOIN_TOA
+    print('  {:<28s} median {:8.0f} s  p90 {:8.0f} s  attempts {:7.1f}  airtime {:6.1f} s'.format(
+        name, times[runs // 2], times[runs * 9 // 10], sum(tries) / runs, airtime))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='join retry simulation')
+    parser.add_argument('--runs', type=int, default=2000)
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    net = 3
+
+    for outage, p_link in ((0, 0.9), (0, 0.3), (3600, 0.9), (6 * 3600, 0.3)):
+        print('outage {:5d} s, link success {:.1f}'.format(outage, p_link))
+        run('baseline', lambda: baseline(net, outage, p_link), args.runs)
+        run('scheduler, unknown sub-band', lambda: scheduler(net, outage, p_link, None), args.runs)
+        run('scheduler, learned sub-band', lambda: scheduler(net, outage, p_link, net), args.runs)
+        run('scheduler, stale sub-band', lambda: scheduler(net, outage, p_link, (net + 4) % SUBBANDS), args.runs)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+# Host side of the binary console framing in lorawan_frame.c
+#
+# Enter the mode with "lorawan frame" on the text console, then stream
+# frames.  Each frame is COBS encoded, zero delimited and carries a
+# CRC-16/CCITT of its contents.  Without --serial the frames are written
+# to stdout, e.g. to feed the host simulation.
+
+import argparse
+import binascii
+import struct
+import sys
+import time
+
+SEND = 0x01
+STATS = 0x02
+CONFIG = 0x03
+EXIT = 0x04
+BATCH = 0x05
+REPLY = 0x80
+
+CONFIG_ITEMS = {'drain': 0x01, 'power': 0x02, 'hint': 0x03, 'reset': 0x04}
+STATUS = ['ok', 'crc', 'length', 'unknown', 'busy']
+COMMAND_STATUS = ['ok', 'error', 'usage', 'unknown']
+TRUNCATED = 0x80
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_index = 0
+    for b in data:
+        if b == 0:
+            out[code_index] = len(out) - code_index
+            code_index = len(out)
+            out.append(0)
+        else:
+            out.append(b)
+            if len(out) - code_index == 0xFF:
+                out[code_index] = 0xFF
+                code_index = len(out)
+                out.append(0)
+    out[code_index] = len(out) - code_index
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def frame(kind, sequence, body=b''):
+    data = bytes([kind, sequence & 0xFF]) + body
+    data += struct.pack('>H', binascii.crc_hqx(data, 0xFFFF))
+    return b'\x00' + cobs_encode(data) + b'\x00'
+
+
+def parse_reply(data):
+    data = cobs_decode(data)
+    if len(data) < 5 or binascii.crc_hqx(data, 0xFFFF) != 0:
+        return None
+    return data[0] & ~REPLY, data[1], data[2], data[3:-2]
+
+
+def parse_batch(body):
+    elapsed, count = struct.unpack_from('<IB', body)
+    offset = 5
+    results = []
+    for _ in range(count):
+        status, length = struct.unpack_from('<BH', body, offset)
+        offset += 3
+        results.append((status, body[offset:offset + length]))
+        offset += length
+    return elapsed, results
+
+
+def text_bytes(size):
+    # "lorawan send 2 0 " followed by \xNN per byte and the line end
+    return len('lorawan send 2 0 ') + 4 * size + 1
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--serial', help='console serial port')
+    parser.add_argument('--baud', type=int, default=115200)
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('send')
+    p.add_argument('port', type=int)
+    p.add_argument('payload', help='hex')
+    p.add_argument('--confirmed', action='store_true')
+    p.add_argument('--key', type=int, default=0)
+    p.add_argument('--count', type=int, default=1)
+    sub.add_parser('stats')
+    p = sub.add_parser('config')
+    p.add_argument('item', choices=CONFIG_ITEMS.keys())
+    p.add_argument('value', type=int, nargs='?', default=0)
+    sub.add_parser('exit')
+    p = sub.add_parser('batch', help='run console commands in one frame')
+    p.add_argument('commands', nargs='*')
+    p.add_argument('--file', help='commands, one per line')
+    p = sub.add_parser('rate', help='console bytes per uplink, text vs binary')
+    p.add_argument('size', type=int)
+    args = parser.parse_args()
+
+    if args.command == 'rate':
+        payload = bytes([0x5A]) * args.size
+        binary = len(frame(SEND, 0, bytes([2, 0, 0]) + payload))
+        text = text_bytes(args.size)
+        print('text %d bytes, binary %d bytes, %.1fx' %
+              (text, binary, text / binary))
+        return
+
+    frames = []
+    if args.command == 'send':
+        body = bytes([args.port, 1 if args.confirmed else 0, args.key])
+        body += bytes.fromhex(args.payload)
+        frames = [frame(SEND, i, body) for i in range(args.count)]
+    elif args.command == 'stats':
+        frames = [frame(STATS, 0)]
+    elif args.command == 'config':
+        item = CONFIG_ITEMS[args.item]
+        value = struct.pack('<I', args.value) if args.item == 'hint' else \
+            bytes([args.value]) if args.item != 'reset' else b''
+        frames = [frame(CONFIG, 0, bytes([item]) + value)]
+    elif args.command == 'exit':
+        frames = [frame(EXIT, 0)]
+    elif args.command == 'batch':
+        commands = list(args.commands)
+        if args.file:
+            with open(args.file) as f:
+                commands += [l.strip() for l in f if l.strip()]
+        frames = [frame(BATCH, 0, '\n'.join(commands).encode())]
+
+    if args.serial is None:
+        sys.stdout.buffer.write(b''.join(frames))
+        return
+
+    import serial
+    with serial.Serial(args.serial, args.baud, timeout=1) as s:
+        start = time.monotonic()
+        s.write(b''.join(frames))
+        replies = 0
+        buffer = b''
+        while replies < len(frames):
+            chunk = s.read(256)
+            if not chunk:
+                break
+            buffer += chunk
+            *complete, buffer = buffer.split(b'\x00')
+            for data in complete:
+                reply = parse_reply(data) if data else None
+                if reply is None:
+                    continue
+                replies += 1
+                kind, sequence, status, body = reply
+                if kind == BATCH and status == 0:
+                    elapsed, results = parse_batch(body)
+                    for status, output in results:
+                        print('= %s%s' % (COMMAND_STATUS[status & 0x7F],
+                                          ' (truncated)'
+                                          if status & TRUNCATED else ''))
+                        sys.stdout.write(output.decode(errors='replace'))
+                    print('%d commands in %d ms' % (len(results), elapsed))
+                    continue
+                print('%02x %3d %s %s' % (kind, sequence, STATUS[status],
+                                          body.hex()))
+        elapsed = time.monotonic() - start
+        print('%d replies in %.3f s' % (replies, elapsed))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+# Decoder for the tokenized log in token_log.c
+#
+# "log dump" on the console prints one record per line,
+#
+#   L <ticks> <id> <arguments...>
+#
+# in hex, where id is the offset of the format string in the token_log
+# section of the firmware ELF.  Pass a console capture (or stdin) and the
+# ELF the device runs, other lines are passed through unchanged.
+
+import argparse
+import re
+import struct
+import sys
+
+RECORD = re.compile(r'^L ([0-9a-f]{8}) ([0-9a-f]{6})((?: [0-9a-f]{8})*)\s*$')
+CONVERSION = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l)?([diuxXoc%])')
+
+
+def elf_section(path, name):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] != b'\x7fELF' or data[5] != 1:
+        raise SystemExit('%s: not a little-endian ELF' % path)
+    if data[4] == 1:
+        shoff, = struct.unpack_from('<I', data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x2E)
+        header = '<IIIIIIIIII'
+    else:
+        shoff, = struct.unpack_from('<Q', data, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x3A)
+        header = '<IIQQQQIIQQ'
+
+    sections = [struct.unpack_from(header, data, shoff + i * shentsize)
+                for i in range(shnum)]
+    strings = sections[shstrndx]
+    for s in sections:
+        start = strings[4] + s[0]
+        if data[start:data.index(b'\0', start)].decode() == name:
+            return data[s[4]:s[4] + s[5]]
+    raise SystemExit('%s: no %s section' % (path, name))
+
+
+def format_record(formats, id, args):
+    end = formats.find(b'\0', id)
+    if id >= len(formats) or end < 0:
+        return 'unknown format %06x %s' % (id, ' '.join(map(hex, args)))
+    args = list(args)
+
+    def convert(match):
+        flags, kind = match.groups()
+        if kind == '%':
+            return '%'
+        value = args.pop(0) if args else 0
+        if kind in 'di':
+            value -= (value & 0x80000000) << 1
+            kind = 'd'
+        elif kind == 'u':
+            kind = 'd'
+        elif kind == 'c':
+            value = chr(value & 0xFF)
+        return ('%' + flags + kind) % value
+
+    return CONVERSION.sub(convert, formats[id:end].decode())
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('elf', help='firmware or lorawan-sim ELF')
+    parser.add_argument('capture', nargs='?', help='console output')
+    parser.add_argument('--tick', type=float, default=1.0,
+                        help='ms per tick')
+    args = parser.parse_args()
+
+    formats = elf_section(args.elf, 'token_log')
+    capture = open(args.capture) if args.capture else sys.stdin
+    for line in capture:
+        match = RECORD.match(line)
+        if match is None:
+            sys.stdout.write(line)
+            continue
+        time, id, values = match.groups()
+        values = [int(v, 16) for v in values.split()]
+        print('%10.3f %s' % (int(time, 16) * args.tick / 1000,
+                             format_record(formats, int(id, 16), values)))
+
+
+if __name__ == '__main__':
+    main()